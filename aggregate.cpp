@@ -0,0 +1,321 @@
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  This file contains the implementation of --aggregate. See aggregate.h for
+  an overview.
+
+  The areas are split into ranges of a fixed size, each reduced on the
+  shared ThreadPool to a partial result (a running sum, count, minimum and
+  maximum) for every measure and year, and the partial results are then
+  merged in the order of the ranges. As the ranges don't depend on the
+  number of threads, neither do the sums.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <future>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "aggregate.h"
+#include "area.h"
+#include "areas.h"
+#include "measure.h"
+#include "threadpool.h"
+
+namespace {
+
+/*
+  The number of areas reduced by each task.
+*/
+constexpr size_t AGGREGATE_RANGE_AREAS = 1024;
+
+/*
+  The reduction of the values for one measure and year, so far.
+*/
+struct Partial {
+  double sum = 0;
+  double weights = 0;
+  double min = std::numeric_limits<double>::infinity();
+  double max = -std::numeric_limits<double>::infinity();
+  size_t count = 0;
+
+  void add(double value, double weight) {
+    sum += value * weight;
+    weights += weight;
+    min = value < min ? value : min;
+    max = value > max ? value : max;
+    count++;
+  }
+
+  void merge(const Partial& other) {
+    sum += other.sum;
+    weights += other.weights;
+    min = other.min < min ? other.min : min;
+    max = other.max > max ? other.max : max;
+    count += other.count;
+  }
+};
+
+/*
+  A measure's label and the reduction of its values for each year.
+*/
+struct MeasurePartials {
+  std::string label;
+  std::map<int, Partial> years;
+};
+
+using Partials = std::map<std::string, MeasurePartials>;
+
+/*
+  Reduce the values of areas [first, last). For a weighted mean, a value only
+  counts if the same area has a value of the weighting measure in the same
+  year.
+*/
+Partials reduceRange(const std::vector<const Area*>& areas,
+                     size_t first,
+                     size_t last,
+                     const Aggregation& aggregation) {
+    const bool weighted = aggregation.function == Aggregation::Function::WMEAN;
+    Partials partials;
+    for (size_t i = first; i < last; i++) {
+        const Measure *weight = weighted ? areas[i]->findMeasure(aggregation.weight) : nullptr;
+        if (weighted && weight == nullptr) {
+            continue;
+        }
+
+        for (const Measure *measure: areas[i]->sortedMeasures()) {
+            MeasurePartials &measurePartials = partials[measure->getCodename()];
+            if (measurePartials.label.empty()) {
+                measurePartials.label = measure->getLabel();
+            }
+
+            // Years come in ascending order, so each is inserted just before
+            // the hint
+            auto hint = measurePartials.years.begin();
+            for (auto& yearValue: measure->getData()) {
+                if (std::isnan(yearValue.second)) {
+                    continue;
+                }
+                double by = 1;
+                if (weighted) {
+                    auto found = weight->getData().find(yearValue.first);
+                    if (found == weight->getData().end() || std::isnan(found->second)) {
+                        continue;
+                    }
+                    by = found->second;
+                }
+                auto year = measurePartials.years.emplace_hint(hint, yearValue.first, Partial());
+                year->second.add(yearValue.second, by);
+                hint = std::next(year);
+            }
+        }
+    }
+    return partials;
+}
+
+/*
+  Merge the partial results of a later range into those of earlier ones.
+*/
+void mergePartials(Partials& into, const Partials& from) {
+    for (auto& codePartials: from) {
+        MeasurePartials &measurePartials = into[codePartials.first];
+        if (measurePartials.label.empty()) {
+            measurePartials.label = codePartials.second.label;
+        }
+        for (auto& yearPartial: codePartials.second.years) {
+            measurePartials.years[yearPartial.first].merge(yearPartial.second);
+        }
+    }
+}
+
+/*
+  The aggregated value from the reduction of a measure's values in a year,
+  or NaN if there is none.
+*/
+double result(const Partial& partial, Aggregation::Function function) {
+    switch (function) {
+        case Aggregation::Function::MEAN:
+            return partial.sum / partial.count;
+        case Aggregation::Function::MIN:
+            return partial.min;
+        case Aggregation::Function::MAX:
+            return partial.max;
+        case Aggregation::Function::WMEAN:
+            return partial.weights == 0 ? std::numeric_limits<double>::quiet_NaN()
+                                        : partial.sum / partial.weights;
+        default:
+            return partial.sum;
+    }
+}
+
+} // namespace
+
+/*
+  Aggregation::code()
+
+  @return
+    The authority code given to the aggregated Area, e.g. SUM
+*/
+std::string Aggregation::code() const {
+    switch (function) {
+        case Function::MEAN:
+            return "MEAN";
+        case Function::MIN:
+            return "MIN";
+        case Function::MAX:
+            return "MAX";
+        case Function::WMEAN:
+            return "WMEAN";
+        default:
+            return "SUM";
+    }
+}
+
+/*
+  Aggregation::describe()
+
+  @return
+    The aggregation in words, e.g. "Mean weighted by area"
+*/
+std::string Aggregation::describe() const {
+    switch (function) {
+        case Function::MEAN:
+            return "Mean";
+        case Function::MIN:
+            return "Minimum";
+        case Function::MAX:
+            return "Maximum";
+        case Function::WMEAN:
+            return "Mean weighted by " + weight;
+        default:
+            return "Sum";
+    }
+}
+
+/*
+  BethYw::parseAggregateArg(aggregate)
+
+  Parse the --aggregate argument: sum, mean, min, max, or wmean followed by
+  a colon and the codename of the measure to weight values by (any case).
+
+  @param aggregate
+    The argument
+
+  @return
+    The Aggregation
+
+  @throws
+    std::invalid_argument if the argument is none of these, with the
+    message: Invalid input for aggregate argument
+
+  @example
+    auto aggregation = BethYw::parseAggregateArg("wmean:area");
+*/
+Aggregation BethYw::parseAggregateArg(const std::string& aggregate) {
+    const std::string lower = Areas::toLower(aggregate);
+    Aggregation aggregation;
+    if (lower == "sum") {
+        aggregation.function = Aggregation::Function::SUM;
+    } else if (lower == "mean") {
+        aggregation.function = Aggregation::Function::MEAN;
+    } else if (lower == "min") {
+        aggregation.function = Aggregation::Function::MIN;
+    } else if (lower == "max") {
+        aggregation.function = Aggregation::Function::MAX;
+    } else if (lower.compare(0, 6, "wmean:") == 0 && lower.size() > 6) {
+        aggregation.function = Aggregation::Function::WMEAN;
+        aggregation.weight = lower.substr(6);
+    } else {
+        throw std::invalid_argument("Invalid input for aggregate argument");
+    }
+    return aggregation;
+}
+
+/*
+  BethYw::aggregate(areas, aggregation)
+
+  Combine the values of every area into one Area, with each measure any of
+  the areas has and, for each year, the aggregation of the values the areas
+  have for it. The Area's authority code is the aggregation's code (e.g.
+  SUM) and its English name describes it.
+
+  @param areas
+    The imported areas
+
+  @param aggregation
+    How to combine them
+
+  @return
+    The aggregated Area
+
+  @example
+    Areas areas;
+    ...
+    // The population of all the areas for each year
+    Area total = BethYw::aggregate(areas, BethYw::parseAggregateArg("sum"));
+*/
+Area BethYw::aggregate(const Areas& areas, const Aggregation& aggregation) {
+    std::vector<const Area*> measured;
+    for (auto& codeArea: areas) {
+        if (codeArea.second.size() != 0) {
+            measured.push_back(&codeArea.second);
+        }
+    }
+
+    ThreadPool &pool = ThreadPool::shared();
+    std::vector<std::future<Partials>> ranges;
+    for (size_t first = 0; first < measured.size(); first += AGGREGATE_RANGE_AREAS) {
+        const size_t last = std::min(first + AGGREGATE_RANGE_AREAS, measured.size());
+        ranges.push_back(pool.submit([&measured, &aggregation, first, last]() {
+            return reduceRange(measured, first, last, aggregation);
+        }));
+    }
+
+    // Every task must finish before returning, as they refer to measured
+    Partials partials;
+    std::exception_ptr error;
+    for (auto& range: ranges) {
+        try {
+            const Partials reduced = pool.await(range);
+            if (!error) {
+                mergePartials(partials, reduced);
+            }
+        } catch (...) {
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    Area aggregated(aggregation.code());
+    aggregated.setName("eng", aggregation.describe() + " of " + std::to_string(measured.size()) + " areas");
+    for (auto& codePartials: partials) {
+        Measure measure(codePartials.first, codePartials.second.label);
+        for (auto& yearPartial: codePartials.second.years) {
+            const double value = result(yearPartial.second, aggregation.function);
+            if (!std::isnan(value)) {
+                measure.setValue(yearPartial.first, value);
+            }
+        }
+        if (measure.size() != 0) {
+            aggregated.setMeasure(codePartials.first, measure);
+        }
+    }
+    return aggregated;
+}
@@ -0,0 +1,56 @@
+#ifndef AGGREGATE_H_
+#define AGGREGATE_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  This file contains the declarations for --aggregate, which combines the
+  values of every imported area into a single Area, e.g. the total
+  population of all of Wales for each year.
+
+  For each measure and year, the values of the areas that have one are
+  reduced to their sum, mean, minimum, maximum, or mean weighted by another
+  measure of the same area in the same year (e.g. density weighted by land
+  area). The result is an ordinary Area, so it is output like any other.
+  The weighting measure is imported even if -m leaves it out, and is then
+  only output if -m asks for it.
+ */
+
+#include <string>
+
+#include "area.h"
+#include "areas.h"
+
+/*
+  How areas' values are combined by BethYw::aggregate().
+*/
+struct Aggregation {
+  enum class Function { SUM, MEAN, MIN, MAX, WMEAN };
+
+  Function function = Function::SUM;
+  // The measure weighting each value, for WMEAN
+  std::string weight;
+
+  std::string code() const;
+  std::string describe() const;
+};
+
+namespace BethYw {
+
+/*
+  Parse the --aggregate argument: sum, mean, min, max or wmean:<measure>.
+*/
+Aggregation parseAggregateArg(const std::string& aggregate);
+
+/*
+  Combine the values of every area into one Area.
+*/
+Area aggregate(const Areas& areas, const Aggregation& aggregation);
+
+} // namespace BethYw
+
+#endif // AGGREGATE_H_
@@ -23,7 +23,12 @@
 #include <ostream>
 #include <vector>
 #include <algorithm>
+#include <utility>
+
+#include "lib_json.hpp"
+
 #include "area.h"
+#include "output.h"
 
 /*
   TODO: Area::Area(localAuthorityCode)
@@ -142,6 +147,46 @@ std::vector<Measure> Area::getMeasuresVector() const {
     return measures;
 }
 
+/*
+  Area::sortedMeasures()
+
+  The area's measures in codename order, without copying them.
+
+  @return
+    Pointers to the measures, valid until the area's measures change
+*/
+std::vector<const Measure*> Area::sortedMeasures() const {
+    std::vector<const Measure*> sorted;
+    sorted.reserve(measures.size());
+    for (auto& measure: measures) {
+        sorted.push_back(&measure);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const Measure* lhs, const Measure* rhs) {
+        return *lhs < *rhs;
+    });
+    return sorted;
+}
+
+/*
+  Area::findMeasure(codename)
+
+  Look up a measure without throwing if it isn't there.
+
+  @param codename
+    The codename of the measure, in lowercase
+
+  @return
+    The measure, or nullptr if the area doesn't have it
+*/
+const Measure* Area::findMeasure(const std::string& codename) const {
+    for (auto& measure: measures) {
+        if (measure.getCodename() == codename) {
+            return &measure;
+        }
+    }
+    return nullptr;
+}
+
 /*
   TODO: Area::setName(lang, name)
 
@@ -305,6 +350,64 @@ unsigned int Area::size() const {
 }
 
 
+/*
+  Area::filter(measuresFilter, yearsFilter)
+
+  Create a copy of this Area containing only the measures and years that pass
+  the given filters, using the same rules the Areas::populate…() functions
+  apply at import time. Measures left with no values are dropped. This lets
+  data imported without filters be queried many times over.
+
+  @param measuresFilter
+    An umodifiable pointer to set of lowercase measure codes to keep, or an
+    empty set/nullptr to keep all measures
+
+  @param yearsFilter
+    An umodifiable pointer to a tuple of two years to keep (inclusive), where
+    0 for either value (or nullptr) keeps all years
+
+  @return
+    A filtered copy of this Area
+
+  @example
+    Area area("W06000023");
+    ...
+    std::unordered_set<std::string> measures = {"pop"};
+    std::tuple<unsigned int, unsigned int> years = std::make_tuple(2000, 2010);
+    Area filtered = area.filter(&measures, &years);
+*/
+Area Area::filter(const std::unordered_set<std::string> * const measuresFilter,
+                  const std::tuple<unsigned int, unsigned int> * const yearsFilter) const {
+    Area filtered(areaCode);
+    filtered.names = names;
+
+    bool allYears = yearsFilter == nullptr
+            || std::get<0>(*yearsFilter) == 0 || std::get<1>(*yearsFilter) == 0;
+    int firstYear = allYears ? 0 : std::get<0>(*yearsFilter);
+    int lastYear = allYears ? 0 : std::get<1>(*yearsFilter);
+
+    for (const Measure &m: measures) {
+        if (measuresFilter != nullptr && !measuresFilter->empty()
+                && measuresFilter->find(toLower(m.getCodename())) == measuresFilter->end()) {
+            continue;
+        }
+        if (allYears) {
+            filtered.measures.push_back(m);
+            continue;
+        }
+        Measure kept(m.getCodename(), m.getLabel());
+        for (auto& yearValPair: m.getDataMap()) {
+            if (yearValPair.first >= firstYear && yearValPair.first <= lastYear) {
+                kept.setValue(yearValPair.first, yearValPair.second);
+            }
+        }
+        if (kept.size() != 0) {
+            filtered.measures.push_back(kept);
+        }
+    }
+    return filtered;
+}
+
 /**
  * New method to help out with the AREAS class setArea function where combining without full erasure needs to happen
  * This allows for data persistence via looping through the new area to be inserted, and if any
@@ -332,6 +435,167 @@ Area Area::combineAreas(Area& areaNew, Area& areaOrig) {
     return combined;
 }
 
+/*
+  Area::merge(newer)
+
+  Combine another Area into this one without copying it: names and measures
+  are moved across, and the newer Area takes precedence for names in the
+  same language and values for the same measure and year (as with
+  combineAreas()). newer is left empty.
+
+  @param newer
+    The Area whose data takes precedence
+
+  @return
+    void
+
+  @example
+    Area area("W06000023");
+    area.setName("eng", "Powys");
+
+    Area newer("W06000023");
+    newer.setName("cym", "Powys");
+
+    area.merge(std::move(newer));
+*/
+void Area::merge(Area&& newer) {
+    for (auto& langNamePair: newer.names) {
+        names[langNamePair.first] = std::move(langNamePair.second);
+    }
+    newer.names.clear();
+
+    for (Measure& m: newer.measures) {
+        bool found = false;
+        for (Measure& existing: measures) {
+            if (existing.getCodename() == m.getCodename()) {
+                existing.merge(std::move(m));
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            measures.push_back(std::move(m));
+        }
+    }
+    newer.measures.clear();
+}
+
+/**
+ * Switches every measure in this area to keeping only its running totals, see Measure::summarise()
+ */
+void Area::summarise() {
+    for (Measure &m: measures) {
+        m.summarise();
+    }
+}
+
+/*
+  Area::toNdjson()
+
+  Render the area as newline-delimited JSON: a self-contained line per
+  measure, ordered by measure codename, holding the area's code and names
+  and the measure's code, label and values (numbers formatted as in
+  Areas::toJSON()), or just its average, diff and diffPercent if it is a
+  summary. An area with no measures renders as nothing.
+
+  @return
+    The lines, each ending with a new line
+
+  @example
+    Area area("W06000023");
+    area.setName("eng", "Powys");
+    Measure measure("pop", "Population");
+    measure.setValue(2015, 132447);
+    area.setMeasure("pop", measure);
+
+    // {"area":"W06000023","label":"Population","measure":"pop",
+    //  "names":{"eng":"Powys"},"values":{"2015":132447.0}} (on one line)
+    std::cout << area.toNdjson();
+*/
+std::string Area::toNdjson() const {
+    std::vector<Measure> sorted = measures;
+    std::sort(sorted.begin(), sorted.end());
+
+    std::string lines;
+    for (auto& measure: sorted) {
+        nlohmann::json line;
+        line["area"] = areaCode;
+        line["names"] = names;
+        line["measure"] = measure.getCodename();
+        line["label"] = measure.getLabel();
+        if (measure.isSummary()) {
+            line["average"] = measure.getAverage();
+            line["diff"] = measure.getDifference();
+            line["diffPercent"] = measure.getDifferenceAsPercentage();
+            lines += line.dump();
+            lines += '\n';
+            continue;
+        }
+        nlohmann::json values = nlohmann::json::object();
+        for (auto& yearValue: measure.getDataMap()) {
+            values[std::to_string(yearValue.first)] = yearValue.second;
+        }
+        line["values"] = std::move(values);
+        lines += line.dump();
+        lines += '\n';
+    }
+    return lines;
+}
+
+/*
+  Area::appendDelimited(out, separator)
+
+  Append the area's values in long (tidy) form: a row per value holding the
+  authority code, measure codename, year and value, separated by separator
+  (',' for CSV or '\t' for TSV). Rows are ordered by measure codename, then
+  year. A code containing the separator, a quote or a new line is quoted as
+  in CSV. Summary measures have no year-by-year values, so give no rows.
+
+  @param out
+    The text to append the rows to
+
+  @param separator
+    The character between fields
+
+  @example
+    Area area("W06000023");
+    Measure measure("pop", "Population");
+    measure.setValue(2015, 132447);
+    area.setMeasure("pop", measure);
+
+    std::string csv;
+    area.appendDelimited(csv, ',');
+    // csv is "W06000023,pop,2015,132447\n"
+*/
+void Area::appendDelimited(std::string& out, char separator) const {
+    std::string prefix;
+    char number[BethYw::NUMBER_BUFFER_SIZE];
+    for (const Measure *measure: sortedMeasures()) {
+        prefix.clear();
+        BethYw::appendField(prefix, areaCode, separator);
+        prefix += separator;
+        BethYw::appendField(prefix, measure->getCodename(), separator);
+        prefix += separator;
+
+        for (auto& yearValue: measure->getData()) {
+            out += prefix;
+            out.append(number, BethYw::formatNumber(yearValue.first, number));
+            out += separator;
+            out.append(number, BethYw::formatNumber(yearValue.second, number));
+            out += '\n';
+        }
+    }
+}
+
+/**
+ * Builds the range index of every measure in this area, see Measure::buildRangeIndex()
+ */
+void Area::buildRangeIndexes() {
+    for (Measure &m: measures) {
+        m.buildRangeIndex();
+    }
+}
+
 /*
   TODO: operator<<(os, area)
 
@@ -19,6 +19,8 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <tuple>
+#include <unordered_set>
 
 #include "measure.h"
 
@@ -42,21 +44,30 @@ public:
 
     //getters
     Measure& getMeasure(std::string codename);
+    const Measure* findMeasure(const std::string& codename) const;
     std::string getLocalAuthorityCode() const;
     std::string getName(std::string lang) const;
     std::map<std::string,std::string> getNamesMap() const;
     std::vector<Measure> getMeasuresVector() const;
+    std::vector<const Measure*> sortedMeasures() const;
     unsigned int size() const;
+    Area filter(const std::unordered_set<std::string> * const measuresFilter,
+                const std::tuple<unsigned int, unsigned int> * const yearsFilter) const;
 
     //helpers
-    std::string toLower(std::string s);
+    static std::string toLower(std::string s);
     bool isValidLangCode(std::string lang) const;
     Area combineAreas(Area& areaNew, Area& areaOrig);
+    void merge(Area&& newer);
+    void buildRangeIndexes();
+    void summarise();
 
     //friends, overloads, json conv
     friend bool operator==(const Area &lhs, const Area &rhs);
     friend std::ostream &operator<<(std::ostream &os, const Area &area);
     friend bool operator<(const Area &lhs, const Area &rhs);
+    std::string toNdjson() const;
+    void appendDelimited(std::string& out, char separator) const;
 
 protected:
     std::string areaCode;
@@ -18,6 +18,7 @@
   must implement has a TODO block comment. 
 */
 
+#include <cstdlib>
 #include <stdexcept>
 #include <iostream>
 #include <string>
@@ -28,20 +29,1091 @@
 #include <vector>
 #include <map>
 #include <typeinfo>
+#include <limits>
 #include <locale>
 #include <algorithm>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <thread>
+#include <utility>
 
 #include "lib_json.hpp"
 
 #include "datasets.h"
 #include "areas.h"
+#include "arrow.h"
+#include "csvscanner.h"
+#include "jsonindex.h"
 #include "measure.h"
+#include "pipeline.h"
+#include "threadpool.h"
 
 /*
   An alias for the imported JSON parsing library.
 */
 using json = nlohmann::json;
 
+namespace {
+
+/*
+  WelshStats files with fewer matching rows than this are always imported on
+  a single thread, as splitting them up would cost more than it saves.
+*/
+constexpr size_t PARALLEL_JSON_MIN_ROWS = 4096;
+
+/*
+  The size of the blocks a WelshStats JSON file is read in.
+*/
+constexpr size_t JSON_READ_SIZE = 1024 * 1024;
+
+/*
+  The engine populateFromWelshStatsJSON() reads with (see Areas::setJsonEngine).
+*/
+std::atomic<JsonEngine> jsonEngine(JsonEngine::SIMD);
+
+/*
+  The keys of the columns in a WelshStats JSON file, looked up once from the
+  dataset's SourceColumnMapping rather than for every row.
+*/
+struct WelshStatsColumns {
+    std::string authCode;
+    std::string authName;
+    std::string measureCode;
+    std::string measureName;
+    std::string year;
+    std::string value;
+
+    // Datasets with a single measure give its code and name in the mapping
+    bool singleMeasure;
+};
+
+WelshStatsColumns welshStatsColumns(const BethYw::SourceColumnMapping& cols) {
+    WelshStatsColumns columns;
+    columns.singleMeasure = cols.find(BethYw::SourceColumn::SINGLE_MEASURE_CODE) != cols.end();
+    if (columns.singleMeasure) {
+        columns.measureCode = cols.at(BethYw::SourceColumn::SINGLE_MEASURE_CODE);
+        columns.measureName = cols.at(BethYw::SourceColumn::SINGLE_MEASURE_NAME);
+    } else {
+        columns.measureCode = cols.at(BethYw::SourceColumn::MEASURE_CODE);
+        columns.measureName = cols.at(BethYw::SourceColumn::MEASURE_NAME);
+    }
+    columns.authCode = cols.at(BethYw::SourceColumn::AUTH_CODE);
+    columns.authName = cols.at(BethYw::SourceColumn::AUTH_NAME_ENG);
+    columns.year = cols.at(BethYw::SourceColumn::YEAR);
+    columns.value = cols.at(BethYw::SourceColumn::VALUE);
+    return columns;
+}
+
+/*
+  The filters passed to a populate…() function, with the measure codes
+  lowercased once up front. A nullptr or empty filter lets everything through.
+*/
+struct ImportFilters {
+    const StringFilterSet *areas;
+    StringFilterSet measures;
+    unsigned int firstYear;
+    unsigned int lastYear;
+
+    ImportFilters(const StringFilterSet * const areasFilter,
+                  const StringFilterSet * const measuresFilter,
+                  const YearFilterTuple * const yearsFilter)
+            : areas(areasFilter), firstYear(0), lastYear(0) {
+        if (measuresFilter != nullptr) {
+            for (auto& measure: *measuresFilter) {
+                measures.insert(Areas::toLower(measure));
+            }
+        }
+        if (yearsFilter != nullptr
+                && std::get<0>(*yearsFilter) != 0 && std::get<1>(*yearsFilter) != 0) {
+            firstYear = std::get<0>(*yearsFilter);
+            lastYear = std::get<1>(*yearsFilter);
+        }
+    }
+
+    bool area(const std::string& authCode) const {
+        return areas == nullptr || areas->empty() || areas->find(authCode) != areas->end();
+    }
+
+    bool measure(const std::string& lowerCode) const {
+        return measures.empty() || measures.find(lowerCode) != measures.end();
+    }
+
+    bool year(unsigned int year) const {
+        return firstYear == 0 || (year >= firstYear && year <= lastYear);
+    }
+};
+
+/*
+  The columns of one row of a WelshStats JSON file that are imported, once
+  converted and checked against the filters.
+*/
+struct WelshStatsRecord {
+    std::string authCode;
+    std::string authName;
+    std::string measureCode;
+    std::string measureName;
+    unsigned int year;
+    double value;
+};
+
+/*
+  A function given each WelshStatsRecord as soon as its row has been read.
+*/
+using WelshStatsSink = std::function<void(WelshStatsRecord&&)>;
+
+/*
+  The row being read from a WelshStats JSON file, by either JSON engine:
+  the values of the columns named in the dataset's SourceColumnMapping, which
+  become a WelshStatsRecord (or are dropped, if they fail the filters) when
+  the row ends. The records are collected, or handed to a sink one at a time.
+*/
+class WelshStatsRowBuilder {
+public:
+    WelshStatsRowBuilder(const WelshStatsColumns& columns,
+                         const ImportFilters& filters,
+                         std::vector<WelshStatsRecord>& records)
+            : WelshStatsRowBuilder(columns, filters, [&records](WelshStatsRecord&& record) {
+                  records.push_back(std::move(record));
+              }) {}
+
+    WelshStatsRowBuilder(const WelshStatsColumns& columns,
+                         const ImportFilters& filters,
+                         WelshStatsSink sink)
+            : columns(columns), filters(filters), sink(std::move(sink)), seen(0) {
+        keys.push_back({columns.authCode, AUTH_CODE});
+        keys.push_back({columns.authName, AUTH_NAME});
+        keys.push_back({columns.year, YEAR});
+        keys.push_back({columns.value, VALUE});
+        if (!columns.singleMeasure) {
+            keys.push_back({columns.measureCode, MEASURE_CODE});
+            keys.push_back({columns.measureName, MEASURE_NAME});
+        }
+    }
+
+    /*
+      The columns a key fills (a bit per Slot), or 0 if it isn't imported.
+      One key may fill several columns (e.g. a measure's code and name).
+    */
+    unsigned int slotsFor(const JsonSpan& key) const {
+        unsigned int slots = 0;
+        for (auto& keySlotPair: keys) {
+            if (key.equals(keySlotPair.first)) {
+                slots |= 1u << keySlotPair.second;
+            }
+        }
+        return slots;
+    }
+
+    void startRow() {
+        seen = 0;
+    }
+
+    void setText(unsigned int slots, const std::string& val) {
+        for (int i = 0; i < NUM_SLOTS; i++) {
+            if ((slots & (1u << i)) != 0) {
+                text[i] = val;
+                isNumber[i] = false;
+            }
+        }
+        seen |= slots;
+    }
+
+    void setNumber(unsigned int slots, double val) {
+        for (int i = 0; i < NUM_SLOTS; i++) {
+            if ((slots & (1u << i)) != 0) {
+                numbers[i] = val;
+                isNumber[i] = true;
+            }
+        }
+        seen |= slots;
+    }
+
+    /*
+      Reject a null or boolean value for an imported column.
+    */
+    void setInvalid(unsigned int slots) const {
+        for (int i = 0; i < NUM_SLOTS; i++) {
+            if ((slots & (1u << i)) != 0) {
+                throw std::runtime_error("Areas::populateFromWelshStatsJSON: Invalid value for "
+                                         + keyName(i));
+            }
+        }
+    }
+
+    void finishRow() {
+        WelshStatsRecord record;
+        record.authCode = Areas::toUpper(field(AUTH_CODE));
+        if (!filters.area(record.authCode)) {
+            return;
+        }
+        if (columns.singleMeasure) {
+            record.measureCode = Areas::toLower(columns.measureCode);
+            record.measureName = columns.measureName;
+        } else {
+            record.measureCode = Areas::toLower(field(MEASURE_CODE));
+            record.measureName = std::move(field(MEASURE_NAME));
+        }
+        if (!filters.measure(record.measureCode)) {
+            return;
+        }
+        record.year = std::stoi(field(YEAR));
+        if (!filters.year(record.year)) {
+            return;
+        }
+
+        // Some datasets (e.g. envi0201) store their values as strings
+        if ((seen & (1u << VALUE)) != 0 && isNumber[VALUE]) {
+            record.value = numbers[VALUE];
+        } else {
+            record.value = std::stod(field(VALUE));
+        }
+        record.authName = std::move(field(AUTH_NAME));
+        sink(std::move(record));
+    }
+
+private:
+    enum Slot { AUTH_CODE, AUTH_NAME, MEASURE_CODE, MEASURE_NAME, YEAR, VALUE, NUM_SLOTS };
+
+    std::string keyName(int wanted) const {
+        for (auto& keySlotPair: keys) {
+            if (keySlotPair.second == wanted) {
+                return keySlotPair.first;
+            }
+        }
+        return "";
+    }
+
+    std::string& field(int wanted) {
+        if ((seen & (1u << wanted)) == 0) {
+            throw std::runtime_error("Areas::populateFromWelshStatsJSON: Row has no "
+                                     + keyName(wanted));
+        }
+        if (isNumber[wanted]) {
+            text[wanted] = std::to_string(static_cast<long long>(numbers[wanted]));
+        }
+        return text[wanted];
+    }
+
+    const WelshStatsColumns& columns;
+    const ImportFilters& filters;
+    WelshStatsSink sink;
+    std::vector<std::pair<std::string, int>> keys;
+
+    // The values of the imported columns in the current row
+    unsigned int seen;
+    std::string text[NUM_SLOTS];
+    double numbers[NUM_SLOTS];
+    bool isNumber[NUM_SLOTS];
+};
+
+/*
+  A SAX handler for WelshStats JSON files that keeps only the columns named
+  in the dataset's SourceColumnMapping. No DOM is built: the parser hands
+  over each value as it is read, the values of every other key (notes, sort
+  orders, hierarchy fields, Welsh names, …) are dropped straight away, and a
+  row is converted by a WelshStatsRowBuilder as soon as it ends.
+
+  The rows are the objects in the top-level "value" array, so their keys are
+  at depth 3 (counting the top-level object as 1).
+*/
+class WelshStatsHandler : public nlohmann::json_sax<json> {
+public:
+    explicit WelshStatsHandler(WelshStatsRowBuilder& rows)
+            : rows(rows), depth(0), valueKey(false), inValue(false), sawValue(false),
+              slots(0) {}
+
+    bool null() override {
+        return invalid();
+    }
+
+    bool boolean(bool) override {
+        return invalid();
+    }
+
+    bool binary(binary_t&) override {
+        return invalid();
+    }
+
+    bool number_integer(number_integer_t val) override {
+        return number(static_cast<double>(val));
+    }
+
+    bool number_unsigned(number_unsigned_t val) override {
+        return number(static_cast<double>(val));
+    }
+
+    bool number_float(number_float_t val, const string_t&) override {
+        return number(val);
+    }
+
+    bool string(string_t& val) override {
+        if (inRow()) {
+            rows.setText(slots, val);
+        }
+        return true;
+    }
+
+    bool key(string_t& val) override {
+        if (depth == 1) {
+            valueKey = val == "value";
+        } else if (depth == 3 && inValue) {
+            slots = rows.slotsFor(JsonSpan{val.data(), val.size(), false});
+        }
+        return true;
+    }
+
+    bool start_object(std::size_t) override {
+        slots = 0;
+        depth++;
+        if (depth == 3 && inValue) {
+            rows.startRow();
+        }
+        return true;
+    }
+
+    bool end_object() override {
+        if (depth == 3 && inValue) {
+            rows.finishRow();
+        }
+        slots = 0;
+        depth--;
+        return true;
+    }
+
+    bool start_array(std::size_t) override {
+        slots = 0;
+        depth++;
+        if (depth == 2 && valueKey) {
+            inValue = true;
+            sawValue = true;
+        }
+        return true;
+    }
+
+    bool end_array() override {
+        if (depth == 2) {
+            inValue = false;
+        }
+        depth--;
+        return true;
+    }
+
+    bool parse_error(std::size_t,
+                     const std::string&,
+                     const nlohmann::detail::exception& ex) override {
+        throw std::runtime_error(std::string("Areas::populateFromWelshStatsJSON: ") + ex.what());
+    }
+
+    /*
+      Check that the file had a value array.
+    */
+    void finish() const {
+        if (!sawValue) {
+            throw std::runtime_error("Areas::populateFromWelshStatsJSON: No value array found");
+        }
+    }
+
+private:
+    bool inRow() const {
+        return inValue && depth == 3 && slots != 0;
+    }
+
+    bool number(double val) {
+        if (inRow()) {
+            rows.setNumber(slots, val);
+        }
+        return true;
+    }
+
+    bool invalid() {
+        if (inRow()) {
+            rows.setInvalid(slots);
+        }
+        return true;
+    }
+
+    WelshStatsRowBuilder& rows;
+
+    unsigned int depth;
+    bool valueKey;
+    bool inValue;
+    bool sawValue;
+
+    // The columns filled by the current key, or 0 if it isn't imported
+    unsigned int slots;
+};
+
+/*
+  Read the rows of a WelshStats JSON document with nlohmann::json's SAX
+  parser, which (like the structural index) rejects anything but whitespace
+  after the top-level object.
+*/
+void readWelshStatsNlohmann(const std::string& document, WelshStatsRowBuilder& rows) {
+    WelshStatsHandler handler(rows);
+    json::sax_parse(document, &handler, nlohmann::detail::input_format_t::json, true);
+    handler.finish();
+}
+
+/*
+  Read the rows of a WelshStats JSON document with nlohmann::json's SAX
+  parser as the stream is read, so each row is handed over before the rest
+  of the document has even been read.
+*/
+void readWelshStatsNlohmann(std::istream& is, WelshStatsRowBuilder& rows) {
+    WelshStatsHandler handler(rows);
+    json::sax_parse(is, &handler, nlohmann::detail::input_format_t::json, true);
+    handler.finish();
+}
+
+/*
+  Read the rows of a WelshStats JSON document with the structural index in
+  jsonindex.h. Only the keys of each row are compared, and the values of the
+  keys that aren't imported are skipped without being looked at.
+*/
+void readWelshStatsSimd(const std::string& document, WelshStatsRowBuilder& rows) {
+    JsonStructuralIndex index(document);
+    JsonTapeWalker walker(document, index);
+    if (!walker.enterArray("value")) {
+        throw std::runtime_error("Areas::populateFromWelshStatsJSON: No value array found");
+    }
+
+    JsonSpan key;
+    JsonSpan value;
+    while (walker.nextObject()) {
+        rows.startRow();
+        while (walker.nextMember(key)) {
+            const unsigned int slots = rows.slotsFor(key);
+            if (slots == 0) {
+                walker.skipMemberValue();
+                continue;
+            }
+            switch (walker.memberValue(value)) {
+                case JsonKind::STRING:
+                    rows.setText(slots, value.str());
+                    break;
+                case JsonKind::NUMBER:
+                    rows.setNumber(slots, value.toDouble());
+                    break;
+                case JsonKind::LITERAL:
+                    rows.setInvalid(slots);
+                    break;
+                case JsonKind::CONTAINER:
+                    break;
+            }
+        }
+        rows.finishRow();
+    }
+    walker.finish();
+}
+
+/*
+  Describe a record, for reporting a difference between the JSON engines.
+*/
+std::string describeRecord(const WelshStatsRecord& record) {
+    std::ostringstream description;
+    description.precision(17);
+    description << record.authCode << "/" << record.authName << "/"
+                << record.measureCode << "/" << record.measureName << "/"
+                << record.year << "=" << record.value;
+    return description.str();
+}
+
+/*
+  Read a WelshStats JSON document with both engines and check that they
+  read the same records (or both fail), for testing the structural index
+  against nlohmann::json on real datasets.
+
+  @throws
+    std::runtime_error describing the first difference, or the error both
+    engines failed with
+*/
+void readWelshStatsVerified(const std::string& document,
+                            const WelshStatsColumns& columns,
+                            const ImportFilters& filters,
+                            std::vector<WelshStatsRecord>& records) {
+    std::vector<WelshStatsRecord> simdRecords;
+    WelshStatsRowBuilder nlohmannRows(columns, filters, records);
+    WelshStatsRowBuilder simdRows(columns, filters, simdRecords);
+
+    std::exception_ptr nlohmannError;
+    std::string simdError;
+    try {
+        readWelshStatsNlohmann(document, nlohmannRows);
+    } catch (...) {
+        nlohmannError = std::current_exception();
+    }
+    try {
+        readWelshStatsSimd(document, simdRows);
+    } catch (std::exception const &e) {
+        simdError = e.what();
+    }
+
+    const std::string mismatch = "Areas::populateFromWelshStatsJSON: JSON engines disagree: ";
+    if (nlohmannError && !simdError.empty()) {
+        std::rethrow_exception(nlohmannError);
+    } else if (nlohmannError) {
+        throw std::runtime_error(mismatch + "only nlohmann failed");
+    } else if (!simdError.empty()) {
+        throw std::runtime_error(mismatch + "only simd failed (" + simdError + ")");
+    }
+
+    const size_t rows = std::min(records.size(), simdRecords.size());
+    for (size_t i = 0; i < rows; i++) {
+        const WelshStatsRecord &expected = records[i];
+        const WelshStatsRecord &actual = simdRecords[i];
+        if (expected.authCode != actual.authCode
+                || expected.authName != actual.authName
+                || expected.measureCode != actual.measureCode
+                || expected.measureName != actual.measureName
+                || expected.year != actual.year
+                || expected.value != actual.value) {
+            throw std::runtime_error(mismatch + "record " + std::to_string(i) + " is "
+                                     + describeRecord(expected) + " (nlohmann) but "
+                                     + describeRecord(actual) + " (simd)");
+        }
+    }
+    if (records.size() != simdRecords.size()) {
+        throw std::runtime_error(mismatch + std::to_string(records.size()) + " records (nlohmann) but "
+                                 + std::to_string(simdRecords.size()) + " (simd)");
+    }
+}
+
+/*
+  Read the whole of a stream into a string.
+*/
+std::string readWhole(std::istream& is) {
+    std::string document;
+    std::vector<char> block(JSON_READ_SIZE);
+    while (is.read(block.data(), block.size()) || is.gcount() > 0) {
+        document.append(block.data(), static_cast<size_t>(is.gcount()));
+    }
+    return document;
+}
+
+/*
+  Import one WelshStats record into target.
+*/
+void importWelshStatsRecord(Areas& target, const WelshStatsRecord& record) {
+    Area tempArea(record.authCode);
+    tempArea.setName("eng", record.authName);
+    Measure tempMeasure(record.measureCode, record.measureName);
+    tempMeasure.setValue(record.year, record.value);
+    tempArea.setMeasure(record.measureCode, tempMeasure);
+    target.setArea(record.authCode, std::move(tempArea));
+}
+
+/*
+  The number of rows of an AuthorityByYearCSV file passed from the parse
+  stage to the merge stage at a time, and the most batches waiting.
+*/
+constexpr size_t AUTHORITY_BY_YEAR_BATCH_ROWS = 256;
+constexpr size_t AUTHORITY_BY_YEAR_QUEUE_DEPTH = 8;
+
+/*
+  One row of an AuthorityByYearCSV file: an authority code and its values for
+  the years that passed the filters.
+*/
+struct AuthorityByYearRow {
+    std::string authCode;
+    std::vector<std::pair<unsigned int, double>> values;
+};
+
+using AuthorityByYearBatch = std::vector<AuthorityByYearRow>;
+
+/*
+  The number of bytes of a CSV file scanned at a time while it is still
+  being read.
+*/
+constexpr size_t CSV_READ_SIZE = 256 * 1024;
+
+/*
+  CSV files with fewer bytes than this after their header are always parsed
+  as a single range, as splitting them up would cost more than it saves.
+*/
+constexpr size_t PARALLEL_CSV_MIN_BYTES = 1024 * 1024;
+
+/*
+  The columns of an AuthorityByYearCSV file, read from its header: column 0
+  is the authority code, and column i the year years[i].
+
+  The year filter is applied to the header, not the cells: columns for
+  other years are stepped over without being converted, and a row is not
+  read past the last wanted column. Rows for other areas are rejected on
+  their first field.
+*/
+struct AuthorityByYearColumns {
+    std::vector<unsigned int> years;
+    std::vector<bool> wanted;
+    size_t lastWanted;
+
+    AuthorityByYearColumns() : lastWanted(0) {}
+
+    /*
+      Read the header, the row the scanner has just started.
+    */
+    void readHeader(CsvScanner& scanner, const ImportFilters& filters) {
+        CsvField field;
+        years.push_back(0);
+        scanner.nextField(field);
+        while (scanner.nextField(field)) {
+            years.push_back(std::stoi(field.str()));
+        }
+        wanted.assign(years.size(), false);
+        for (size_t i = 1; i < years.size(); i++) {
+            if (filters.year(years[i])) {
+                wanted[i] = true;
+                lastWanted = i;
+            }
+        }
+    }
+
+    /*
+      Read the row the scanner has just started into row. Empty cells
+      (years with no data) are skipped.
+
+      @return
+        false if the row is blank or fails the area filter
+    */
+    bool readRow(CsvScanner& scanner, const ImportFilters& filters, AuthorityByYearRow& row) const {
+        CsvField field;
+        if (!scanner.nextField(field) || field.empty()) {
+            return false;
+        }
+        row.authCode = field.str();
+        if (!filters.area(row.authCode)) {
+            return false;
+        }
+
+        row.values.clear();
+        for (size_t column = 1; column <= lastWanted && scanner.nextField(field); column++) {
+            if (wanted[column] && !field.empty()) {
+                row.values.push_back({years[column], field.toDouble()});
+            }
+        }
+        return true;
+    }
+};
+
+/*
+  Import one row of an AuthorityByYearCSV file into target.
+*/
+void importAuthorityByYearRow(Areas& target,
+                              const std::string& measureCode,
+                              const std::string& measureName,
+                              const AuthorityByYearRow& row) {
+    Measure measure(measureCode, measureName);
+    for (auto& yearValue: row.values) {
+        measure.setValue(yearValue.first, yearValue.second);
+    }
+    Area area(row.authCode);
+    area.setMeasure(measureCode, measure);
+    target.setArea(row.authCode, std::move(area));
+}
+
+/*
+  The parse stage of importing an AuthorityByYearCSV file on a single
+  thread: read the years from the header, then tokenise every row that
+  passes the filters and push them in batches to the merge stage.
+
+  The file is scanned with a CsvScanner a block at a time, carrying any
+  incomplete last row over to the next block.
+*/
+void parseAuthorityByYearCSV(std::istream& is,
+                             const ImportFilters& filters,
+                             SpscQueue<AuthorityByYearBatch>& batches) {
+    bool readHeader = false;
+    AuthorityByYearColumns columns;
+
+    AuthorityByYearBatch batch;
+    std::string buffer;
+    bool atEnd = false;
+    while (!atEnd) {
+        const size_t kept = buffer.size();
+        buffer.resize(kept + CSV_READ_SIZE);
+        is.read(&buffer[kept], CSV_READ_SIZE);
+        buffer.resize(kept + is.gcount());
+        atEnd = !is;
+
+        CsvScanner scanner(buffer.data(), buffer.size(), atEnd);
+        while (scanner.startRow()) {
+            if (!readHeader) {
+                columns.readHeader(scanner, filters);
+                readHeader = true;
+                continue;
+            }
+
+            AuthorityByYearRow row;
+            if (!columns.readRow(scanner, filters, row)) {
+                continue;
+            }
+            batch.push_back(std::move(row));
+
+            if (batch.size() == AUTHORITY_BY_YEAR_BATCH_ROWS) {
+                if (!batches.push(std::move(batch))) {
+                    return;
+                }
+                batch = AuthorityByYearBatch();
+            }
+        }
+        buffer.erase(0, scanner.position());
+    }
+
+    if (!readHeader) {
+        throw std::runtime_error("Areas::populateFromAuthorityByYearCSV: File is empty");
+    }
+    if (!batch.empty()) {
+        batches.push(std::move(batch));
+    }
+}
+
+/*
+  Import an AuthorityByYearCSV file into target as it is read, with the
+  parse stage on its own thread and the merge stage on this one.
+*/
+void streamAuthorityByYearCSV(Areas& target,
+                              std::istream& is,
+                              const ImportFilters& filters,
+                              const std::string& measureCode,
+                              const std::string& measureName) {
+    SpscQueue<AuthorityByYearBatch> batches(AUTHORITY_BY_YEAR_QUEUE_DEPTH);
+    std::exception_ptr parseError;
+    std::thread parser([&is, &filters, &batches, &parseError]() {
+        try {
+            parseAuthorityByYearCSV(is, filters, batches);
+        } catch (...) {
+            parseError = std::current_exception();
+        }
+        batches.close();
+    });
+
+    try {
+        AuthorityByYearBatch batch;
+        std::string previous;
+        while (batches.pop(batch)) {
+            for (auto& row: batch) {
+                if (row.authCode != previous) {
+                    target.streamCompleted(row.authCode);
+                    previous = row.authCode;
+                }
+                importAuthorityByYearRow(target, measureCode, measureName, row);
+            }
+        }
+    } catch (...) {
+        batches.cancel();
+        parser.join();
+        throw;
+    }
+
+    parser.join();
+    if (parseError) {
+        std::rethrow_exception(parseError);
+    }
+}
+
+/*
+  Split the rows of CSV data from an offset onwards into about `parts`
+  ranges of whole rows, returning the offsets where the ranges start
+  followed by the size of the data.
+
+  The data is first cut into equal pieces whose quotes are counted in
+  parallel. The parity of the quotes before each cut says whether it falls
+  inside a quoted field, from which CsvScanner::nextRowStart() finds where
+  the next row really starts. A quoted field spanning a whole piece can
+  leave some ranges empty.
+*/
+std::vector<size_t> splitCsvRows(const std::string& content, size_t from, size_t parts) {
+    ThreadPool &pool = ThreadPool::shared();
+    const char *data = content.data();
+    const size_t size = content.size();
+    const size_t pieceSize = (size - from + parts - 1) / parts;
+
+    std::vector<size_t> cuts;
+    for (size_t cut = from; cut < size; cut += pieceSize) {
+        cuts.push_back(cut);
+    }
+    cuts.push_back(size);
+
+    std::vector<std::future<size_t>> counts;
+    for (size_t i = 0; i + 2 < cuts.size(); i++) {
+        const size_t begin = cuts[i];
+        const size_t end = cuts[i + 1];
+        counts.push_back(pool.submit([data, begin, end]() {
+            return CsvScanner::countQuotes(data + begin, end - begin);
+        }));
+    }
+
+    std::vector<size_t> starts = {from};
+    size_t quotes = 0;
+    for (size_t i = 0; i < counts.size(); i++) {
+        quotes += pool.await(counts[i]);
+        const size_t start = CsvScanner::nextRowStart(data, size, cuts[i + 1], quotes % 2 == 1);
+        starts.push_back(std::max(start, starts.back()));
+    }
+    starts.push_back(size);
+    return starts;
+}
+
+/*
+  Parse the rows of a CSV file held in memory, from an offset (just after
+  its header) onwards, into target. parseRange(begin, end, areas) must parse
+  the rows in content[begin, end) into areas.
+
+  Large files are split into a range per thread of the shared ThreadPool
+  (see splitCsvRows()), which are parsed concurrently into separate Areas
+  and then merged into target in file order, so later rows still win.
+*/
+template <typename ParseRange>
+void populateFromCsvRanges(Areas& target,
+                           const std::string& content,
+                           size_t from,
+                           const ParseRange& parseRange) {
+    ThreadPool &pool = ThreadPool::shared();
+    if (pool.size() == 1 || content.size() - from < PARALLEL_CSV_MIN_BYTES) {
+        parseRange(from, content.size(), target);
+        return;
+    }
+
+    const std::vector<size_t> starts = splitCsvRows(content, from, pool.size());
+    std::vector<Areas> partials(starts.size() - 1);
+    std::vector<std::future<void>> tasks;
+    for (size_t i = 0; i + 1 < starts.size(); i++) {
+        const size_t begin = starts[i];
+        const size_t end = starts[i + 1];
+        Areas *partial = &partials[i];
+        tasks.push_back(pool.submit([&parseRange, begin, end, partial]() {
+            parseRange(begin, end, *partial);
+        }));
+    }
+
+    // Every task must finish before the partial results go out of scope
+    std::exception_ptr error;
+    for (auto& task: tasks) {
+        try {
+            pool.await(task);
+        } catch (...) {
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    for (auto& partial: partials) {
+        target.merge(std::move(partial));
+    }
+}
+
+/*
+  The most rows in each record batch of Areas::writeArrow().
+*/
+constexpr size_t ARROW_BATCH_ROWS = 1024 * 1024;
+
+/*
+  Areas with fewer areas than this are always rendered (as a table or JSON)
+  on a single thread.
+*/
+constexpr size_t PARALLEL_RENDER_MIN_AREAS = 256;
+
+/*
+  Render areas as text in ranges, handing each range's text to write() in
+  container (authority code) order. renderRange(first, last) must return the
+  text for the areas in [first, last).
+
+  With more than one thread, the ranges are rendered concurrently on the
+  shared ThreadPool, each into its own buffer, and written as soon as they
+  and every range before them are done, so the text is the same as if it
+  had been rendered in one go.
+*/
+template <typename RenderRange, typename Write>
+void renderAreasInOrder(const AreasContainer& container,
+                        const RenderRange& renderRange,
+                        const Write& write) {
+    ThreadPool &pool = ThreadPool::shared();
+    if (pool.size() == 1 || container.size() < PARALLEL_RENDER_MIN_AREAS) {
+        write(renderRange(container.begin(), container.end()));
+        return;
+    }
+
+    const size_t ranges = pool.size() * 4;
+    const size_t rangeSize = (container.size() + ranges - 1) / ranges;
+    std::vector<std::future<std::string>> rendered;
+    auto first = container.begin();
+    while (first != container.end()) {
+        auto last = first;
+        for (size_t i = 0; i < rangeSize && last != container.end(); i++) {
+            last++;
+        }
+        rendered.push_back(pool.submit([&renderRange, first, last]() {
+            return renderRange(first, last);
+        }));
+        first = last;
+    }
+
+    // Every task must finish before returning, as they refer to renderRange
+    std::exception_ptr error;
+    for (auto& range: rendered) {
+        try {
+            const std::string text = pool.await(range);
+            if (!error) {
+                write(text);
+            }
+        } catch (...) {
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+/*
+  The JSON for one area in Areas::toJSON(): its names and measures.
+*/
+json areaToJSON(const Area& area) {
+    //names convert to json
+    json jNames = area.getNamesMap();
+
+    //measures conv to json
+    std::vector<Measure> measureVec = area.getMeasuresVector();
+    json jMeasures;
+    for (std::vector<Measure>::iterator m = measureVec.begin(); m != measureVec.end(); m++) {
+        Measure tempMeasure = *m;
+        std::string mName = tempMeasure.getCodename();
+        if (tempMeasure.isSummary()) {
+            // Only the summary values are known
+            jMeasures[mName]["average"] = tempMeasure.getAverage();
+            jMeasures[mName]["diff"] = tempMeasure.getDifference();
+            jMeasures[mName]["diffPercent"] = tempMeasure.getDifferenceAsPercentage();
+            continue;
+        }
+        std::map<std::string,double> tempMeasureMap;
+        for (auto& kvp: tempMeasure.getDataMap()) {
+            std::string yearString = std::to_string(kvp.first);
+            double val = kvp.second;
+            tempMeasureMap.insert({yearString, val});
+        }
+        //Append the json created map to the relevant measure name
+        jMeasures[mName] = tempMeasureMap;
+    }
+
+    json j;
+    j["names"] = jNames;
+    j["measures"] = jMeasures;
+    return j;
+}
+
+/*
+  The JSON members for the areas in [first, last), separated by commas.
+*/
+std::string renderJSONRange(AreasContainer::const_iterator first, AreasContainer::const_iterator last) {
+    std::string fragment;
+    for (auto it = first; it != last; it++) {
+        if (!fragment.empty()) {
+            fragment += ',';
+        }
+        fragment += json(it->first).dump();
+        fragment += ':';
+        fragment += areaToJSON(it->second).dump();
+    }
+    return fragment;
+}
+
+/*
+  Render areas as a JSON object, handing the text to write() in pieces. The
+  areas are rendered in ranges (in parallel, if there are many) and joined
+  in order, giving the same text as dumping a single object.
+*/
+template <typename Write>
+void renderJSON(const AreasContainer& container, const Write& write) {
+    if (container.size() == 0) {
+        write(std::string("{}"));
+        return;
+    }
+
+    const std::string comma = ",";
+    bool first = true;
+    write(std::string("{"));
+    renderAreasInOrder(container,
+                       renderJSONRange,
+                       [&](const std::string& fragment) {
+                           if (!first) {
+                               write(comma);
+                           }
+                           first = false;
+                           write(fragment);
+                       });
+    write(std::string("}"));
+}
+
+/*
+  Render areas in long form (see Area::appendDelimited), after a header row,
+  handing the text to write() in pieces.
+*/
+template <typename Write>
+void renderDelimited(const AreasContainer& container, char separator, const Write& write) {
+    std::string header = "authority_code";
+    for (const char *column: {"measure_code", "year", "value"}) {
+        header += separator;
+        header += column;
+    }
+    header += '\n';
+    write(header);
+
+    if (container.size() == 0) {
+        return;
+    }
+    renderAreasInOrder(container,
+                       [separator](AreasContainer::const_iterator first, AreasContainer::const_iterator last) {
+                           std::string rows;
+                           for (auto it = first; it != last; it++) {
+                               it->second.appendDelimited(rows, separator);
+                           }
+                           return rows;
+                       },
+                       write);
+}
+
+/*
+  Render areas as tables, handing the text to write() in pieces. Each range
+  is rendered into its own stream, which starts with the formatting
+  formatting has, and the formatting the last one ends with is passed back
+  to formatting.
+*/
+template <typename Write>
+void renderTables(const AreasContainer& container, std::ios& formatting, const Write& write) {
+    std::ostringstream format;
+    format.copyfmt(formatting);
+    std::ios_base::fmtflags finalFlags = formatting.flags();
+    std::streamsize finalPrecision = formatting.precision();
+    const auto end = container.end();
+
+    renderAreasInOrder(container,
+                       [&](AreasContainer::const_iterator first, AreasContainer::const_iterator last) {
+                           std::ostringstream stream;
+                           stream.copyfmt(format);
+                           for (auto it = first; it != last; it++) {
+                               stream << it->second;
+                           }
+                           if (last == end) {
+                               finalFlags = stream.flags();
+                               finalPrecision = stream.precision();
+                           }
+                           return stream.str();
+                       },
+                       write);
+
+    formatting.flags(finalFlags);
+    formatting.precision(finalPrecision);
+}
+
+} // namespace
+
 /*
   TODO: Areas::Areas()
 
@@ -50,7 +1122,7 @@ using json = nlohmann::json;
   @example
     Areas data = Areas();
 */
-Areas::Areas() {
+Areas::Areas() : streamInOrder(false), streamPosition(), summaryOnly(false) {
 //  throw std::logic_error("Areas::Areas() has not been implemented!");
 }
 
@@ -80,21 +1152,75 @@ Areas::Areas() {
     data.setArea(localAuthorityCode, area);
 */
 void Areas::setArea(const std::string localAuthorityCode, Area area) {
-    if (areasContainer.empty()) {
-        this -> areasContainer.insert({localAuthorityCode, area});
+    auto it = areasContainer.find(localAuthorityCode);
+    if (it == areasContainer.end()) {
+        it = this -> areasContainer.emplace(localAuthorityCode, std::move(area)).first;
     } else {
-        bool found = false;
-        for (auto& keyValPair: areasContainer) {
-            if (areasContainer.find(localAuthorityCode)->first == keyValPair.first) {
-                found = true;
-                // Calls helper function in area class to replace the values inside this area object
-                keyValPair.second = area.combineAreas(area, keyValPair.second);
+        // The new area's names and values replace those already there
+        it->second.merge(std::move(area));
+    }
+    if (summaryOnly) {
+        it->second.summarise();
+    }
+}
+
+/*
+  Areas::merge(newer)
+
+  Combine every Area in another Areas object into this one, exactly as if
+  each had been passed to setArea() (so the newer Areas takes precedence),
+  but without copying them. Both containers are ordered by local authority
+  code, so they are walked together in a single linear pass: areas only in
+  newer are moved in at the current position, and areas in both are merged
+  with Area::merge(). newer is left empty.
+
+  This is how partial results (e.g. from importing files on several threads)
+  are combined.
+
+  @param newer
+    The Areas whose data takes precedence
+
+  @return
+    void
+
+  @example
+    Areas areas = Areas();
+    areas.populate(...);
+
+    Areas more = Areas();
+    more.populate(...);
+
+    areas.merge(std::move(more));
+*/
+void Areas::merge(Areas&& newer) {
+    if (areasContainer.empty()) {
+        areasContainer = std::move(newer.areasContainer);
+        newer.areasContainer.clear();
+        if (summaryOnly) {
+            for (auto& keyValPair: areasContainer) {
+                keyValPair.second.summarise();
             }
         }
-        if (!found) {
-            this -> areasContainer.insert({localAuthorityCode, area});
+        return;
+    }
+
+    auto position = areasContainer.begin();
+    for (auto& keyValPair: newer.areasContainer) {
+        while (position != areasContainer.end() && position->first < keyValPair.first) {
+            position++;
+        }
+        if (position != areasContainer.end() && position->first == keyValPair.first) {
+            position->second.merge(std::move(keyValPair.second));
+        } else {
+            position = areasContainer.emplace_hint(position,
+                                                   keyValPair.first,
+                                                   std::move(keyValPair.second));
+        }
+        if (summaryOnly) {
+            position->second.summarise();
         }
     }
+    newer.areasContainer.clear();
 }
 
 /*
@@ -155,6 +1281,269 @@ unsigned int Areas::size() const {
     return this -> areasContainer.size();
 }
 
+/*
+  Iterators over the (local authority code, Area) pairs in this Areas
+  object, in order of local authority code.
+
+  @example
+    for (auto& keyValPair: areas) {
+        std::cout << keyValPair.first << std::endl;
+    }
+*/
+AreasContainer::const_iterator Areas::begin() const {
+    return this -> areasContainer.begin();
+}
+
+AreasContainer::const_iterator Areas::end() const {
+    return this -> areasContainer.end();
+}
+
+/*
+  Areas::findArea(localAuthorityCode)
+
+  Look up an Area without throwing if it isn't there.
+
+  @param localAuthorityCode
+    The local authority code of the Area
+
+  @return
+    The Area, or nullptr if there is no Area with the code
+*/
+const Area* Areas::findArea(const std::string& localAuthorityCode) const {
+    auto it = areasContainer.find(localAuthorityCode);
+    return it == areasContainer.end() ? nullptr : &it->second;
+}
+
+/*
+  Areas::retainAreas(localAuthorityCodes)
+
+  Remove every Area whose local authority code isn't in a set. Unlike the
+  areas filter given to populate() or filterInto(), an empty set removes
+  every Area.
+
+  @param localAuthorityCodes
+    The codes of the Areas to keep
+
+  @return
+    void
+
+  @example
+    Areas data = Areas();
+    ...
+    data.retainAreas({"W06000011", "W06000023"});
+*/
+void Areas::retainAreas(const StringFilterSet& localAuthorityCodes) {
+    for (auto it = areasContainer.begin(); it != areasContainer.end();) {
+        if (localAuthorityCodes.count(it->first)) {
+            it++;
+        } else {
+            it = areasContainer.erase(it);
+        }
+    }
+}
+
+/*
+  Areas::streamTo(handler)
+
+  Stream the areas imported by populateFromWelshStatsJSON() and
+  populateFromAuthorityByYearCSV() to a handler instead of keeping them.
+  The file is parsed as it is read, and each area is handed over, and
+  removed, as soon as the import has moved past its rows, for as long as
+  the rows are sorted by authority code. From the first row that is out of
+  order, the areas are kept until the whole file has been imported instead;
+  an area already handed over whose code comes up again is then handed over
+  a second time, with just the values from its later rows.
+
+  @param handler
+    The function to give each completed Area to, or nullptr to stop
+    streaming
+
+  @return
+    void
+
+  @example
+    Areas imported = Areas();
+    imported.streamTo([](const Area& area) { std::cout << area; });
+    imported.populate(is, type, cols);
+*/
+void Areas::streamTo(AreaStreamHandler handler) {
+    streamHandler = std::move(handler);
+    streamInOrder = true;
+    streamPosition.clear();
+}
+
+/*
+  Areas::streamCompleted(before)
+
+  When streaming, hand over every area with a code before the one the
+  import has reached, as no more rows can follow for them if the file is
+  sorted by authority code. If the code is before one reached earlier, the
+  file isn't sorted after all, and nothing more is handed over until
+  streamAll(). Does nothing if not streaming.
+
+  @param before
+    The authority code of the row about to be imported, when it differs
+    from the previous row's
+
+  @return
+    void
+*/
+void Areas::streamCompleted(const std::string before) {
+    if (!streamHandler || !streamInOrder) {
+        return;
+    }
+    if (before < streamPosition) {
+        streamInOrder = false;
+        return;
+    }
+    streamPosition = before;
+    const auto end = areasContainer.lower_bound(before);
+    for (auto it = areasContainer.begin(); it != end; it++) {
+        streamHandler(it->second);
+    }
+    areasContainer.erase(areasContainer.begin(), end);
+}
+
+/*
+  Areas::streamAll()
+
+  When streaming, hand over every area that is left, at the end of a file.
+
+  @return
+    void
+*/
+void Areas::streamAll() {
+    if (!streamHandler) {
+        return;
+    }
+    for (auto& keyValPair: areasContainer) {
+        streamHandler(keyValPair.second);
+    }
+    areasContainer.clear();
+}
+
+/*
+  Areas::setSummaryOnly(summaryOnly)
+
+  Choose whether the measures of imported areas keep only running totals
+  (see Measure::summarise), enough for the average, difference and
+  percentage difference. Rows are then fed straight into the totals in
+  file order as they are read, rather than a whole file being parsed
+  first, and a year seen again for the same area and measure replaces its
+  earlier value, so the totals are those a full import would have ended
+  with. The totals still keep one number per year for each measure, so
+  that a value can be replaced, but no map of years or parsed rows.
+
+  @param summaryOnly
+    true to keep only running totals
+
+  @return
+    void
+
+  @example
+    Areas data = Areas();
+    data.setSummaryOnly(true);
+    BethYw::loadDatasets(data, ...);
+    std::cout << data << std::endl;
+*/
+void Areas::setSummaryOnly(bool summaryOnly) {
+    this->summaryOnly = summaryOnly;
+}
+
+/*
+  @return
+    true if imported measures keep only running totals
+*/
+bool Areas::isSummaryOnly() const {
+    return summaryOnly;
+}
+
+/*
+  Areas::buildRangeIndexes()
+
+  Build the year range index of every Measure in every Area, so that
+  Measure::rangeStats() can be answered for any range of years without
+  re-importing the data. Call this once all datasets have been loaded.
+
+  @return
+    void
+
+  @example
+    Areas data = Areas();
+    BethYw::loadDatasets(data, ...);
+    data.buildRangeIndexes();
+
+    auto stats = data.getArea("W06000023").getMeasure("pop").rangeStats(2000, 2010);
+*/
+void Areas::buildRangeIndexes() {
+    for (auto& keyValPair: areasContainer) {
+        keyValPair.second.buildRangeIndexes();
+    }
+}
+
+
+/*
+  Areas::filterInto(target, areasFilter, measuresFilter, yearsFilter, keepEmpty)
+
+  Copy the Areas, Measures and years in this object that pass the given
+  filters into another Areas object, combining them with whatever the target
+  already contains (the copied data takes precedence, as with setArea()).
+  This gives the same result as importing the data with those filters, so a
+  dataset can be imported once and then queried many times.
+
+  @param target
+    The Areas object to copy the filtered data in to
+
+  @param areasFilter
+    An umodifiable pointer to set of umodifiable strings for areas to copy,
+    or an empty set if all areas should be copied
+
+  @param measuresFilter
+    An umodifiable pointer to set of umodifiable strings for measures to copy,
+    or an empty set if all measures should be copied
+
+  @param yearsFilter
+    An umodifiable pointer to an umodifiable tuple of two unsigned integers,
+    where if both values are 0, then all years should be copied, otherwise
+    they should be treated as a the range of years to be copied
+
+  @param keepEmpty
+    Whether to copy Areas left with no measures by the filters (true for
+    areas.csv, where there are only names, false for datasets)
+
+  @return
+    void
+
+  @example
+    Areas popden = Areas();
+    popden.populate(...);
+
+    Areas result = Areas();
+    popden.filterInto(result, &areasFilter, &measuresFilter, &yearsFilter, false);
+*/
+void Areas::filterInto(Areas& target,
+                       const StringFilterSet * const areasFilter,
+                       const StringFilterSet * const measuresFilter,
+                       const YearFilterTuple * const yearsFilter,
+                       bool keepEmpty) const {
+    StringFilterSet lowerMeasures;
+    if (measuresFilter != nullptr) {
+        for (auto& measure: *measuresFilter) {
+            lowerMeasures.insert(Area::toLower(measure));
+        }
+    }
+
+    for (auto& keyValPair: areasContainer) {
+        if (areasFilter != nullptr && !areasFilter->empty()
+                && areasFilter->find(keyValPair.first) == areasFilter->end()) {
+            continue;
+        }
+        Area filtered = keyValPair.second.filter(&lowerMeasures, yearsFilter);
+        if (keepEmpty || filtered.size() != 0) {
+            target.setArea(keyValPair.first, std::move(filtered));
+        }
+    }
+}
 
 /*
   TODO: Areas::populateFromAuthorityCodeCSV(is, cols, areasFilter)
@@ -215,58 +1604,43 @@ void Areas::populateFromAuthorityCodeCSV(
     if (cols.size() != 3) {
         throw std::out_of_range("Wrong number of columns");
     }
-    //Queues to hold all column values, queues are first in first out and are probably best for population
-    std::vector<std::string> authCodes, nameEng, nameCym;
-
 
-    // When the csv file has content in it, store the data in relevant queues
-    std::vector<std::string> fileContent;
-    std::vector<std::string> allContent;
-    std::string thisLine;
-    if (is.good()) {
-        while(std::getline(is, thisLine)) {//Add all lines of the file to a vector
-            fileContent.push_back(thisLine);
-        }
-        for (unsigned int i = 0; i < fileContent.size(); i++) {
-            std::stringstream ss(fileContent[i]);
-            while (ss.good()) {//Add all individual elements to a bigger vector
-                std::string tempString;
-                std::getline( ss, tempString, ',' );
-                allContent.push_back(tempString);
+    // The file is read whole and then scanned, in parallel if it is large.
+    // Names may be quoted (e.g. if they contain commas)
+    const std::string content = readWhole(is);
+    CsvScanner header(content.data(), content.size());
+
+    // Ignore column titles
+    header.startRow();
+    populateFromCsvRanges(*this, content, header.position(),
+                          [&content, areasFilter](size_t begin, size_t end, Areas& target) {
+        CsvScanner scanner(content.data() + begin, end - begin);
+        CsvField field;
+        while (scanner.startRow()) {
+            if (!scanner.nextField(field) || field.empty()) {
+                continue;
             }
-        }
-        // Ignore column titles
-        for (unsigned int i = 3; i < allContent.size(); i+=3) {
-            authCodes.push_back(allContent[i]);
-            nameEng.push_back(allContent[i+1]);
-            nameCym.push_back(allContent[i+2]);
-        }
-
-        // Remove the column headings as we don't want these as area objects
-        // If empty we can assume no args were called or 'all' was called and we want everything
-        if (areasFilter == nullptr || areasFilter->empty()) {
-            for (unsigned int i = 0; i < authCodes.size(); i++) {
-                Area newArea(authCodes[i]);
-                newArea.setName("eng", nameEng[i]);
-                newArea.setName("cym", nameCym[i]);
-                this->setArea(authCodes[i], newArea);
+            const std::string authCode = field.str();
+            if (areasFilter != nullptr && !areasFilter->empty()
+                    && areasFilter->find(authCode) == areasFilter->end()) {
+                continue;
             }
-        } else {
-            for (auto it = areasFilter->begin(); it != areasFilter->end(); it++) {
-                unsigned int indexOfReq = 0;
 
-                for (auto const& authCode: authCodes) {
-                    if (authCode == *it) { break; }
-                    else { indexOfReq++; }
+            std::string names[2];
+            for (auto& name: names) {
+                if (!scanner.nextField(field)) {
+                    throw std::runtime_error("Areas::populateFromAuthorityCodeCSV: Missing name for "
+                                             + authCode);
                 }
-
-                Area newArea(authCodes[indexOfReq]);
-                newArea.setName("eng", nameEng[indexOfReq]);
-                newArea.setName("cym", nameCym[indexOfReq]);
-                this->setArea(newArea.getLocalAuthorityCode(), newArea);
+                name = field.str();
             }
+
+            Area newArea(authCode);
+            newArea.setName("eng", names[0]);
+            newArea.setName("cym", names[1]);
+            target.setArea(authCode, std::move(newArea));
         }
-    }
+    });
 }
 
 /*
@@ -378,95 +1752,114 @@ void Areas::populateFromWelshStatsJSON(std::istream& is,
                                        const StringFilterSet * const areasFilter,
                                        const StringFilterSet * const measuresFilter,
                                        const YearFilterTuple * const yearsFilter) {
-    // istream is is the file that we have input
-    // cols is the columns of
-    if (cols.size() == 6) {
-        json j;
-        is >> j;
+    if (cols.size() != 6) {
+        throw std::out_of_range("There are not enough columns in cols");
+    }
 
-        for (auto& el : j["value"].items()) {
-            // Setting up temporary values to populate measure and area object with based on file
-            auto &data = el.value();
-            std::string code;
-            std::string label;
-            if (j["odata.metadata"] == "http://open.statswales.gov.wales/en-gb/dataset/$metadata#tran0152") {
-                code = cols.find(BethYw::SourceColumn::SINGLE_MEASURE_CODE)->second;
-                label = cols.find(BethYw::SourceColumn::SINGLE_MEASURE_NAME)->second;
-            } else {
-                code = data[cols.find(BethYw::SourceColumn::MEASURE_CODE)->second];
-                label = data[cols.find(BethYw::SourceColumn::MEASURE_NAME)->second];
-            }
-            std::string authCode = data[cols.find(BethYw::SourceColumn::AUTH_CODE)->second];
-            std::string engName = data[cols.find(BethYw::SourceColumn::AUTH_NAME_ENG)->second];
-            std::string tempYear = data[cols.find(BethYw::SourceColumn::YEAR)->second];
-            unsigned int year = std::stoi(tempYear);
-
-            // do stuff here...
-            double value = 0;
-            std::string odata = j["odata.metadata"];
-            if (odata == "http://open.statswales.gov.wales/en-gb/dataset/$metadata#envi0201") {
-                std::string tempValStr = data[cols.find(BethYw::SourceColumn::VALUE)->second];
-                value = std::stod(tempValStr);
-            } else {
-                value = data[cols.find(BethYw::SourceColumn::VALUE)->second];
-            }
-            authCode = toUpper(authCode);
-            code = toLower(code);
-            Area tempArea(authCode);
-            tempArea.setName("eng", engName);
-
-            Measure tempMeasure(code, label);
-            tempMeasure.setValue(year, value);
-            tempArea.setMeasure(code, tempMeasure);
-
-            // Then add it to areas container
-            /**
-             * Checking for filters starting with the areas filter, followed by measure, then years,
-             * as all of the filter checks are basically the same I will only explain areas,
-             * checks from start to end and looks for the value in the filter being equal to the current authority code
-             * if it is found then it sets the areas argument to true to move on to measure.
-             */
-            bool areaBool = false;
-            for (auto it = areasFilter->begin(); it != areasFilter->end(); it++) {
-                if (*it == authCode) {
-                    areaBool = true;
-                }
-            }
-            if (areasFilter->empty()) {
-                areaBool = true;
+    // Only the columns in cols are kept, and only rows passing the filters
+    const WelshStatsColumns columns = welshStatsColumns(cols);
+    const ImportFilters filters(areasFilter, measuresFilter, yearsFilter);
+
+    // When streaming, each row is imported as soon as the parser has read
+    // it, and each area handed over as soon as the rows move past it.
+    // Summaries are imported the same way, as they can't be merged like the
+    // partial results of a parallel import. This needs nlohmann::json, as
+    // the structural index needs the whole document.
+    if (streamHandler || summaryOnly) {
+        std::string previous;
+        WelshStatsRowBuilder rows(columns, filters, [this, &previous](WelshStatsRecord&& record) {
+            if (record.authCode != previous) {
+                streamCompleted(record.authCode);
+                previous = record.authCode;
             }
+            importWelshStatsRecord(*this, record);
+        });
+        readWelshStatsNlohmann(is, rows);
+        streamAll();
+        return;
+    }
 
-            bool measureBool = false;
-            for (auto it = measuresFilter->begin(); it != measuresFilter->end(); it++) {
-                std::string lowerMeasureCode = toLower(code);
-                std::string tempM = toLower(*it);
-                if (lowerMeasureCode == tempM) {
-                    measureBool = true;
-                }
-            }
-            if (measuresFilter->empty()) {
-                measureBool = true;
-            }
+    std::vector<WelshStatsRecord> records;
+    const std::string document = readWhole(is);
+    switch (jsonEngine.load()) {
+        case JsonEngine::NLOHMANN: {
+            WelshStatsRowBuilder rows(columns, filters, records);
+            readWelshStatsNlohmann(document, rows);
+            break;
+        }
+        case JsonEngine::SIMD: {
+            WelshStatsRowBuilder rows(columns, filters, records);
+            readWelshStatsSimd(document, rows);
+            break;
+        }
+        case JsonEngine::VERIFY:
+            readWelshStatsVerified(document, columns, filters, records);
+            break;
+    }
 
-            bool yearBool = false;
-            if (std::get<0>(*yearsFilter) == 0 || std::get<1>(*yearsFilter) == 0) {
-                yearBool = true;
-            } else if (yearsFilter == nullptr) {
-                yearBool = true;
-            }else {
-                if (((year >= std::get<0>(*yearsFilter)) && (year <= std::get<1>(*yearsFilter))) && (yearsFilter !=
-                        nullptr)) {
-                    yearBool = true;
-                }
+    ThreadPool &pool = ThreadPool::shared();
+    if (pool.size() == 1 || records.size() < PARALLEL_JSON_MIN_ROWS) {
+        for (auto& record: records) {
+            importWelshStatsRecord(*this, record);
+        }
+        return;
+    }
+
+    // Split the records into ranges, each imported concurrently into its own
+    // partial Areas, and merge those in the order of the ranges so that a
+    // later record for the same area, measure and year always wins
+    const size_t ranges = pool.size() * 4;
+    const size_t rangeSize = (records.size() + ranges - 1) / ranges;
+    std::vector<Areas> partials((records.size() + rangeSize - 1) / rangeSize);
+    std::vector<std::future<void>> tasks;
+    for (size_t begin = 0; begin < records.size(); begin += rangeSize) {
+        const size_t end = std::min(begin + rangeSize, records.size());
+        Areas *partial = &partials[begin / rangeSize];
+        tasks.push_back(pool.submit([partial, &records, begin, end]() {
+            for (size_t i = begin; i < end; i++) {
+                importWelshStatsRecord(*partial, records[i]);
             }
+        }));
+    }
 
-            if (areaBool && measureBool && yearBool) {
-                setArea(authCode, tempArea);
+    // Every task must finish before the records go out of scope
+    std::exception_ptr error;
+    for (auto& task: tasks) {
+        try {
+            pool.await(task);
+        } catch (...) {
+            if (!error) {
+                error = std::current_exception();
             }
         }
-    } else {
-        throw std::out_of_range("There are not enough columns in cols");
     }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    for (auto& partial: partials) {
+        merge(std::move(partial));
+    }
+}
+
+/*
+  Areas::setJsonEngine(engine)
+
+  Choose how WelshStats JSON files are read by every Areas from now on.
+  VERIFY reads each file with both engines and throws a std::runtime_error
+  if they disagree, which makes a quick differential test of the SIMD
+  engine against nlohmann::json on real datasets.
+
+  @param engine
+    The engine to read with
+
+  @return
+    void
+
+  @example
+    Areas::setJsonEngine(JsonEngine::VERIFY);
+*/
+void Areas::setJsonEngine(JsonEngine engine) {
+    jsonEngine = engine;
 }
 
 /**
@@ -569,93 +1962,44 @@ void Areas::populateFromAuthorityByYearCSV(std::istream& is,
     if (cols.size() != 3) {
         throw std::out_of_range("Wrong number of columns");
     }
-    //Queues to hold all column values, queues are first in first out and are probably best for population
-    std::vector<std::string> authCodes;
-    std::vector<int> yearsVec;
-    // Each line of the file will be stored as auth code, and then the following values
-
-    std::map<std::string, std::map<int, double>> authYearValMap;
 
+    const std::string measureCode = cols.at(BethYw::SourceColumn::SINGLE_MEASURE_CODE);
+    const std::string measureName = cols.at(BethYw::SourceColumn::SINGLE_MEASURE_NAME);
+    const ImportFilters filters(areasFilter, measuresFilter, yearFilter);
+    if (!filters.measure(toLower(measureCode))) {
+        return;
+    }
 
-    // When the csv file has content in it, store the data in relevant queues
-    std::vector<std::string> fileContent;
-    std::vector<std::string> allContent;
-    std::string thisLine;
-    if (is.good()) {
-        while (std::getline(is, thisLine)) {
-            fileContent.push_back(thisLine);
-        }
-        for (unsigned int i = 0; i < fileContent.size(); i++) {
-            std::stringstream ss(fileContent[i]);
-            while (ss.good()) {
-                std::string tempString;
-                std::getline(ss, tempString, ',');
-                allContent.push_back(tempString);
-            }
-        }
-
-        //Populate years vector
-        for (int i = 1; i < 12; i++) {
-            int tempYear = std::stoi(allContent[i]);
-            yearsVec.push_back(tempYear);
-        }
-        // Ignore column titles
-        // Remove the years are outside of the range
-        int year1 = std::get<0>(*yearFilter);
-        int year2 = std::get<1>(*yearFilter);
-        for (unsigned int i = 12; i < allContent.size(); i += 12) {
-            std::map<int, double> tempSavedVals;
-            int mapIterator = 1;
-            for (auto it = yearsVec.begin(); it != yearsVec.end(); it++) {
-                int tempYear = *it;
-                double tempVal = std::stod(allContent[i+mapIterator]);
-                if ((yearFilter != nullptr) && (year1 != 0 && year2 != 0)) {
-                    if (tempYear >= year1 && tempYear <= year2) {
-                        tempSavedVals.insert({tempYear, tempVal});
-                    }
-                } else {
-                    tempSavedVals.insert({tempYear, tempVal});
-                }
-                mapIterator++;
-            }
-            if (areasFilter->size() != 0 && areasFilter != nullptr) {
-                if (areasFilter->find(allContent[i]) != areasFilter->end()) {
-                    authYearValMap.insert({allContent[i], tempSavedVals});
-                }
-            } else {
-                authYearValMap.insert({allContent[i], tempSavedVals});
-            }
-        }
-        // Remove the column headings as we don't want these as area objects
-        // Remove the authority code areas that aren't wanted
-
-        // Find the relevant code and name values
-
-        std::string measureCode = cols.find(BethYw::SourceColumn::SINGLE_MEASURE_CODE)->second;
-        std::string measureName = cols.find(BethYw::SourceColumn::SINGLE_MEASURE_NAME)->second;
-        Measure tempMeasure(measureCode, measureName);
-        // Finally create all areas, 1 by 1 and populate their measure values
-        for (auto &codeMeasureMap: authYearValMap) {//Look at all areas 1 by 1 and populate
-            Area tempArea(codeMeasureMap.first);
-            // now iterate through the measure map and set values
-            std::map<int, double> tempYearMap = codeMeasureMap.second;
-            for (auto &yearValMap: tempYearMap) {//Set all measures in a tempArea
-                tempMeasure.setValue(yearValMap.first, yearValMap.second);
-            }
-            tempArea.setMeasure(codeMeasureMap.first, tempMeasure);
+    // On a single thread, the file is streamed: the parse stage runs on its
+    // own thread, tokenising rows into batches while this thread (the merge
+    // stage) adds earlier batches to the areas. This is also how summaries
+    // are imported, as they can't be merged from parallel ranges, and how
+    // areas are streamed out, each as soon as the rows move past it.
+    if (ThreadPool::shared().size() == 1 || summaryOnly || streamHandler) {
+        streamAuthorityByYearCSV(*this, is, filters, measureCode, measureName);
+        streamAll();
+        return;
+    }
 
-            if (measuresFilter->size() != 0 && measuresFilter != nullptr) {
-                if (measuresFilter->find(measureCode) != measuresFilter->end()) {//If measure code is found, measure is to be included
-                    this->setArea(codeMeasureMap.first, tempArea);
-                }
-            } else {//Include all measures
-                this->setArea(codeMeasureMap.first, tempArea);
+    // Otherwise it is read whole and its rows parsed in parallel ranges
+    const std::string content = readWhole(is);
+    CsvScanner header(content.data(), content.size());
+    if (!header.startRow()) {
+        throw std::runtime_error("Areas::populateFromAuthorityByYearCSV: File is empty");
+    }
+    AuthorityByYearColumns columns;
+    columns.readHeader(header, filters);
+
+    populateFromCsvRanges(*this, content, header.position(),
+                          [&](size_t begin, size_t end, Areas& target) {
+        CsvScanner scanner(content.data() + begin, end - begin);
+        AuthorityByYearRow row;
+        while (scanner.startRow()) {
+            if (columns.readRow(scanner, filters, row)) {
+                importAuthorityByYearRow(target, measureCode, measureName, row);
             }
         }
-    } else {
-        std::cout << "File isn't good" << std::endl;
-    }
-
+    });
 }
 
 
@@ -715,7 +2059,8 @@ void Areas::populate(std::istream &is,
                      const BethYw::SourceDataType &type,
                      const BethYw::SourceColumnMapping &cols) {
     if (type == BethYw::AuthorityCodeCSV) {
-        populateFromAuthorityCodeCSV(is, cols);
+        PipelinedInput pipelined(is);
+        populateFromAuthorityCodeCSV(pipelined, cols);
     } else {
     throw std::runtime_error("Areas::populate: Unexpected data type");
   }
@@ -811,12 +2156,14 @@ void Areas::populate(
     const StringFilterSet * const measuresFilter,
     const YearFilterTuple * const yearsFilter)
      {
+  // The file is read ahead on another thread while it is parsed
+  PipelinedInput pipelined(is);
   if (type == BethYw::AuthorityCodeCSV) {
-    populateFromAuthorityCodeCSV(is, cols, areasFilter);
+    populateFromAuthorityCodeCSV(pipelined, cols, areasFilter);
   } else if (type == BethYw::WelshStatsJSON) {
-      populateFromWelshStatsJSON(is, cols, areasFilter, measuresFilter, yearsFilter);
+      populateFromWelshStatsJSON(pipelined, cols, areasFilter, measuresFilter, yearsFilter);
   } else if (type == BethYw::AuthorityByYearCSV) {
-      populateFromAuthorityByYearCSV(is, cols, areasFilter, measuresFilter, yearsFilter);
+      populateFromAuthorityByYearCSV(pipelined, cols, areasFilter, measuresFilter, yearsFilter);
   } else {
     throw std::runtime_error("Areas::populate: Unexpected data type");
   }
@@ -896,45 +2243,177 @@ void Areas::populate(
     std::cout << data.toJSON();
 */
 std::string Areas::toJSON() const {
-  json j;
-  if (this->areasContainer.size() == 0) {
-      return "{}";
-  } else {
-      for (auto it = areasContainer.begin(); it != areasContainer.end(); it++) {
-          // it -> first is local auth code, inside format names followed by measures, for loop to set up json
-          // names and measures objects
-          Area tempArea = it->second;
-          //names convert to json
-          json jNames;
-          //Make a temporary map which is the area's values
-          std::map<std::string, std::string> tempNameMap = tempArea.getNamesMap();
-          //Convert this map with json lib
-          json j_map(tempNameMap);
-          jNames = tempNameMap;
-
-          //measures conv to json
-          std::vector<Measure> measureVec = tempArea.getMeasuresVector();
-          json jMeasures;
-          for (std::vector<Measure>::iterator m = measureVec.begin(); m != measureVec.end(); m++) {
-              Measure tempMeasure = *m;
-              std::string mName = tempMeasure.getCodename();
-              std::map<std::string,double> tempMeasureMap;
-              for (auto& kvp: tempMeasure.getDataMap()) {
-                  std::string yearString = std::to_string(kvp.first);
-                  double val = kvp.second;
-                  tempMeasureMap.insert({yearString, val});
+  std::string jsonStr;
+  renderJSON(areasContainer, [&jsonStr](const std::string& text) {
+      jsonStr += text;
+  });
+  return jsonStr;
+}
+
+/*
+  Areas::writeJSON(sink)
+
+  Write the same JSON as toJSON() to an output sink, handing it each range
+  of areas as it is rendered rather than building the whole document first.
+
+  @param sink
+    The OutputSink to write to
+
+  @throws
+    std::runtime_error if the sink fails to write
+
+  @example
+    OutputStdout output;
+    areas.writeJSON(output);
+    output.flush();
+*/
+void Areas::writeJSON(OutputSink& sink) const {
+  renderJSON(areasContainer, [&sink](const std::string& text) {
+      sink.write(text);
+  });
+}
+
+/*
+  Areas::writeTable(sink)
+
+  Write the same tables as operator<< (into a stream with the default
+  formatting) to an output sink, handing it each range of areas as it is
+  rendered.
+
+  @param sink
+    The OutputSink to write to
+
+  @throws
+    std::runtime_error if the sink fails to write
+
+  @example
+    OutputFile output("areas.txt");
+    areas.writeTable(output);
+    output.flush();
+*/
+void Areas::writeTable(OutputSink& sink) const {
+  if (areasContainer.size() == 0) {
+      sink.write("No areas to print\n");
+      return;
+  }
+  std::ostringstream formatting;
+  renderTables(areasContainer, formatting, [&sink](const std::string& text) {
+      sink.write(text);
+  });
+}
+
+/*
+  Areas::toDelimited(separator)
+
+  Render the areas in long (tidy) form: a header row of authority_code,
+  measure_code, year and value, then a row per value of every measure of
+  every area (see Area::appendDelimited), in authority code order.
+
+  @param separator
+    The character between fields, ',' for CSV or '\t' for TSV
+
+  @return
+    The rows, each ending with a new line
+
+  @example
+    Areas areas;
+    ...
+    std::cout << areas.toDelimited(',');
+*/
+std::string Areas::toDelimited(char separator) const {
+  std::string rows;
+  renderDelimited(areasContainer, separator, [&rows](const std::string& text) {
+      rows += text;
+  });
+  return rows;
+}
+
+/*
+  Areas::writeDelimited(sink, separator)
+
+  Write the same rows as toDelimited() to an output sink, handing it each
+  range of areas as it is rendered.
+
+  @param sink
+    The OutputSink to write to
+
+  @param separator
+    The character between fields, ',' for CSV or '\t' for TSV
+
+  @throws
+    std::runtime_error if the sink fails to write
+
+  @example
+    OutputFile output("areas.csv");
+    areas.writeDelimited(output, ',');
+    output.flush();
+*/
+void Areas::writeDelimited(OutputSink& sink, char separator) const {
+  renderDelimited(areasContainer, separator, [&sink](const std::string& text) {
+      sink.write(text);
+  });
+}
+
+/*
+  Areas::writeArrow(sink)
+
+  Write the areas as an Apache Arrow IPC stream holding the same long form
+  table as toDelimited() (see arrow.h for its columns), in record batches
+  of up to ARROW_BATCH_ROWS rows.
+
+  @param sink
+    The OutputSink to write to
+
+  @throws
+    std::out_of_range if a year does not fit in 16 bits, or
+    std::runtime_error if the sink fails to write
+
+  @example
+    OutputFile output("areas.arrow");
+    areas.writeArrow(output);
+    output.flush();
+*/
+void Areas::writeArrow(OutputSink& sink) const {
+  std::vector<std::string> areaCodes;
+  std::map<std::string, int32_t> measureIndexes;
+  for (auto& codeArea: areasContainer) {
+      areaCodes.push_back(codeArea.first);
+      for (const Measure *measure: codeArea.second.sortedMeasures()) {
+          measureIndexes.insert({measure->getCodename(), 0});
+      }
+  }
+  std::vector<std::string> measureCodes;
+  for (auto& codeIndex: measureIndexes) {
+      codeIndex.second = static_cast<int32_t>(measureCodes.size());
+      measureCodes.push_back(codeIndex.first);
+  }
+
+  ArrowStreamWriter writer(sink, areaCodes, measureCodes);
+  ArrowBatch batch;
+  int32_t areaIndex = 0;
+  for (auto& codeArea: areasContainer) {
+      for (const Measure *measure: codeArea.second.sortedMeasures()) {
+          const int32_t measureIndex = measureIndexes[measure->getCodename()];
+          for (auto& yearValue: measure->getData()) {
+              if (yearValue.first < std::numeric_limits<int16_t>::min()
+                      || yearValue.first > std::numeric_limits<int16_t>::max()) {
+                  throw std::out_of_range("Areas::writeArrow: Year " + std::to_string(yearValue.first)
+                                          + " does not fit in 16 bits");
+              }
+              batch.areas.push_back(areaIndex);
+              batch.measures.push_back(measureIndex);
+              batch.years.push_back(static_cast<int16_t>(yearValue.first));
+              batch.values.push_back(yearValue.second);
+              if (batch.size() == ARROW_BATCH_ROWS) {
+                  writer.writeBatch(batch);
+                  batch.clear();
               }
-              json j_map(tempMeasureMap);
-              //Append the json created map to the relevant measure name
-              jMeasures[mName] = tempMeasureMap;
           }
-
-          j[it->first]["names"] = jNames;
-          j[it->first]["measures"] = jMeasures;
       }
+      areaIndex++;
   }
-  std::string jsonStr = j.dump();
-  return jsonStr;
+  writer.writeBatch(batch);
+  writer.finish();
 }
 
 /*
@@ -1045,15 +2524,11 @@ std::string Areas::toJSON() const {
 */
 std::ostream &operator<<(std::ostream &os, const Areas &areas) {
     if (areas.size() != 0) {
-        std::vector<Area> areasCpy;
-        for (auto it = areas.areasContainer.begin(); it != areas.areasContainer.end(); it++) {
-            areasCpy.push_back(it->second);
-        }
-        std::sort(areasCpy.begin(), areasCpy.end());
-        for (auto it = areasCpy.begin(); it != areasCpy.end(); it++) {
-//            std::cout << "Printing " << *it;
-            os << *it;
-        }
+        // The container is already in authority code order (as Area's
+        // operator< is)
+        renderTables(areas.areasContainer, os, [&os](const std::string& text) {
+            os.write(text.data(), text.size());
+        });
     } else {
         os << "No areas to print\n";
     }
@@ -26,6 +26,7 @@
   functions and member variables you need to declare in this class.
  */
 
+#include <functional>
 #include <iostream>
 #include <string>
 #include <tuple>
@@ -33,6 +34,7 @@
 
 #include "datasets.h"
 #include "area.h"
+#include "output.h"
 
 /*
   An alias for filters based on strings such as categorisations e.g. area,
@@ -53,6 +55,19 @@ using YearFilterTuple = std::tuple<unsigned int, unsigned int>;
 */
 using AreasContainer = std::map<std::string, Area>;
 
+/*
+  A function given each Area an Areas has finished importing, when it is
+  streaming them (see Areas::streamTo).
+*/
+using AreaStreamHandler = std::function<void(const Area&)>;
+
+/*
+  The JSON readers populateFromWelshStatsJSON() can use: nlohmann::json's
+  SAX parser, the SIMD structural index in jsonindex.h (the default), or
+  both, failing if they read different records.
+*/
+enum class JsonEngine { NLOHMANN, SIMD, VERIFY };
+
 /*
   Areas is a class that stores all the data categorised by area. The 
   underlying Standard Library container is customisable using the alias above.
@@ -72,10 +87,27 @@ public:
   Areas();
 
   void setArea(const std::string localAuthorityCode, Area area);
-  std::string toLower(std::string s);
-  std::string toUpper(std::string s);
+  void merge(Areas&& newer);
+  static std::string toLower(std::string s);
+  static std::string toUpper(std::string s);
+  static void setJsonEngine(JsonEngine engine);
   Area& getArea(std::string localAuthorityCode);
   unsigned int size() const;
+  AreasContainer::const_iterator begin() const;
+  AreasContainer::const_iterator end() const;
+  const Area* findArea(const std::string& localAuthorityCode) const;
+  void retainAreas(const StringFilterSet& localAuthorityCodes);
+  void buildRangeIndexes();
+  void streamTo(AreaStreamHandler handler);
+  void streamCompleted(const std::string before);
+  void streamAll();
+  void setSummaryOnly(bool summaryOnly);
+  bool isSummaryOnly() const;
+  void filterInto(Areas& target,
+                  const StringFilterSet * const areasFilter,
+                  const StringFilterSet * const measuresFilter,
+                  const YearFilterTuple * const yearsFilter,
+                  bool keepEmpty = true) const;
 
   void populateFromAuthorityCodeCSV(
      std::istream& is,
@@ -114,11 +146,25 @@ public:
 
   friend std::ostream &operator<<(std::ostream &os, const Areas &areas);
   std::string toJSON() const;
+  void writeJSON(OutputSink& sink) const;
+  void writeTable(OutputSink& sink) const;
+  std::string toDelimited(char separator) const;
+  void writeDelimited(OutputSink& sink, char separator) const;
+  void writeArrow(OutputSink& sink) const;
 
 protected:
     AreasContainer areasContainer;
     YearFilterTuple yearFilterTuple;
     StringFilterSet stringFilterSet;
+
+    // Where completed areas go when streaming, whether the rows imported so
+    // far have been sorted by authority code, and the last code reached
+    AreaStreamHandler streamHandler;
+    bool streamInOrder;
+    std::string streamPosition;
+
+    // Whether measures keep only their running totals (see Measure::summarise)
+    bool summaryOnly;
 };
 
 #endif // AREAS_H
\ No newline at end of file
@@ -0,0 +1,536 @@
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  This file contains the implementation of ArrowStreamWriter and the
+  flatbuffer builder it uses. See arrow.h for an overview.
+
+  An IPC stream is a sequence of messages, each made up of:
+
+    0xFFFFFFFF                  a continuation marker
+    int32                       the size of the metadata, with its padding
+    Message flatbuffer          the metadata, padded with zeros
+    body                        the message's buffers, each padded with zeros
+
+  and the stream ends with 0xFFFFFFFF followed by a zero size. All of the
+  numbers are little endian, as is every processor we build for.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "arrow.h"
+
+namespace {
+
+/*
+  What the metadata and every body buffer are padded to a multiple of.
+*/
+constexpr size_t ARROW_ALIGNMENT = 64;
+
+/*
+  Values from Schema.fbs and Message.fbs.
+*/
+constexpr int16_t METADATA_V5 = 4;
+constexpr uint8_t HEADER_SCHEMA = 1;
+constexpr uint8_t HEADER_DICTIONARY_BATCH = 2;
+constexpr uint8_t HEADER_RECORD_BATCH = 3;
+constexpr uint8_t TYPE_INT = 2;
+constexpr uint8_t TYPE_FLOATING_POINT = 3;
+constexpr uint8_t TYPE_UTF8 = 5;
+constexpr int16_t PRECISION_DOUBLE = 2;
+constexpr int16_t ENDIANNESS_LITTLE = 0;
+
+/*
+  The dictionary ids of the two dictionary-encoded columns.
+*/
+constexpr int64_t AREA_DICTIONARY = 0;
+constexpr int64_t MEASURE_DICTIONARY = 1;
+
+/*
+  The length and null count of a column in a record batch (FieldNode), or
+  the offset and length of a buffer in the body (Buffer). Both are structs
+  of two longs.
+*/
+using LongPair = std::pair<int64_t, int64_t>;
+
+size_t padded(size_t size) {
+    return (size + ARROW_ALIGNMENT - 1) / ARROW_ALIGNMENT * ARROW_ALIGNMENT;
+}
+
+/*
+  Builds a flatbuffer back to front, as the flatbuffers library does, so
+  that everything a table or vector refers to is already built (and so
+  comes after it, as offsets must point forwards). Objects are identified
+  by their distance from the end of the buffer, which doesn't change as
+  more is added in front of them.
+
+  Tables are built by creating whatever they refer to, then calling
+  startTable(), the add functions for each field, and endTable().
+*/
+class FlatBuilder {
+public:
+    FlatBuilder() : used(0), maxAlign(1), tableStart(0) {}
+
+    /*
+      The position of whatever was built last.
+    */
+    uint32_t offset() const {
+        return static_cast<uint32_t>(used);
+    }
+
+    template <typename T>
+    void push(T value) {
+        align(sizeof(T));
+        std::memcpy(reserve(sizeof(T)), &value, sizeof(T));
+    }
+
+    /*
+      Add an offset (relative to itself) to the object at target.
+    */
+    void pushOffset(uint32_t target) {
+        align(4);
+        push<uint32_t>(static_cast<uint32_t>(used + 4 - target));
+    }
+
+    uint32_t createString(const std::string& text) {
+        align(4, text.size() + 1);
+        *reserve(1) = 0;
+        std::memcpy(reserve(text.size()), text.data(), text.size());
+        push<uint32_t>(static_cast<uint32_t>(text.size()));
+        return offset();
+    }
+
+    uint32_t createOffsetVector(const std::vector<uint32_t>& targets) {
+        align(4);
+        for (auto it = targets.rbegin(); it != targets.rend(); it++) {
+            pushOffset(*it);
+        }
+        push<uint32_t>(static_cast<uint32_t>(targets.size()));
+        return offset();
+    }
+
+    uint32_t createPairVector(const std::vector<LongPair>& pairs) {
+        align(8, pairs.size() * 16);
+        for (auto it = pairs.rbegin(); it != pairs.rend(); it++) {
+            push<int64_t>(it->second);
+            push<int64_t>(it->first);
+        }
+        push<uint32_t>(static_cast<uint32_t>(pairs.size()));
+        return offset();
+    }
+
+    void startTable() {
+        fields.clear();
+        tableStart = used;
+    }
+
+    template <typename T>
+    void addField(unsigned int slot, T value) {
+        push<T>(value);
+        fields.push_back({slot, offset()});
+    }
+
+    void addOffsetField(unsigned int slot, uint32_t target) {
+        pushOffset(target);
+        fields.push_back({slot, offset()});
+    }
+
+    /*
+      Finish a table, adding its vtable (the offset of each field from the
+      start of the table) in front of it.
+    */
+    uint32_t endTable() {
+        push<int32_t>(0);
+        const uint32_t table = offset();
+
+        unsigned int slots = 0;
+        for (auto& field: fields) {
+            slots = std::max(slots, field.first + 1);
+        }
+        std::vector<uint16_t> entries(slots, 0);
+        for (auto& field: fields) {
+            entries[field.first] = static_cast<uint16_t>(table - field.second);
+        }
+        for (auto it = entries.rbegin(); it != entries.rend(); it++) {
+            push<uint16_t>(*it);
+        }
+        push<uint16_t>(static_cast<uint16_t>(table - tableStart));
+        push<uint16_t>(static_cast<uint16_t>(4 + 2 * slots));
+
+        // The table starts with the (signed) distance back to its vtable
+        const int32_t toVtable = static_cast<int32_t>(offset() - table);
+        std::memcpy(at(table), &toVtable, sizeof(toVtable));
+        return table;
+    }
+
+    /*
+      Finish the buffer with the offset of its root table.
+    */
+    std::string finish(uint32_t root) {
+        align(std::max<size_t>(maxAlign, 4), 4);
+        pushOffset(root);
+        return std::string(reinterpret_cast<const char*>(at(offset())), used);
+    }
+
+private:
+    uint8_t *at(uint32_t position) {
+        return buffer.data() + buffer.size() - position;
+    }
+
+    /*
+      Make room for size more bytes in front, returning where they start.
+    */
+    uint8_t *reserve(size_t size) {
+        if (used + size > buffer.size()) {
+            std::vector<uint8_t> larger(std::max(buffer.size() * 2, used + size + 256));
+            std::memcpy(larger.data() + larger.size() - used, buffer.data() + buffer.size() - used, used);
+            buffer.swap(larger);
+        }
+        used += size;
+        return at(offset());
+    }
+
+    /*
+      Pad so that, after another additional bytes, the size is a multiple
+      of alignment.
+    */
+    void align(size_t alignment, size_t additional = 0) {
+        maxAlign = std::max(maxAlign, alignment);
+        const size_t padding = (alignment - (used + additional) % alignment) % alignment;
+        if (padding > 0) {
+            std::memset(reserve(padding), 0, padding);
+        }
+    }
+
+    std::vector<uint8_t> buffer;
+    size_t used;
+    size_t maxAlign;
+
+    // The table being built: where it starts, and the slot and position of
+    // each field added so far
+    size_t tableStart;
+    std::vector<std::pair<unsigned int, uint32_t>> fields;
+};
+
+/*
+  Build an Int type table.
+*/
+uint32_t intType(FlatBuilder& builder, int32_t bitWidth) {
+    builder.startTable();
+    builder.addField<int32_t>(0, bitWidth);
+    builder.addField<uint8_t>(1, 1);
+    return builder.endTable();
+}
+
+/*
+  Build a Field table for a nullable column.
+*/
+uint32_t field(FlatBuilder& builder,
+               const std::string& name,
+               uint8_t typeType,
+               uint32_t type,
+               uint32_t dictionary = 0) {
+    const uint32_t nameString = builder.createString(name);
+    const uint32_t children = builder.createOffsetVector({});
+
+    builder.startTable();
+    builder.addOffsetField(0, nameString);
+    builder.addField<uint8_t>(1, 1);
+    builder.addField<uint8_t>(2, typeType);
+    builder.addOffsetField(3, type);
+    if (dictionary != 0) {
+        builder.addOffsetField(4, dictionary);
+    }
+    builder.addOffsetField(5, children);
+    return builder.endTable();
+}
+
+/*
+  Build a Field table for a column of strings encoded with dictionary id.
+*/
+uint32_t dictionaryField(FlatBuilder& builder, const std::string& name, int64_t id) {
+    builder.startTable();
+    const uint32_t utf8 = builder.endTable();
+    const uint32_t indexType = intType(builder, 32);
+
+    builder.startTable();
+    builder.addField<int64_t>(0, id);
+    builder.addOffsetField(1, indexType);
+    // The dictionaries are sorted, so index order is value order
+    builder.addField<uint8_t>(2, 1);
+    const uint32_t encoding = builder.endTable();
+
+    return field(builder, name, TYPE_UTF8, utf8, encoding);
+}
+
+/*
+  Build a RecordBatch table for columns with the given lengths and null
+  counts, whose buffers are laid out one after another in the body.
+
+  @return
+    The table, and the length of the body
+*/
+std::pair<uint32_t, int64_t> recordBatch(FlatBuilder& builder,
+                                         int64_t length,
+                                         const std::vector<LongPair>& nodes,
+                                         const std::vector<OutputBlock>& body) {
+    std::vector<LongPair> buffers;
+    int64_t bodyLength = 0;
+    for (auto& block: body) {
+        buffers.push_back({bodyLength, static_cast<int64_t>(block.size)});
+        bodyLength += padded(block.size);
+    }
+    const uint32_t nodeVector = builder.createPairVector(nodes);
+    const uint32_t bufferVector = builder.createPairVector(buffers);
+
+    builder.startTable();
+    builder.addField<int64_t>(0, length);
+    builder.addOffsetField(1, nodeVector);
+    builder.addOffsetField(2, bufferVector);
+    return {builder.endTable(), bodyLength};
+}
+
+/*
+  Finish the Message flatbuffer that wraps a header.
+*/
+std::string message(FlatBuilder& builder, uint8_t headerType, uint32_t header, int64_t bodyLength) {
+    builder.startTable();
+    builder.addField<int64_t>(3, bodyLength);
+    builder.addOffsetField(2, header);
+    builder.addField<int16_t>(0, METADATA_V5);
+    builder.addField<uint8_t>(1, headerType);
+    return builder.finish(builder.endTable());
+}
+
+/*
+  A validity bitmap for count values with every bit set.
+*/
+std::string allValid(size_t count) {
+    std::string bitmap(count / 8, static_cast<char>(0xFF));
+    if (count % 8 != 0) {
+        bitmap += static_cast<char>((1u << (count % 8)) - 1);
+    }
+    return bitmap;
+}
+
+} // namespace
+
+/*
+  @return
+    The number of rows in the batch
+*/
+size_t ArrowBatch::size() const {
+    return values.size();
+}
+
+/*
+  Remove every row from the batch.
+*/
+void ArrowBatch::clear() {
+    areas.clear();
+    measures.clear();
+    years.clear();
+    values.clear();
+}
+
+/*
+  ArrowStreamWriter::ArrowStreamWriter(sink, areaCodes, measureCodes)
+
+  Start an Arrow IPC stream, writing its schema and the dictionaries of
+  authority and measure codes.
+
+  @param sink
+    The OutputSink to write the stream to
+
+  @param areaCodes
+    The authority codes that ArrowBatch::areas index, in sorted order. It
+    must outlive the writer.
+
+  @param measureCodes
+    The measure codenames that ArrowBatch::measures index, in sorted order.
+    It must outlive the writer.
+
+  @throws
+    std::runtime_error if the processor is not little endian, or the sink
+    fails to write
+
+  @example
+    OutputFile output("areas.arrow");
+    ArrowStreamWriter writer(output, {"W06000011"}, {"pop"});
+
+    ArrowBatch batch;
+    batch.areas.push_back(0);
+    batch.measures.push_back(0);
+    batch.years.push_back(2015);
+    batch.values.push_back(244513);
+    writer.writeBatch(batch);
+
+    writer.finish();
+    output.flush();
+*/
+ArrowStreamWriter::ArrowStreamWriter(OutputSink& sink,
+                                     const std::vector<std::string>& areaCodes,
+                                     const std::vector<std::string>& measureCodes)
+    : sink(sink), areaCodes(areaCodes), measureCodes(measureCodes), finished(false) {
+    const uint16_t probe = 1;
+    if (*reinterpret_cast<const uint8_t*>(&probe) != 1) {
+        throw std::runtime_error("ArrowStreamWriter::ArrowStreamWriter: Arrow output needs a little endian processor");
+    }
+    writeSchema();
+    writeDictionary(AREA_DICTIONARY, areaCodes);
+    writeDictionary(MEASURE_DICTIONARY, measureCodes);
+}
+
+/*
+  ArrowStreamWriter::writeBatch(batch)
+
+  Write a batch of rows as a record batch. Values that are not a number
+  are written as nulls.
+
+  @param batch
+    The rows, whose four columns must be the same length
+
+  @throws
+    std::invalid_argument if the columns are not the same length, or
+    std::runtime_error if the sink fails to write
+*/
+void ArrowStreamWriter::writeBatch(const ArrowBatch& batch) {
+    const size_t rows = batch.size();
+    if (batch.areas.size() != rows || batch.measures.size() != rows || batch.years.size() != rows) {
+        throw std::invalid_argument("ArrowStreamWriter::writeBatch: Columns of different lengths");
+    }
+    if (rows == 0) {
+        return;
+    }
+
+    const std::string valid = allValid(rows);
+    std::string valueValidity = valid;
+    int64_t nullValues = 0;
+    for (size_t i = 0; i < rows; i++) {
+        if (std::isnan(batch.values[i])) {
+            valueValidity[i / 8] &= static_cast<char>(~(1u << (i % 8)));
+            nullValues++;
+        }
+    }
+
+    const std::vector<OutputBlock> body = {
+        {valid.data(), valid.size()},
+        {reinterpret_cast<const char*>(batch.areas.data()), rows * sizeof(int32_t)},
+        {valid.data(), valid.size()},
+        {reinterpret_cast<const char*>(batch.measures.data()), rows * sizeof(int32_t)},
+        {valid.data(), valid.size()},
+        {reinterpret_cast<const char*>(batch.years.data()), rows * sizeof(int16_t)},
+        {valueValidity.data(), valueValidity.size()},
+        {reinterpret_cast<const char*>(batch.values.data()), rows * sizeof(double)}
+    };
+    const int64_t length = static_cast<int64_t>(rows);
+    const std::vector<LongPair> nodes = {{length, 0}, {length, 0}, {length, 0}, {length, nullValues}};
+
+    FlatBuilder builder;
+    auto header = recordBatch(builder, length, nodes, body);
+    writeMessage(message(builder, HEADER_RECORD_BATCH, header.first, header.second), body);
+}
+
+/*
+  ArrowStreamWriter::finish()
+
+  End the stream. Nothing more can be written afterwards.
+
+  @throws
+    std::runtime_error if the sink fails to write
+*/
+void ArrowStreamWriter::finish() {
+    if (!finished) {
+        const uint32_t endOfStream[2] = {0xFFFFFFFF, 0};
+        sink.write(reinterpret_cast<const char*>(endOfStream), sizeof(endOfStream));
+        finished = true;
+    }
+}
+
+/*
+  Write the Schema message.
+*/
+void ArrowStreamWriter::writeSchema() {
+    FlatBuilder builder;
+    std::vector<uint32_t> fields;
+    fields.push_back(dictionaryField(builder, "authority_code", AREA_DICTIONARY));
+    fields.push_back(dictionaryField(builder, "measure_code", MEASURE_DICTIONARY));
+    fields.push_back(field(builder, "year", TYPE_INT, intType(builder, 16)));
+
+    builder.startTable();
+    builder.addField<int16_t>(0, PRECISION_DOUBLE);
+    const uint32_t doubleType = builder.endTable();
+    fields.push_back(field(builder, "value", TYPE_FLOATING_POINT, doubleType));
+
+    const uint32_t fieldVector = builder.createOffsetVector(fields);
+    builder.startTable();
+    builder.addField<int16_t>(0, ENDIANNESS_LITTLE);
+    builder.addOffsetField(1, fieldVector);
+    const uint32_t schema = builder.endTable();
+
+    writeMessage(message(builder, HEADER_SCHEMA, schema, 0), {});
+}
+
+/*
+  Write a DictionaryBatch message holding a column of strings.
+*/
+void ArrowStreamWriter::writeDictionary(int64_t id, const std::vector<std::string>& codes) {
+    std::vector<int32_t> offsets = {0};
+    std::string characters;
+    for (auto& code: codes) {
+        characters += code;
+        if (characters.size() > static_cast<size_t>(std::numeric_limits<int32_t>::max())) {
+            throw std::runtime_error("ArrowStreamWriter::writeDictionary: Dictionary too large");
+        }
+        offsets.push_back(static_cast<int32_t>(characters.size()));
+    }
+
+    const std::string valid = allValid(codes.size());
+    const std::vector<OutputBlock> body = {
+        {valid.data(), valid.size()},
+        {reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(int32_t)},
+        {characters.data(), characters.size()}
+    };
+    const int64_t length = static_cast<int64_t>(codes.size());
+
+    FlatBuilder builder;
+    auto data = recordBatch(builder, length, {{length, 0}}, body);
+    builder.startTable();
+    builder.addField<int64_t>(0, id);
+    builder.addOffsetField(1, data.first);
+    const uint32_t dictionary = builder.endTable();
+
+    writeMessage(message(builder, HEADER_DICTIONARY_BATCH, dictionary, data.second), body);
+}
+
+/*
+  Write a message: its prefix, its metadata padded so that the body starts
+  on a 64 byte boundary, then each buffer of its body, padded.
+*/
+void ArrowStreamWriter::writeMessage(const std::string& metadata, const std::vector<OutputBlock>& body) {
+    static const char zeros[ARROW_ALIGNMENT] = {};
+
+    const size_t metadataSize = padded(8 + metadata.size()) - 8;
+    const uint32_t prefix[2] = {0xFFFFFFFF, static_cast<uint32_t>(metadataSize)};
+    sink.write(reinterpret_cast<const char*>(prefix), sizeof(prefix));
+    sink.write(metadata);
+    sink.write(zeros, metadataSize - metadata.size());
+
+    for (auto& block: body) {
+        sink.write(block.data, block.size);
+        sink.write(zeros, padded(block.size) - block.size);
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef ARROW_H_
+#define ARROW_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  This file contains a writer for the Apache Arrow IPC streaming format,
+  written against the format specification rather than the Arrow library.
+
+  The stream holds the long (tidy) table that --csv writes, with the columns:
+
+    authority_code  dictionary-encoded utf8 (int32 indices)
+    measure_code    dictionary-encoded utf8 (int32 indices)
+    year            int16
+    value           float64 (null if not a number)
+
+  Each column has a validity bitmap. The dictionaries are written once, after
+  the schema, and are followed by any number of record batches. Every buffer
+  starts on a 64 byte boundary, so a reader that maps the file into memory
+  can use the columns where they are.
+
+  The flatbuffers that describe each message (see Schema.fbs and Message.fbs
+  in the Arrow repository) are built by a small builder of our own, which
+  supports just the tables, vectors, structs and strings the messages use.
+ */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "output.h"
+
+/*
+  A batch of rows for ArrowStreamWriter, as indices into its dictionaries,
+  years and values.
+*/
+struct ArrowBatch {
+  std::vector<int32_t> areas;
+  std::vector<int32_t> measures;
+  std::vector<int16_t> years;
+  std::vector<double> values;
+
+  size_t size() const;
+  void clear();
+};
+
+class ArrowStreamWriter {
+public:
+  ArrowStreamWriter(OutputSink& sink,
+                    const std::vector<std::string>& areaCodes,
+                    const std::vector<std::string>& measureCodes);
+
+  void writeBatch(const ArrowBatch& batch);
+  void finish();
+
+private:
+  void writeSchema();
+  void writeDictionary(int64_t id, const std::vector<std::string>& codes);
+  void writeMessage(const std::string& metadata, const std::vector<OutputBlock>& body);
+
+  OutputSink& sink;
+  const std::vector<std::string>& areaCodes;
+  const std::vector<std::string>& measureCodes;
+  bool finished;
+};
+
+#endif // ARROW_H_
@@ -22,19 +22,34 @@
   additional functions not specified.
 */
 
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <tuple>
 #include <unordered_set>
 #include <vector>
 #include <sstream>
+#include <exception>
+#include <future>
+#include <memory>
+#include <set>
 
 #include "lib_cxxopts.hpp"
 
+#include "aggregate.h"
 #include "areas.h"
+#include "catalogue.h"
 #include "datasets.h"
 #include "bethyw.h"
 #include "input.h"
+#include "output.h"
+#include "pivot.h"
+#include "ranking.h"
+#include "rollup.h"
+#include "valueindex.h"
+#include "query.h"
+#include "server.h"
+#include "threadpool.h"
 
 /*
   Run Beth Yw?, parsing the command line arguments, importing the data,
@@ -54,6 +69,9 @@
 */
 
 int BethYw::run(int argc, char *argv[]) {
+  // cxxopts consumes the arguments it parses, so keep a copy to forward
+  const std::vector<std::string> programArgs(argv, argv + argc);
+
   auto cxxopts = BethYw::cxxoptsSetup();
   auto args = cxxopts.parse(argc, argv);
 
@@ -65,35 +83,210 @@ int BethYw::run(int argc, char *argv[]) {
 
 
   try {
+      // Forward the query to a running server rather than importing the data
+      if (args.count("client")) {
+          return BethYw::runClient(args["client"].as<std::string>(), programArgs);
+      }
+
+      // Size the thread pool shared by importing, querying and rendering
+      ThreadPool::configure(args["threads"].as<unsigned int>());
+
+      // Choose how WelshStats JSON files are read
+      Areas::setJsonEngine(BethYw::parseJsonEngineArg(args));
+
       // Parse data directory argument
       std::string dir = args["dir"].as<std::string>() + DIR_SEP;
 
+      // Memory budget for caching results in server and batch modes
+      size_t cacheBytes = args["cache-mb"].as<unsigned int>() * static_cast<size_t>(1024 * 1024);
+
+      // Import the data once and answer queries from clients until stopped
+      if (args.count("serve")) {
+          return BethYw::runServer(dir,
+                                   args["serve"].as<std::string>(),
+                                   args["workers"].as<unsigned int>(),
+                                   args["timeout"].as<unsigned int>(),
+                                   cacheBytes);
+      }
+
+      // Answer a file of queries against a single import of the data
+      if (args.count("batch")) {
+          return BethYw::runBatch(dir,
+                                  args["batch"].as<std::string>(),
+                                  args.count("json") != 0,
+                                  cacheBytes);
+      }
+
       // Parse other arguments and import data
       auto datasetsToImport = BethYw::parseDatasetsArg(args);
       auto areasFilter = BethYw::parseAreasArg(args);
       auto measuresFilter = BethYw::parseMeasuresArg(args);
       auto yearsFilter = BethYw::parseYearsArg(args);
 
+      auto format = BethYw::parseOutputFormatArg(args);
+
       Areas data = Areas();
+      data.setSummaryOnly(args.count("summary-only") != 0);
+      if (data.isSummaryOnly()
+              && (format == OutputFormat::CSV || format == OutputFormat::TSV || format == OutputFormat::ARROW)) {
+          throw std::invalid_argument("--csv, --tsv and --arrow need every year's value, so can't be used with --summary-only");
+      }
+      const bool pivoting = args.count("pivot") != 0;
+      if (pivoting && (data.isSummaryOnly() || format == OutputFormat::NDJSON || format == OutputFormat::ARROW)) {
+          throw std::invalid_argument("--pivot can't be used with --summary-only, --ndjson or --arrow");
+      }
+      const bool ranking = args.count("top") != 0;
+      if (ranking != (args.count("by") != 0)) {
+          throw std::invalid_argument("--top and --by must be used together");
+      }
+      if (ranking && (pivoting || format == OutputFormat::NDJSON || format == OutputFormat::ARROW)) {
+          throw std::invalid_argument("--top can't be used with --pivot, --ndjson or --arrow");
+      }
+      RankKey rankKey;
+      if (ranking) {
+          rankKey = BethYw::parseRankKey(args["by"].as<std::string>());
+          if (data.isSummaryOnly() && (rankKey.statistic == RankKey::Statistic::YEAR || rankKey.isRange())) {
+              throw std::invalid_argument("--summary-only keeps no year's value, so --by can only use avg, diff or pdiff");
+          }
+      }
+      std::vector<ValuePredicate> predicates;
+      if (args.count("where")) {
+          if (data.isSummaryOnly() || format == OutputFormat::NDJSON) {
+              throw std::invalid_argument("--where needs every year's value, so can't be used with --summary-only or --ndjson");
+          }
+          predicates = BethYw::parseWhereArg(args["where"].as<std::string>());
+      }
+      const bool aggregating = args.count("aggregate") != 0;
+      Aggregation aggregation;
+      if (aggregating) {
+          if (data.isSummaryOnly() || format == OutputFormat::NDJSON) {
+              throw std::invalid_argument("--aggregate needs every year's value, so can't be used with --summary-only or --ndjson");
+          }
+          aggregation = BethYw::parseAggregateArg(args["aggregate"].as<std::string>());
+      }
+      const bool rollingUp = args.count("rollup") != 0;
+      if (rollingUp && (aggregating || data.isSummaryOnly() || format == OutputFormat::NDJSON)) {
+          throw std::invalid_argument("--rollup can't be used with --aggregate, --summary-only or --ndjson");
+      }
+      if (format == OutputFormat::ARROW && args.count("output")) {
+          throw std::invalid_argument("--arrow writes to its own file, so can't be used with --output");
+      }
 
 
       BethYw::loadAreas(data, dir, areasFilter);
 
+      std::unique_ptr<OutputSink> output;
+      if (args.count("output")) {
+          output.reset(new OutputFile(args["output"].as<std::string>()));
+      } else if (format == OutputFormat::ARROW) {
+          output.reset(new OutputFile(args["arrow"].as<std::string>()));
+      } else {
+          output.reset(new OutputStdout());
+      }
+
+      if (format == OutputFormat::NDJSON) {
+          // A JSON line per area and measure, written as each area is
+          // completed by the import
+          BethYw::loadDatasets(data,
+                               dir,
+                               datasetsToImport,
+                               areasFilter,
+                               measuresFilter,
+                               yearsFilter,
+                               [&output](const Area& area) {
+                                   output->write(area.toNdjson());
+                                   output->flush();
+                               });
+          return 0;
+      }
+
+      // The values --where compares, the measure --aggregate wmean:
+      // weights by, and the measures --rollup computes ratios from, are
+      // imported even if -m or -y leave them out, and -m and -y are then
+      // only applied to what is output
+      auto importMeasures = measuresFilter;
+      auto importYears = yearsFilter;
+      for (auto& predicate: predicates) {
+          BethYw::widenFilters(importMeasures, importYears, predicate.measure, predicate.year);
+      }
+      if (aggregating && aggregation.function == Aggregation::Function::WMEAN) {
+          BethYw::widenFilters(importMeasures, importYears, aggregation.weight, 0);
+      }
+      if (rollingUp) {
+          BethYw::widenForRollup(importMeasures);
+      }
+
       BethYw::loadDatasets(data,
                            dir,
                            datasetsToImport,
                            areasFilter,
-                           measuresFilter,
-                           yearsFilter);
+                           importMeasures,
+                           importYears);
+      if (!predicates.empty()) {
+          BethYw::applyWhere(data, predicates);
+      }
+      if (rollingUp) {
+          // The parents in the hierarchy in place of the imported areas,
+          // output as usual
+          std::set<std::string> leftOut;
+          data = BethYw::loadHierarchy(dir, args["rollup"].as<std::string>()).rollup(data, &leftOut);
+          for (auto& measure: leftOut) {
+              std::cerr << "Note: --rollup leaves out " << measure
+                        << ", whose values can't be added up across areas" << std::endl;
+          }
+      } else if (aggregating) {
+          // A single area combining all the others, output as usual
+          Areas aggregated = Areas();
+          aggregated.setArea(aggregation.code(), BethYw::aggregate(data, aggregation));
+          data = std::move(aggregated);
+      }
+      if (importMeasures != measuresFilter || importYears != yearsFilter) {
+          Areas narrowed = Areas();
+          data.filterInto(narrowed, nullptr, &measuresFilter, &yearsFilter, true);
+          data = std::move(narrowed);
+      }
 
-      if (args.count("json")) {
-          // The output as JSON
-          std::cout << data.toJSON() << std::endl;
-      } else {
-          // The output as tables
-          std::cout << data << std::endl;
+      if (pivoting) {
+          // A matrix for one year or one area, in place of the usual output
+          output->write(BethYw::pivot(data, args["pivot"].as<std::string>()).render(format));
+          output->flush();
+          return 0;
+      }
+
+      if (ranking) {
+          // The areas with the highest (or lowest) values, in place of the
+          // usual output
+          output->write(BethYw::rank(data,
+                                     rankKey,
+                                     args["top"].as<unsigned int>(),
+                                     args.count("ascending") != 0).render(format));
+          output->flush();
+          return 0;
       }
 
+      switch (format) {
+          case OutputFormat::JSON:
+              data.writeJSON(*output);
+              output->write("\n");
+              break;
+          case OutputFormat::CSV:
+              // A row per value, in long form
+              data.writeDelimited(*output, ',');
+              break;
+          case OutputFormat::TSV:
+              data.writeDelimited(*output, '\t');
+              break;
+          case OutputFormat::ARROW:
+              data.writeArrow(*output);
+              break;
+          default:
+              // The output as tables
+              data.writeTable(*output);
+              output->write("\n");
+              break;
+      }
+      output->flush();
+
   } catch (std::exception const &e) {
       std::cerr << e.what() << std::endl;
   }
@@ -147,6 +340,114 @@ cxxopts::Options BethYw::cxxoptsSetup() {
       "j,json",
       "Print the output as JSON instead of tables.")(
 
+      "csv",
+      "Print the output as CSV in long form, with a row of authority_code, "
+      "measure_code, year and value for each value")(
+
+      "tsv",
+      "Print the output as --csv does, but separated by tabs")(
+
+      "arrow",
+      "Write the rows --csv would print to the given file as an Apache Arrow "
+      "IPC stream",
+      cxxopts::value<std::string>())(
+
+      "pivot",
+      "Print a matrix of authorities by measures for the given year (YYYY), or "
+      "of measures by years for the given authority code, as a table, JSON "
+      "(-j), or CSV/TSV (--csv/--tsv)",
+      cxxopts::value<std::string>())(
+
+      "top",
+      "Print only the given number of areas with the highest values of the "
+      "statistic chosen with --by",
+      cxxopts::value<unsigned int>())(
+
+      "by",
+      "The measure to rank areas by with --top, optionally followed by :YYYY "
+      "for a year's value, :avg (the default), :diff or :pdiff, or by "
+      ":sum, :avg, :min or :max and :YYYY-ZZZZ for a range of years",
+      cxxopts::value<std::string>())(
+
+      "ascending",
+      "Rank the areas with the lowest values first when using --top")(
+
+      "where",
+      "Keep only the areas whose value of a measure in a year passes a "
+      "comparison, e.g. pop@2015>100000 (using <, <=, =, >= or >), or every "
+      "one of a comma-separated list of comparisons (the measure and year "
+      "needn't be output by -m and -y)",
+      cxxopts::value<std::string>())(
+
+      "aggregate",
+      "Combine the values of all the selected areas for each measure and "
+      "year into a single area, by their sum, mean, min, max, or mean weighted "
+      "by another measure (wmean:<measure>, e.g. wmean:area)",
+      cxxopts::value<std::string>())(
+
+      "rollup",
+      "Print the areas that are parents in the given hierarchy file (in the "
+      "datasets directory, with a row of child code, parent code and optional "
+      "parent name for each child), each with the sums of its children's values "
+      "of additive measures (e.g. pop, area) and the ratios of those sums (dens "
+      "is pop / area); other measures are left out, and a parent only some of "
+      "whose areas are selected is marked as a partial sum",
+      cxxopts::value<std::string>())(
+
+      "summary-only",
+      "Print only the average, difference and percentage difference of each "
+      "measure, importing rows into running totals as they are read")(
+
+      "ndjson",
+      "Print a line of JSON for each area and measure, as soon as it has "
+      "been imported (when importing a single dataset, up to its first row "
+      "out of order by area)")(
+
+      "output",
+      "Write the output to a file instead of the standard output",
+      cxxopts::value<std::string>())(
+
+      "batch",
+      "Answer each line of a file as a separate query (using the -d/-a/-m/-y/-j "
+      "arguments), importing the datasets only once",
+      cxxopts::value<std::string>())(
+
+      "serve",
+      "Import all datasets once and answer queries from clients on the given "
+      "Unix domain socket",
+      cxxopts::value<std::string>())(
+
+      "client",
+      "Send the other arguments as a query to the server on the given Unix "
+      "domain socket",
+      cxxopts::value<std::string>())(
+
+      "workers",
+      "Number of threads answering queries when using --serve",
+      cxxopts::value<unsigned int>()->default_value(
+          std::to_string(BethYw::DEFAULT_SERVER_WORKERS)))(
+
+      "timeout",
+      "Time in milliseconds allowed for each request when using --serve",
+      cxxopts::value<unsigned int>()->default_value(
+          std::to_string(BethYw::DEFAULT_REQUEST_TIMEOUT_MS)))(
+
+      "cache-mb",
+      "Memory in megabytes for caching query results when using --serve or "
+      "--batch",
+      cxxopts::value<unsigned int>()->default_value(
+          std::to_string(BethYw::DEFAULT_CACHE_MB)))(
+
+      "threads",
+      "Number of threads to import, query and render with "
+      "(omit or set to 0 to use one per core)",
+      cxxopts::value<unsigned int>()->default_value("0"))(
+
+      "json-engine",
+      "How to read JSON datasets: simd, nlohmann, or verify (read with both "
+      "and fail if they differ)",
+      cxxopts::value<std::string>()->default_value("simd"))(
+
       "h,help",
       "Print usage.");
 
@@ -279,7 +580,7 @@ std::unordered_set<std::string> BethYw::parseAreasArg(
       if (temp.empty() == true) {
           areas.clear();
       } else {
-          bool allEntered;
+          bool allEntered = false;
           for (unsigned int i = 0; i < temp.size(); i++) {
               if (temp[i] == "all") {
                   allEntered = true;
@@ -369,12 +670,12 @@ std::unordered_set<std::string> BethYw::parseMeasuresArg(
     if (temp.empty()) {
         measures.clear();
     } else {
-        bool allEntered;
+        bool allEntered = false;
         for (unsigned int i = 0; i < temp.size(); i++) {
             std::string measure = temp[i];
             for(unsigned int i = 0; i < measure.length(); i++) {
                 if (measure.find_first_not_of("abcdefghijklmnopqrstuvwxys") != std::string::npos) {
-                    throw new std::invalid_argument("Invalid input for measures argument");
+                    throw std::invalid_argument("Invalid input for measures argument");
                 }
             }
             if (temp[i] == "all") {
@@ -485,6 +786,120 @@ bool BethYw::yearIsNumber(std::string& year)
     return true;
 }
 
+/*
+  BethYw::parseJsonEngineArg(args)
+
+  Parse the --json-engine argument, which chooses how WelshStats JSON files
+  are read (see Areas::setJsonEngine).
+
+  @param args
+    Parsed program arguments
+
+  @return
+    The JsonEngine to read with
+
+  @throws
+    std::invalid_argument if the argument is not simd, nlohmann or verify,
+    with the message: Invalid input for json-engine argument
+*/
+JsonEngine BethYw::parseJsonEngineArg(cxxopts::ParseResult& args) {
+    const std::string engine = Areas::toLower(args["json-engine"].as<std::string>());
+    if (engine == "simd") {
+        return JsonEngine::SIMD;
+    } else if (engine == "nlohmann") {
+        return JsonEngine::NLOHMANN;
+    } else if (engine == "verify") {
+        return JsonEngine::VERIFY;
+    }
+    throw std::invalid_argument("Invalid input for json-engine argument");
+}
+
+/*
+  BethYw::parseOutputFormatArg(args)
+
+  Parse the arguments choosing the output format: -j/--json, --ndjson,
+  --csv, --tsv or --arrow, or none of them for tables.
+
+  @param args
+    Parsed program arguments
+
+  @return
+    The OutputFormat to write
+
+  @throws
+    std::invalid_argument if more than one format is given, with the
+    message: Only one of --json, --ndjson, --csv, --tsv and --arrow can be
+    used
+*/
+BethYw::OutputFormat BethYw::parseOutputFormatArg(cxxopts::ParseResult& args) {
+    OutputFormat format = OutputFormat::TABLE;
+    unsigned int formats = 0;
+    const std::pair<const char*, OutputFormat> options[] = {
+        {"json", OutputFormat::JSON},
+        {"ndjson", OutputFormat::NDJSON},
+        {"csv", OutputFormat::CSV},
+        {"tsv", OutputFormat::TSV},
+        {"arrow", OutputFormat::ARROW}
+    };
+    for (auto& option: options) {
+        if (args.count(option.first)) {
+            format = option.second;
+            formats++;
+        }
+    }
+    if (formats > 1) {
+        throw std::invalid_argument("Only one of --json, --ndjson, --csv, --tsv and --arrow can be used");
+    }
+    return format;
+}
+
+/*
+  BethYw::widenFilters(measuresFilter, yearsFilter, measure, year)
+
+  Widen the filters given to loadDatasets() so that a value they would
+  leave out is imported too, e.g. one compared by --where. The measure is
+  added to the measures filter (unless it is empty, i.e. all measures), and
+  the years filter is stretched to cover the year (unless it covers all
+  years). Any other data this brings in must be filtered out before output,
+  e.g. with Areas::filterInto().
+
+  @param measuresFilter
+    The measures filter to widen
+
+  @param yearsFilter
+    The years filter to widen
+
+  @param measure
+    The codename of the measure
+
+  @param year
+    The year, or 0 to leave the years filter as it is
+
+  @return
+    void
+
+  @example
+    auto importMeasures = BethYw::parseMeasuresArg(args);
+    auto importYears = BethYw::parseYearsArg(args);
+    BethYw::widenFilters(importMeasures, importYears, "pop", 2015);
+*/
+void BethYw::widenFilters(StringFilterSet& measuresFilter,
+                          YearFilterTuple& yearsFilter,
+                          const std::string& measure,
+                          int year) {
+    if (!measuresFilter.empty()) {
+        measuresFilter.insert(Areas::toLower(measure));
+    }
+
+    unsigned int &firstYear = std::get<0>(yearsFilter);
+    unsigned int &lastYear = std::get<1>(yearsFilter);
+    if (year <= 0 || firstYear == 0 || lastYear == 0) {
+        return;
+    }
+    firstYear = std::min(firstYear, static_cast<unsigned int>(year));
+    lastYear = std::max(lastYear, static_cast<unsigned int>(year));
+}
+
 /*
   TODO: BethYw::loadAreas(areas, dir, areasFilter)
 
@@ -569,6 +984,11 @@ void BethYw::loadAreas(Areas &areas,std::string dir,std::unordered_set<std::stri
     An two-pair tuple of unsigned ints corresponding to the range of years 
     to import, which should both be 0 to import all years.
 
+  @param stream
+    If set, each Area is given to this function once it is complete (see
+    Areas::streamTo). A single dataset is then streamed rather than merged
+    into areas.
+
   @return
     void
 
@@ -588,17 +1008,97 @@ void BethYw::loadDatasets(Areas &areas,
                           std::vector<BethYw::InputFileSource> datasetsToImport,
                           std::unordered_set<std::string> areasFilter,
                           std::unordered_set<std::string> measuresFilter,
-                          std::tuple<unsigned int, unsigned int> yearsFilter
+                          std::tuple<unsigned int, unsigned int> yearsFilter,
+    const AreaStreamHandler& stream
 ) {
-        for (auto it = datasetsToImport.begin(); it != datasetsToImport.end(); it++) {
-            InputFile tempFile(dir + it->FILE);
-            SourceColumnMapping tempColumns = it->COLS;
-            SourceDataType tempType = it->PARSER;
-            std::istream &loaded = tempFile.open();
-            areas.populate(loaded, tempType, tempColumns, &areasFilter, &measuresFilter, &yearsFilter);
-//            std::cout << areas << std::endl;
+    // With a filter, skip datasets the catalogue knows have none of the
+    // requested measures or areas, without opening them
+    if (!areasFilter.empty() || !measuresFilter.empty()) {
+        BethYw::MeasureCatalogue catalogue(dir);
+        catalogue.refresh(datasetsToImport);
+
+        std::vector<BethYw::InputFileSource> needed;
+        for (auto& source: datasetsToImport) {
+            if (catalogue.mayContain(source, areasFilter, measuresFilter)) {
+                needed.push_back(source);
+            }
         }
-}
+        datasetsToImport.swap(needed);
+    }
 
+    // A single dataset can be streamed: it is imported on this thread, and
+    // each area handed over as soon as it is complete, with the names
+    // loaded from areas.csv (the dataset's own names take precedence, as
+    // when merging)
+    if (stream && datasetsToImport.size() == 1) {
+        const BethYw::InputFileSource &source = datasetsToImport.front();
+        InputFile file(dir + source.FILE);
+        Areas imported = Areas();
+        imported.streamTo([&areas, &stream](const Area& area) {
+            Area named(area.getLocalAuthorityCode());
+            try {
+                named = areas.getArea(area.getLocalAuthorityCode());
+            } catch (const std::out_of_range &exception) {
+                // Not in areas.csv, so the dataset's names are all there are
+            }
+            named.merge(Area(area));
+            stream(named);
+        });
+        imported.populate(file.open(), source.PARSER, source.COLS, &areasFilter, &measuresFilter, &yearsFilter);
+        return;
+    }
 
+    // Summaries are imported straight into areas, one dataset after another,
+    // so every value goes into the running totals in order rather than
+    // totals being merged
+    if (areas.isSummaryOnly()) {
+        for (auto& source: datasetsToImport) {
+            InputFile file(dir + source.FILE);
+            areas.populate(file.open(), source.PARSER, source.COLS, &areasFilter, &measuresFilter, &yearsFilter);
+        }
+        // Nothing is left for the parallel import below
+        datasetsToImport.clear();
+    }
+
+    // Each dataset is imported into its own Areas by a task on the shared
+    // pool, so small datasets finish (and free their thread) while large
+    // ones are still being parsed
+    ThreadPool &pool = ThreadPool::shared();
+    std::vector<std::future<Areas>> imports;
+    for (auto& source: datasetsToImport) {
+        imports.push_back(pool.submit([&dir, source, &areasFilter, &measuresFilter, &yearsFilter]() {
+            InputFile tempFile(dir + source.FILE);
+            std::istream &loaded = tempFile.open();
+            Areas imported = Areas();
+            imported.populate(loaded, source.PARSER, source.COLS, &areasFilter, &measuresFilter, &yearsFilter);
+            return imported;
+        }));
+    }
 
+    // Combine them in the order they were given, so later datasets take
+    // precedence. Every import must finish before returning, even after an
+    // error, as they refer to the filters.
+    std::exception_ptr error;
+    for (auto& import: imports) {
+        try {
+            Areas imported = pool.await(import);
+            if (!error) {
+                areas.merge(std::move(imported));
+            }
+        } catch (...) {
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    // Otherwise areas are only complete once every dataset has been merged
+    if (stream) {
+        for (auto& codeAreaPair: areas) {
+            stream(codeAreaPair.second);
+        }
+    }
+}
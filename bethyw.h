@@ -39,6 +39,11 @@ namespace BethYw {
 */
 const std::string STUDENT_NUMBER = "963906";
 
+/*
+  The ways the imported data can be output.
+*/
+enum class OutputFormat { TABLE, JSON, NDJSON, CSV, TSV, ARROW };
+
 /*
   Run Beth Yw?, parsing the command line arguments and acting upon them.
 */
@@ -76,6 +81,25 @@ std::tuple<unsigned int, unsigned int> parseYearsArg(cxxopts::ParseResult& args)
 
 bool yearIsNumber(std::string& year);
 
+/*
+  Parse the JSON engine argument (nlohmann, simd or verify).
+*/
+JsonEngine parseJsonEngineArg(cxxopts::ParseResult& args);
+
+/*
+  Parse the output format arguments (-j, --ndjson, --csv, --tsv and --arrow).
+*/
+OutputFormat parseOutputFormatArg(cxxopts::ParseResult& args);
+
+/*
+  Widen the measures and years filters so that a measure's value for a year
+  is imported.
+*/
+void widenFilters(StringFilterSet& measuresFilter,
+                  YearFilterTuple& yearsFilter,
+                  const std::string& measure,
+                  int year);
+
 void loadAreas(Areas &areas,std::string dir,std::unordered_set<std::string> areasFilter);
 
 void loadDatasets(
@@ -84,7 +108,8 @@ void loadDatasets(
         std::vector<BethYw::InputFileSource> datasetsToImport,
         std::unordered_set<std::string> areasFilter,
         std::unordered_set<std::string> measuresFilter,
-        std::tuple<unsigned int, unsigned int> yearsFilter
+        std::tuple<unsigned int, unsigned int> yearsFilter,
+        const AreaStreamHandler& stream = nullptr
         );
 
 } // namespace BethYw
@@ -2,7 +2,7 @@
 
 SET bin_dir=bin
 SET tests_dir=tests
-SET source_files=bethyw.cpp input.cpp areas.cpp area.cpp measure.cpp
+SET source_files=bethyw.cpp input.cpp areas.cpp area.cpp measure.cpp query.cpp server.cpp cache.cpp threadpool.cpp pipeline.cpp catalogue.cpp csvscanner.cpp jsonindex.cpp output.cpp arrow.cpp pivot.cpp ranking.cpp valueindex.cpp aggregate.cpp rollup.cpp
 SET main_file=main.cpp
 SET executable=%bin_dir%\bethyw.exe
 
@@ -25,6 +25,6 @@ IF %testStr%==test (
 :compile
 IF NOT EXIST %bin_dir% MKDIR %bin_dir%
 IF EXIST %executable% DEL %executable%
-g++ --std=c++14 -Wall %source_files% %main_file% -o %executable%
+g++ --std=c++14 -Wall -pthread %source_files% %main_file% -o %executable%
 
 :end
@@ -0,0 +1,274 @@
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  This file contains the implementation of the QueryCache class and of the
+  canonical query keys it is indexed by.
+*/
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "area.h"
+#include "areas.h"
+#include "cache.h"
+#include "query.h"
+
+/*
+  BethYw::canonicalQueryKey(query)
+
+  Build the cache key for a query. Area and measure filters are sorted (and
+  measure codes lowercased, as they are when filtering), and a year range
+  that imports all years is always written as 0-0. The order of the datasets
+  is kept as it decides which dataset takes precedence.
+
+  @param query
+    The Query to build a key for
+
+  @return
+    The canonical key
+
+  @example
+    auto key1 = BethYw::canonicalQueryKey(BethYw::parseQueryLine("-a W06000011,W06000010 -m Pop"));
+    auto key2 = BethYw::canonicalQueryKey(BethYw::parseQueryLine("-a W06000010,W06000011 -m pop"));
+    // key1 == key2
+*/
+std::string BethYw::canonicalQueryKey(const Query& query) {
+    std::vector<std::string> areas(query.areasFilter.begin(), query.areasFilter.end());
+    std::sort(areas.begin(), areas.end());
+
+    std::vector<std::string> measures;
+    for (auto& measure: query.measuresFilter) {
+        measures.push_back(Area::toLower(measure));
+    }
+    std::sort(measures.begin(), measures.end());
+    measures.erase(std::unique(measures.begin(), measures.end()), measures.end());
+
+    unsigned int firstYear = std::get<0>(query.yearsFilter);
+    unsigned int lastYear = std::get<1>(query.yearsFilter);
+    if (firstYear == 0 || lastYear == 0) {
+        firstYear = lastYear = 0;
+    }
+
+    std::string key = "d=";
+    for (auto& dataset: query.datasets) {
+        key += dataset + ",";
+    }
+    key += "|a=";
+    for (auto& area: areas) {
+        key += area + ",";
+    }
+    key += "|m=";
+    for (auto& measure: measures) {
+        key += measure + ",";
+    }
+    key += "|y=" + std::to_string(firstYear) + "-" + std::to_string(lastYear);
+    if (!query.pivot.empty()) {
+        key += "|p=" + Areas::toUpper(query.pivot);
+    }
+    if (!query.by.empty()) {
+        key += "|top=" + std::to_string(query.top) + (query.ascending ? ",asc," : ",desc,")
+               + Areas::toLower(query.by);
+    }
+    if (!query.where.empty()) {
+        key += "|w=" + Areas::toLower(query.where);
+    }
+    if (!query.aggregate.empty()) {
+        key += "|g=" + Areas::toLower(query.aggregate);
+    }
+    if (!query.rollup.empty()) {
+        key += "|r=" + query.rollup;
+    }
+    switch (query.format) {
+        case OutputFormat::JSON:
+            key += "|f=json";
+            break;
+        case OutputFormat::CSV:
+            key += "|f=csv";
+            break;
+        case OutputFormat::TSV:
+            key += "|f=tsv";
+            break;
+        default:
+            key += "|f=table";
+            break;
+    }
+    return key;
+}
+
+/*
+  QueryCache::QueryCache(budgetBytes)
+
+  Construct an empty cache.
+
+  @param budgetBytes
+    The most memory, in bytes, the cached results (and their keys) may use
+
+  @example
+    BethYw::QueryCache cache(64 * 1024 * 1024);
+*/
+BethYw::QueryCache::QueryCache(size_t budgetBytes)
+    : budget(budgetBytes), used(0), currentGeneration(0), hitCount(0), missCount(0) {}
+
+/*
+  QueryCache::get(key, generation, rendered)
+
+  Look up a rendered result, marking it as the most recently used.
+
+  @param key
+    The canonical key of the query
+
+  @param generation
+    The generation of the data the result must have been rendered from
+
+  @param rendered
+    Set to the rendered result if there is one
+
+  @return
+    true if the result was cached
+*/
+bool BethYw::QueryCache::get(const std::string& key,
+                             unsigned long generation,
+                             std::string& rendered) {
+    std::lock_guard<std::mutex> lock(mutex);
+    changeGeneration(generation);
+
+    auto it = index.find(key);
+    if (it == index.end()) {
+        missCount++;
+        return false;
+    }
+    lru.splice(lru.begin(), lru, it->second);
+    rendered = it->second->rendered;
+    hitCount++;
+    return true;
+}
+
+/*
+  QueryCache::put(key, generation, rendered)
+
+  Store a rendered result, evicting the least recently used results until it
+  fits within the budget. Results larger than the whole budget are not
+  stored.
+
+  @param key
+    The canonical key of the query
+
+  @param generation
+    The generation of the data the result was rendered from
+
+  @param rendered
+    The rendered result
+
+  @return
+    void
+*/
+void BethYw::QueryCache::put(const std::string& key,
+                             unsigned long generation,
+                             const std::string& rendered) {
+    std::lock_guard<std::mutex> lock(mutex);
+    changeGeneration(generation);
+
+    auto it = index.find(key);
+    if (it != index.end()) {
+        used -= entrySize(key, it->second->rendered);
+        lru.erase(it->second);
+        index.erase(it);
+    }
+
+    const size_t size = entrySize(key, rendered);
+    if (size > budget) {
+        return;
+    }
+    evict(size);
+    lru.push_front(Entry{key, rendered});
+    index.insert({key, lru.begin()});
+    used += size;
+}
+
+/*
+  Remove every result from the cache. The hit and miss counts are kept.
+*/
+void BethYw::QueryCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    lru.clear();
+    index.clear();
+    used = 0;
+}
+
+/*
+  @return
+    The number of lookups that found a cached result
+*/
+unsigned long BethYw::QueryCache::hits() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return hitCount;
+}
+
+/*
+  @return
+    The number of lookups that did not find a cached result
+*/
+unsigned long BethYw::QueryCache::misses() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return missCount;
+}
+
+/*
+  @return
+    The number of results in the cache
+*/
+size_t BethYw::QueryCache::entries() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return lru.size();
+}
+
+/*
+  @return
+    The memory used by the results in the cache, in bytes
+*/
+size_t BethYw::QueryCache::bytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return used;
+}
+
+/*
+  Empty the cache if its results were rendered from a different generation
+  of the data. The mutex must be held.
+*/
+void BethYw::QueryCache::changeGeneration(unsigned long generation) {
+    if (generation != currentGeneration) {
+        lru.clear();
+        index.clear();
+        used = 0;
+        currentGeneration = generation;
+    }
+}
+
+/*
+  Evict the least recently used results until another `needed` bytes fit in
+  the budget. The mutex must be held.
+*/
+void BethYw::QueryCache::evict(size_t needed) {
+    while (!lru.empty() && used + needed > budget) {
+        const Entry &oldest = lru.back();
+        used -= entrySize(oldest.key, oldest.rendered);
+        index.erase(oldest.key);
+        lru.pop_back();
+    }
+}
+
+/*
+  The memory charged for an entry: the result, the key (stored in both the
+  list and the index), and a rough allowance for the nodes themselves.
+*/
+size_t BethYw::QueryCache::entrySize(const std::string& key, const std::string& rendered) {
+    return rendered.size() + 2 * key.size() + 128;
+}
@@ -0,0 +1,81 @@
+#ifndef CACHE_H_
+#define CACHE_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  This file contains the declaration of the QueryCache class, which stores
+  rendered query results (tables or JSON) so that repeated queries against
+  resident data (i.e. in batch or server mode) are not filtered and rendered
+  again every time.
+ */
+
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace BethYw {
+
+struct Query;
+
+/*
+  Default memory budget for cached results, in megabytes.
+*/
+constexpr size_t DEFAULT_CACHE_MB = 64;
+
+/*
+  Build a key that is identical for queries that must give identical output,
+  regardless of the order of the areas/measures or the case of the measures.
+*/
+std::string canonicalQueryKey(const Query& query);
+
+/*
+  A thread-safe least-recently-used cache of rendered results, limited by the
+  total size of the results. Every entry belongs to a generation of the data
+  it was rendered from, and the whole cache is emptied when it is used with a
+  different generation (i.e. the data has changed).
+*/
+class QueryCache {
+public:
+  QueryCache(size_t budgetBytes);
+
+  bool get(const std::string& key, unsigned long generation, std::string& rendered);
+  void put(const std::string& key, unsigned long generation, const std::string& rendered);
+  void clear();
+
+  unsigned long hits() const;
+  unsigned long misses() const;
+  size_t entries() const;
+  size_t bytes() const;
+
+private:
+  struct Entry {
+    std::string key;
+    std::string rendered;
+  };
+
+  void changeGeneration(unsigned long generation);
+  void evict(size_t needed);
+  static size_t entrySize(const std::string& key, const std::string& rendered);
+
+  mutable std::mutex mutex;
+  size_t budget;
+  size_t used;
+  unsigned long currentGeneration;
+  unsigned long hitCount;
+  unsigned long missCount;
+
+  // Most recently used at the front
+  std::list<Entry> lru;
+  std::unordered_map<std::string, std::list<Entry>::iterator> index;
+};
+
+} // namespace BethYw
+
+#endif // CACHE_H_
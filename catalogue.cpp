@@ -0,0 +1,335 @@
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  This file contains the implementation of the MeasureCatalogue class. See
+  catalogue.h for an overview.
+*/
+
+#include <sys/stat.h>
+
+#include <cstdio>
+#include <fstream>
+#include <future>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "area.h"
+#include "catalogue.h"
+#include "input.h"
+#include "threadpool.h"
+
+namespace {
+
+/*
+  The name of the catalogue file in the datasets directory, and the first
+  line it must start with (changed whenever the format changes).
+*/
+const std::string CATALOGUE_FILE = ".bethyw-catalogue";
+const std::string CATALOGUE_HEADER = "bethyw-catalogue 1";
+
+/*
+  Find the size and modification time of a file.
+
+  @return
+    false if the file cannot be found
+*/
+bool fileStat(const std::string& path, long long& size, std::time_t& modified) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        return false;
+    }
+    size = info.st_size;
+    modified = info.st_mtime;
+    return true;
+}
+
+std::string joinCodes(const std::set<std::string>& codes) {
+    std::string joined;
+    for (auto& code: codes) {
+        if (!joined.empty()) {
+            joined += ",";
+        }
+        joined += code;
+    }
+    return joined;
+}
+
+std::set<std::string> splitCodes(const std::string& joined) {
+    std::set<std::string> codes;
+    std::istringstream codeStream(joined);
+    std::string code;
+    while (std::getline(codeStream, code, ',')) {
+        if (!code.empty()) {
+            codes.insert(code);
+        }
+    }
+    return codes;
+}
+
+} // namespace
+
+/*
+  MeasureCatalogue::MeasureCatalogue(dir)
+
+  Construct the catalogue for the datasets in a directory, loading whatever
+  has been saved there before. A missing or unreadable catalogue file is
+  treated as empty.
+
+  @param dir
+    The directory where the datasets are, ending with a directory separator
+
+  @example
+    BethYw::MeasureCatalogue catalogue("datasets/");
+*/
+BethYw::MeasureCatalogue::MeasureCatalogue(const std::string& dir) : dir(dir) {
+    load();
+}
+
+/*
+  MeasureCatalogue::refresh(datasets)
+
+  Catalogue every dataset in datasets whose file has changed (or has never
+  been catalogued), importing them in parallel on the shared ThreadPool, and
+  save the catalogue if anything changed. Datasets that fail to import are
+  left out, so that the error is reported when they are imported for real.
+
+  If the catalogue can't be saved (e.g. the directory is read only), nothing
+  is catalogued: the scans would be thrown away and repeated on every run,
+  costing more than importing the changed datasets without pruning them.
+
+  @param datasets
+    The datasets that are about to be imported
+
+  @return
+    void
+
+  @example
+    BethYw::MeasureCatalogue catalogue("datasets/");
+    catalogue.refresh(BethYw::parseDatasetsArg(args));
+*/
+void BethYw::MeasureCatalogue::refresh(const std::vector<InputFileSource>& datasets) {
+    std::vector<InputFileSource> stale;
+    for (auto& dataset: datasets) {
+        if (!isFresh(dataset)) {
+            stale.push_back(dataset);
+        }
+    }
+    if (stale.empty() || !writable()) {
+        return;
+    }
+
+    ThreadPool &pool = ThreadPool::shared();
+    std::vector<std::string> codes;
+    std::vector<std::future<Entry>> scans;
+    for (auto& dataset: stale) {
+        codes.push_back(dataset.CODE);
+        scans.push_back(pool.submit([this, dataset]() { return scan(dataset); }));
+    }
+
+    bool changed = false;
+    for (unsigned int i = 0; i < scans.size(); i++) {
+        try {
+            entries[codes[i]] = pool.await(scans[i]);
+            changed = true;
+        } catch (std::exception const &e) {
+            entries.erase(codes[i]);
+        }
+    }
+    if (changed) {
+        save();
+    }
+}
+
+/*
+  MeasureCatalogue::mayContain(dataset, areasFilter, measuresFilter)
+
+  Check whether importing a dataset with the given filters could add any
+  data. A dataset that isn't catalogued (or has changed since) always may.
+
+  @param dataset
+    The dataset to check
+
+  @param areasFilter
+    The local authority codes to import, or an empty set for all areas
+
+  @param measuresFilter
+    The measure codes to import, or an empty set for all measures
+
+  @return
+    false only if the dataset certainly contains none of the areas or none
+    of the measures in the filters
+
+  @example
+    if (catalogue.mayContain(dataset, areasFilter, measuresFilter)) {
+      ... import the dataset ...
+    }
+*/
+bool BethYw::MeasureCatalogue::mayContain(const InputFileSource& dataset,
+                                          const StringFilterSet& areasFilter,
+                                          const StringFilterSet& measuresFilter) const {
+    auto it = entries.find(dataset.CODE);
+    if (it == entries.end() || !isFresh(dataset)) {
+        return true;
+    }
+    const Entry &entry = it->second;
+
+    if (!measuresFilter.empty()) {
+        bool found = false;
+        for (auto& measure: measuresFilter) {
+            if (entry.measures.find(Area::toLower(measure)) != entry.measures.end()) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+    }
+
+    if (!areasFilter.empty()) {
+        bool found = false;
+        for (auto& area: areasFilter) {
+            if (entry.areas.find(area) != entry.areas.end()) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+  MeasureCatalogue::save()
+
+  Write the catalogue to the datasets directory. It is written to a
+  temporary file first and renamed, so a reader never sees half a file.
+
+  @return
+    false if the catalogue could not be written (e.g. the directory is read
+    only), in which case it will simply be rebuilt next time
+*/
+bool BethYw::MeasureCatalogue::save() const {
+    const std::string path = dir + CATALOGUE_FILE;
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::trunc);
+        if (!out.is_open()) {
+            return false;
+        }
+        out << CATALOGUE_HEADER << "\n";
+        for (auto& codeEntryPair: entries) {
+            const Entry &entry = codeEntryPair.second;
+            out << codeEntryPair.first << "\t"
+                << entry.size << "\t"
+                << static_cast<long long>(entry.modified) << "\t"
+                << joinCodes(entry.measures) << "\t"
+                << joinCodes(entry.areas) << "\n";
+        }
+        if (!out.good()) {
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+    return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+/*
+  Check whether the catalogue can be saved, by creating (and removing) the
+  temporary file save() writes to.
+*/
+bool BethYw::MeasureCatalogue::writable() const {
+    const std::string temporary = dir + CATALOGUE_FILE + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::app);
+        if (!out.is_open()) {
+            return false;
+        }
+    }
+    std::remove(temporary.c_str());
+    return true;
+}
+
+/*
+  Check whether a dataset's entry matches the size and modification time of
+  its file.
+*/
+bool BethYw::MeasureCatalogue::isFresh(const InputFileSource& dataset) const {
+    auto it = entries.find(dataset.CODE);
+    long long size = 0;
+    std::time_t modified = 0;
+    return it != entries.end()
+           && fileStat(dir + dataset.FILE, size, modified)
+           && size == it->second.size
+           && modified == it->second.modified;
+}
+
+/*
+  Build the entry for a dataset by importing it without filters.
+
+  @throws
+    Any exception thrown while importing the dataset
+*/
+BethYw::MeasureCatalogue::Entry BethYw::MeasureCatalogue::scan(const InputFileSource& dataset) const {
+    Entry entry;
+    if (!fileStat(dir + dataset.FILE, entry.size, entry.modified)) {
+        throw std::runtime_error("MeasureCatalogue::scan: Failed to find " + dir + dataset.FILE);
+    }
+
+    InputFile file(dir + dataset.FILE);
+    Areas imported = Areas();
+    imported.populate(file.open(), dataset.PARSER, dataset.COLS, nullptr, nullptr, nullptr);
+    for (auto& keyValPair: imported) {
+        entry.areas.insert(keyValPair.first);
+        for (auto& measure: keyValPair.second.getMeasuresVector()) {
+            entry.measures.insert(measure.getCodename());
+        }
+    }
+    return entry;
+}
+
+/*
+  Load the catalogue saved in the datasets directory, skipping any line that
+  cannot be read.
+*/
+void BethYw::MeasureCatalogue::load() {
+    std::ifstream in(dir + CATALOGUE_FILE);
+    std::string line;
+    if (!std::getline(in, line) || line != CATALOGUE_HEADER) {
+        return;
+    }
+
+    while (std::getline(in, line)) {
+        std::istringstream lineStream(line);
+        std::vector<std::string> fields;
+        std::string field;
+        while (std::getline(lineStream, field, '\t')) {
+            fields.push_back(field);
+        }
+        while (fields.size() < 5) {
+            fields.push_back("");
+        }
+
+        try {
+            Entry entry;
+            entry.size = std::stoll(fields[1]);
+            entry.modified = static_cast<std::time_t>(std::stoll(fields[2]));
+            entry.measures = splitCodes(fields[3]);
+            entry.areas = splitCodes(fields[4]);
+            entries[fields[0]] = std::move(entry);
+        } catch (std::exception const &e) {
+            continue;
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef CATALOGUE_H_
+#define CATALOGUE_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  This file contains the MeasureCatalogue class, which records the measure
+  codes and local authority codes found in each dataset so that datasets
+  which cannot contribute to a filtered query are never opened.
+
+  The catalogue is saved in the datasets directory (as .bethyw-catalogue)
+  along with the size and modification time of each dataset file. An entry
+  is rebuilt, by importing its dataset once without filters, whenever the
+  file has changed or has not been catalogued before. If the catalogue can't
+  be saved, changed datasets are simply imported without being pruned.
+ */
+
+#include <ctime>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "areas.h"
+#include "datasets.h"
+
+namespace BethYw {
+
+class MeasureCatalogue {
+public:
+  explicit MeasureCatalogue(const std::string& dir);
+
+  void refresh(const std::vector<InputFileSource>& datasets);
+  bool mayContain(const InputFileSource& dataset,
+                  const StringFilterSet& areasFilter,
+                  const StringFilterSet& measuresFilter) const;
+  bool save() const;
+
+private:
+  struct Entry {
+    long long size;
+    std::time_t modified;
+    std::set<std::string> measures;
+    std::set<std::string> areas;
+  };
+
+  bool writable() const;
+  bool isFresh(const InputFileSource& dataset) const;
+  Entry scan(const InputFileSource& dataset) const;
+  void load();
+
+  std::string dir;
+  std::map<std::string, Entry> entries;
+};
+
+} // namespace BethYw
+
+#endif // CATALOGUE_H_
@@ -0,0 +1,424 @@
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  This file contains the implementation of the CsvScanner class and the
+  vectorised byte search it is built on. See csvscanner.h for an overview.
+*/
+
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "csvscanner.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BETHYW_CSV_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// The AVX2 path is compiled with a target attribute, so the rest of the
+// program doesn't need to be built for AVX2
+#if defined(BETHYW_CSV_SSE2) && (defined(__GNUC__) || defined(__clang__))
+#define BETHYW_CSV_AVX2 1
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace {
+
+/*
+  A function that finds the first byte in data[from, end) equal to a or b,
+  returning end if there isn't one.
+*/
+using FindFunction = size_t (*)(const char *data, size_t from, size_t end, char a, char b);
+
+size_t findScalar(const char *data, size_t from, size_t end, char a, char b) {
+    for (size_t i = from; i < end; i++) {
+        if (data[i] == a || data[i] == b) {
+            return i;
+        }
+    }
+    return end;
+}
+
+#if defined(BETHYW_CSV_SSE2)
+/*
+  The index of the lowest set bit of a non-zero mask.
+*/
+inline unsigned int lowestBit(unsigned int mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+size_t findSSE2(const char *data, size_t from, size_t end, char a, char b) {
+    const __m128i matchA = _mm_set1_epi8(a);
+    const __m128i matchB = _mm_set1_epi8(b);
+    size_t i = from;
+    for (; i + 16 <= end; i += 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        const __m128i matches = _mm_or_si128(_mm_cmpeq_epi8(block, matchA),
+                                             _mm_cmpeq_epi8(block, matchB));
+        const unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(matches));
+        if (mask != 0) {
+            return i + lowestBit(mask);
+        }
+    }
+    return findScalar(data, i, end, a, b);
+}
+#endif
+
+#if defined(BETHYW_CSV_AVX2)
+__attribute__((target("avx2")))
+size_t findAVX2(const char *data, size_t from, size_t end, char a, char b) {
+    const __m256i matchA = _mm256_set1_epi8(a);
+    const __m256i matchB = _mm256_set1_epi8(b);
+    size_t i = from;
+    for (; i + 32 <= end; i += 32) {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        const __m256i matches = _mm256_or_si256(_mm256_cmpeq_epi8(block, matchA),
+                                                _mm256_cmpeq_epi8(block, matchB));
+        const unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(matches));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return findSSE2(data, i, end, a, b);
+}
+#endif
+
+/*
+  Pick the widest search the processor supports.
+*/
+FindFunction chooseFind() {
+#if defined(BETHYW_CSV_AVX2)
+    if (__builtin_cpu_supports("avx2")) {
+        return findAVX2;
+    }
+#endif
+#if defined(BETHYW_CSV_SSE2)
+    return findSSE2;
+#else
+    return findScalar;
+#endif
+}
+
+const FindFunction findEither = chooseFind();
+
+} // namespace
+
+/*
+  @return
+    true if the field has no characters
+*/
+bool CsvField::empty() const {
+    return size == 0;
+}
+
+/*
+  Copy the field out of the scanned data, turning doubled quotes back into
+  single ones.
+
+  @return
+    The field's value
+*/
+std::string CsvField::str() const {
+    if (!escaped) {
+        return std::string(data, size);
+    }
+    std::string value;
+    value.reserve(size);
+    for (size_t i = 0; i < size; i++) {
+        value += data[i];
+        if (data[i] == '"' && i + 1 < size && data[i + 1] == '"') {
+            i++;
+        }
+    }
+    return value;
+}
+
+/*
+  Convert the field to a number.
+
+  @return
+    The field's value as a double
+
+  @throws
+    std::runtime_error if the field does not start with a number
+*/
+double CsvField::toDouble() const {
+    // strtod needs a terminated string, and the span is followed by the
+    // rest of the data, so short fields are copied to the stack first
+    char buffer[64];
+    std::string longField;
+    const char *terminated = buffer;
+    if (size < sizeof(buffer)) {
+        std::memcpy(buffer, data, size);
+        buffer[size] = '\0';
+    } else {
+        longField = str();
+        terminated = longField.c_str();
+    }
+
+    char *parsedTo = nullptr;
+    const double value = std::strtod(terminated, &parsedTo);
+    if (parsedTo == terminated) {
+        throw std::runtime_error("CsvField::toDouble: Invalid value " + str());
+    }
+    return value;
+}
+
+/*
+  CsvScanner::CsvScanner(data, size, final)
+
+  Construct a scanner over CSV data in memory. The data is not copied, so it
+  must outlive the scanner and the fields it returns.
+
+  @param data
+    The CSV data
+
+  @param size
+    The number of bytes of data
+
+  @param final
+    Whether data runs to the end of the file. If not, a last row that isn't
+    ended by a new line is treated as incomplete (startRow() returns false
+    and position() says where it starts), so that it can be scanned again
+    once more of the file has been read.
+
+  @example
+    std::string csv = "AuthorityCode,2015\nW06000011,123.4\n";
+    CsvScanner scanner(csv.data(), csv.size());
+    CsvField field;
+    while (scanner.startRow()) {
+      while (scanner.nextField(field)) {
+        std::cout << field.str() << std::endl;
+      }
+    }
+*/
+CsvScanner::CsvScanner(const char* data, size_t size, bool final)
+    : data(data), size(size), final(final),
+      pos(0), rowEnd(0), nextRow(0), inRow(false), rowDone(false) {}
+
+/*
+  CsvScanner::startRow()
+
+  Move on to the next row (skipping whatever is left of the current one),
+  finding where it ends. New lines inside quoted fields don't end a row.
+
+  @return
+    false if there are no more (complete) rows
+
+  @throws
+    std::runtime_error if the final row has an unterminated quoted field
+*/
+bool CsvScanner::startRow() {
+    if (inRow) {
+        skipRow();
+    }
+    if (pos >= size) {
+        return false;
+    }
+
+    size_t scan = pos;
+    bool quoted = false;
+    while (true) {
+        const size_t found = quoted
+                             ? findEither(data, scan, size, '"', '"')
+                             : findEither(data, scan, size, '\n', '"');
+        if (found == size) {
+            if (!final) {
+                return false;
+            }
+            if (quoted) {
+                throw std::runtime_error("CsvScanner::startRow: Unterminated quoted field");
+            }
+            rowEnd = size;
+            nextRow = size;
+            break;
+        }
+        if (data[found] == '"') {
+            quoted = !quoted;
+            scan = found + 1;
+            continue;
+        }
+        rowEnd = found;
+        nextRow = found + 1;
+        break;
+    }
+
+    if (rowEnd > pos && data[rowEnd - 1] == '\r') {
+        rowEnd--;
+    }
+    inRow = true;
+    rowDone = false;
+    return true;
+}
+
+/*
+  CsvScanner::nextField(field)
+
+  Read the next field of the current row.
+
+  @param field
+    Set to the field, if there is one
+
+  @return
+    false once every field of the row has been read
+
+  @throws
+    std::runtime_error if a quoted field is followed by anything other than
+    a comma or the end of the row
+*/
+bool CsvScanner::nextField(CsvField& field) {
+    if (!inRow || rowDone) {
+        return false;
+    }
+    field.escaped = false;
+
+    if (pos < rowEnd && data[pos] == '"') {
+        size_t close = pos + 1;
+        while (true) {
+            close = findEither(data, close, rowEnd, '"', '"');
+            if (close + 1 < rowEnd && data[close + 1] == '"') {
+                field.escaped = true;
+                close += 2;
+                continue;
+            }
+            break;
+        }
+        field.data = data + pos + 1;
+        field.size = close - pos - 1;
+
+        pos = close + 1;
+        if (pos >= rowEnd) {
+            pos = rowEnd;
+            rowDone = true;
+        } else if (data[pos] == ',') {
+            pos++;
+        } else {
+            throw std::runtime_error("CsvScanner::nextField: Unexpected character after quoted field");
+        }
+        return true;
+    }
+
+    const size_t comma = findEither(data, pos, rowEnd, ',', ',');
+    field.data = data + pos;
+    field.size = comma - pos;
+    if (comma == rowEnd) {
+        pos = rowEnd;
+        rowDone = true;
+    } else {
+        pos = comma + 1;
+    }
+    return true;
+}
+
+/*
+  CsvScanner::skipRow()
+
+  Skip the rest of the current row without reading its fields.
+*/
+void CsvScanner::skipRow() {
+    if (inRow) {
+        pos = nextRow;
+        inRow = false;
+    }
+}
+
+/*
+  The position of the first row that has not been started, e.g. of an
+  incomplete row after startRow() returned false.
+
+  @return
+    An offset into the scanned data
+*/
+size_t CsvScanner::position() const {
+    return inRow ? nextRow : pos;
+}
+
+/*
+  CsvScanner::countQuotes(data, size)
+
+  Count the double quotes in some CSV data. An odd count means the data ends
+  inside a quoted field (if it started outside one).
+
+  @param data
+    The CSV data
+
+  @param size
+    The number of bytes of data
+
+  @return
+    The number of double quotes
+*/
+size_t CsvScanner::countQuotes(const char* data, size_t size) {
+    size_t quotes = 0;
+    for (size_t i = findEither(data, 0, size, '"', '"'); i < size;
+            i = findEither(data, i + 1, size, '"', '"')) {
+        quotes++;
+    }
+    return quotes;
+}
+
+/*
+  CsvScanner::nextRowStart(data, size, from, quoted)
+
+  Find where the first row starting at or after an offset begins.
+
+  @param data
+    The CSV data
+
+  @param size
+    The number of bytes of data
+
+  @param from
+    The offset to search from
+
+  @param quoted
+    Whether from is inside a quoted field, i.e. whether an odd number of
+    quotes comes before it
+
+  @return
+    The offset just after the first new line at or after from that is not
+    inside a quoted field, or size if there isn't one
+
+  @example
+    // Split the data into two ranges of whole rows
+    size_t middle = size / 2;
+    bool quoted = CsvScanner::countQuotes(data, middle) % 2 == 1;
+    size_t split = CsvScanner::nextRowStart(data, size, middle, quoted);
+*/
+size_t CsvScanner::nextRowStart(const char* data, size_t size, size_t from, bool quoted) {
+    size_t scan = from;
+    while (scan < size) {
+        const size_t found = quoted
+                             ? findEither(data, scan, size, '"', '"')
+                             : findEither(data, scan, size, '\n', '"');
+        if (found == size) {
+            break;
+        }
+        if (data[found] == '"') {
+            quoted = !quoted;
+            scan = found + 1;
+            continue;
+        }
+        return found + 1;
+    }
+    return size;
+}
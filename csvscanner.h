@@ -0,0 +1,75 @@
+#ifndef CSVSCANNER_H_
+#define CSVSCANNER_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  This file contains the CsvScanner class, which splits CSV data held in
+  memory into rows and fields without copying it.
+
+  The scanner looks for the bytes that matter (commas, new lines and double
+  quotes) 16 bytes at a time with SSE2, or 32 at a time with AVX2 when the
+  processor supports it (checked once, at run time). On other processors it
+  falls back to a plain loop. Fields are returned as CsvField spans over the
+  scanned data, so nothing is allocated unless a field is copied out with
+  CsvField::str().
+
+  Quoted fields follow RFC 4180: they may contain commas, new lines, and
+  double quotes written twice (""), e.g. "Bro Morgannwg, Vale of Glamorgan".
+  Lines may end with \n or \r\n.
+
+  countQuotes() and nextRowStart() let a large file be split into ranges of
+  whole rows that can be scanned in parallel: whether an offset is inside a
+  quoted field follows from the parity of the quotes before it, and the
+  ranges then start after the next new line outside quotes.
+ */
+
+#include <cstddef>
+#include <string>
+
+/*
+  A field of a CSV row: a span of the scanned data, without its enclosing
+  quotes. If the field contained doubled quotes they are still doubled in
+  the span; str() undoes this.
+*/
+struct CsvField {
+  const char *data;
+  size_t size;
+  bool escaped;
+
+  bool empty() const;
+  std::string str() const;
+  double toDouble() const;
+};
+
+class CsvScanner {
+public:
+  CsvScanner(const char* data, size_t size, bool final = true);
+
+  bool startRow();
+  bool nextField(CsvField& field);
+  void skipRow();
+  size_t position() const;
+
+  static size_t countQuotes(const char* data, size_t size);
+  static size_t nextRowStart(const char* data, size_t size, size_t from, bool quoted);
+
+private:
+  const char *data;
+  size_t size;
+  bool final;
+
+  // The next field starts at pos, the row being read ends at rowEnd
+  // (before its line ending), and the next row starts at nextRow
+  size_t pos;
+  size_t rowEnd;
+  size_t nextRow;
+  bool inRow;
+  bool rowDone;
+};
+
+#endif // CSVSCANNER_H_
@@ -0,0 +1,776 @@
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  This file contains the implementation of JsonStructuralIndex and
+  JsonTapeWalker. See jsonindex.h for an overview.
+*/
+
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "jsonindex.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BETHYW_JSON_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// The AVX2 path is compiled with a target attribute, so the rest of the
+// program doesn't need to be built for AVX2
+#if defined(BETHYW_JSON_SSE2) && (defined(__GNUC__) || defined(__clang__))
+#define BETHYW_JSON_AVX2 1
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace {
+
+/*
+  The bytes of interest in a 64-byte block of the document, a bit per byte.
+  ops holds the braces, brackets, colons and commas.
+*/
+struct BlockMasks {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t ops;
+};
+
+using ClassifyFunction = void (*)(const char *block, BlockMasks& masks);
+
+#if !defined(BETHYW_JSON_SSE2)
+void classifyScalar(const char *block, BlockMasks& masks) {
+    masks = BlockMasks{0, 0, 0};
+    for (unsigned int i = 0; i < 64; i++) {
+        const uint64_t bit = uint64_t(1) << i;
+        switch (block[i]) {
+            case '"':
+                masks.quote |= bit;
+                break;
+            case '\\':
+                masks.backslash |= bit;
+                break;
+            case '{':
+            case '}':
+            case '[':
+            case ']':
+            case ':':
+            case ',':
+                masks.ops |= bit;
+                break;
+            default:
+                break;
+        }
+    }
+}
+#endif
+
+#if defined(BETHYW_JSON_SSE2)
+/*
+  Setting bit 0x20 maps [ to { and ] to } (and nothing else to either), so
+  each pair of brackets needs only one comparison.
+*/
+void classifySSE2(const char *block, BlockMasks& masks) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i open = _mm_set1_epi8('{');
+    const __m128i close = _mm_set1_epi8('}');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+
+    masks = BlockMasks{0, 0, 0};
+    for (unsigned int i = 0; i < 4; i++) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + 16 * i));
+        const __m128i folded = _mm_or_si128(bytes, caseBit);
+        const __m128i ops = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(folded, open), _mm_cmpeq_epi8(folded, close)),
+            _mm_or_si128(_mm_cmpeq_epi8(bytes, colon), _mm_cmpeq_epi8(bytes, comma)));
+
+        const unsigned int shift = 16 * i;
+        masks.quote |= uint64_t(static_cast<uint16_t>(
+            _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, quote)))) << shift;
+        masks.backslash |= uint64_t(static_cast<uint16_t>(
+            _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, backslash)))) << shift;
+        masks.ops |= uint64_t(static_cast<uint16_t>(_mm_movemask_epi8(ops))) << shift;
+    }
+}
+#endif
+
+#if defined(BETHYW_JSON_AVX2)
+__attribute__((target("avx2")))
+void classifyAVX2(const char *block, BlockMasks& masks) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i open = _mm256_set1_epi8('{');
+    const __m256i close = _mm256_set1_epi8('}');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i caseBit = _mm256_set1_epi8(0x20);
+
+    masks = BlockMasks{0, 0, 0};
+    for (unsigned int i = 0; i < 2; i++) {
+        const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block + 32 * i));
+        const __m256i folded = _mm256_or_si256(bytes, caseBit);
+        const __m256i ops = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(folded, open), _mm256_cmpeq_epi8(folded, close)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(bytes, colon), _mm256_cmpeq_epi8(bytes, comma)));
+
+        const unsigned int shift = 32 * i;
+        masks.quote |= uint64_t(static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, quote)))) << shift;
+        masks.backslash |= uint64_t(static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, backslash)))) << shift;
+        masks.ops |= uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(ops))) << shift;
+    }
+}
+#endif
+
+/*
+  Pick the widest classifier the processor supports.
+*/
+ClassifyFunction chooseClassify() {
+#if defined(BETHYW_JSON_AVX2)
+    if (__builtin_cpu_supports("avx2")) {
+        return classifyAVX2;
+    }
+#endif
+#if defined(BETHYW_JSON_SSE2)
+    return classifySSE2;
+#else
+    return classifyScalar;
+#endif
+}
+
+const ClassifyFunction classify = chooseClassify();
+
+/*
+  The index of the lowest set bit of a non-zero mask.
+*/
+inline unsigned int lowestBit(uint64_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(mask);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return index;
+#else
+    unsigned int index = 0;
+    while ((mask & 1) == 0) {
+        mask >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
+
+/*
+  Set each bit to the XOR of it and every bit below it, so that the bits
+  between an opening quote (inclusive) and its closing quote (exclusive) are
+  set.
+*/
+inline uint64_t prefixXor(uint64_t bits) {
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+/*
+  Find the bytes of a block escaped by a backslash. Backslashes are rare in
+  WelshStats files, so blocks without any are answered straight away.
+  prevEscape carries an escape over from the end of the previous block.
+*/
+uint64_t escapedBits(const char *block, uint64_t backslash, bool& prevEscape) {
+    if (backslash == 0 && !prevEscape) {
+        return 0;
+    }
+    uint64_t escaped = 0;
+    for (unsigned int i = 0; i < 64; i++) {
+        if (prevEscape) {
+            escaped |= uint64_t(1) << i;
+            prevEscape = false;
+        } else if (block[i] == '\\') {
+            prevEscape = true;
+        }
+    }
+    return escaped;
+}
+
+bool isWhitespace(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+/*
+  Append a Unicode code point to a string as UTF-8.
+*/
+void appendUTF8(std::string& out, unsigned long codePoint) {
+    if (codePoint < 0x80) {
+        out += static_cast<char>(codePoint);
+    } else if (codePoint < 0x800) {
+        out += static_cast<char>(0xC0 | (codePoint >> 6));
+        out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else if (codePoint < 0x10000) {
+        out += static_cast<char>(0xE0 | (codePoint >> 12));
+        out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (codePoint >> 18));
+        out += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+}
+
+/*
+  Read the four hex digits of a \u escape starting at text[i].
+*/
+unsigned long hexEscape(const char *text, size_t i, size_t size) {
+    if (i + 4 > size) {
+        throw std::runtime_error("JsonSpan::str: Incomplete \\u escape");
+    }
+    unsigned long value = 0;
+    for (size_t j = i; j < i + 4; j++) {
+        const char c = text[j];
+        value <<= 4;
+        if (c >= '0' && c <= '9') {
+            value |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            value |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            value |= c - 'A' + 10;
+        } else {
+            throw std::runtime_error("JsonSpan::str: Invalid \\u escape");
+        }
+    }
+    return value;
+}
+
+} // namespace
+
+/*
+  Compare the span with some text, decoding it first if it is escaped.
+
+  @param text
+    The text to compare with
+
+  @return
+    true if they are equal
+*/
+bool JsonSpan::equals(const std::string& text) const {
+    if (escaped) {
+        return str() == text;
+    }
+    return size == text.size() && std::memcmp(data, text.data(), size) == 0;
+}
+
+/*
+  Copy the span out of the document, decoding any escapes (including \u
+  escapes and surrogate pairs, which become UTF-8).
+
+  @return
+    The decoded string
+
+  @throws
+    std::runtime_error if an escape is invalid
+*/
+std::string JsonSpan::str() const {
+    if (!escaped) {
+        return std::string(data, size);
+    }
+
+    std::string out;
+    out.reserve(size);
+    for (size_t i = 0; i < size; i++) {
+        if (data[i] != '\\') {
+            out += data[i];
+            continue;
+        }
+        if (++i >= size) {
+            throw std::runtime_error("JsonSpan::str: Incomplete escape");
+        }
+        switch (data[i]) {
+            case '"':  out += '"';  break;
+            case '\\': out += '\\'; break;
+            case '/':  out += '/';  break;
+            case 'b':  out += '\b'; break;
+            case 'f':  out += '\f'; break;
+            case 'n':  out += '\n'; break;
+            case 'r':  out += '\r'; break;
+            case 't':  out += '\t'; break;
+            case 'u': {
+                unsigned long codePoint = hexEscape(data, i + 1, size);
+                i += 4;
+                if (codePoint >= 0xD800 && codePoint <= 0xDBFF) {
+                    if (i + 2 >= size || data[i + 1] != '\\' || data[i + 2] != 'u') {
+                        throw std::runtime_error("JsonSpan::str: Unpaired surrogate");
+                    }
+                    const unsigned long low = hexEscape(data, i + 3, size);
+                    if (low < 0xDC00 || low > 0xDFFF) {
+                        throw std::runtime_error("JsonSpan::str: Unpaired surrogate");
+                    }
+                    codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                    i += 6;
+                } else if (codePoint >= 0xDC00 && codePoint <= 0xDFFF) {
+                    throw std::runtime_error("JsonSpan::str: Unpaired surrogate");
+                }
+                appendUTF8(out, codePoint);
+                break;
+            }
+            default:
+                throw std::runtime_error("JsonSpan::str: Invalid escape");
+        }
+    }
+    return out;
+}
+
+/*
+  Convert a number span to a double.
+
+  @return
+    The number
+
+  @throws
+    std::runtime_error if the span is not entirely a number
+*/
+double JsonSpan::toDouble() const {
+    // strtod needs a terminated string, and the span is followed by the
+    // rest of the document, so short numbers are copied to the stack first
+    char buffer[64];
+    std::string longNumber;
+    const char *terminated = buffer;
+    if (size < sizeof(buffer)) {
+        std::memcpy(buffer, data, size);
+        buffer[size] = '\0';
+    } else {
+        longNumber = str();
+        terminated = longNumber.c_str();
+    }
+
+    char *parsedTo = nullptr;
+    const double value = std::strtod(terminated, &parsedTo);
+    if (size == 0 || parsedTo != terminated + size) {
+        throw std::runtime_error("JsonSpan::toDouble: Invalid number " + std::string(data, size));
+    }
+    return value;
+}
+
+/*
+  JsonStructuralIndex::JsonStructuralIndex(json)
+
+  Build the structural index of a document (the first stage).
+
+  @param json
+    The whole JSON document
+
+  @throws
+    std::runtime_error if the document ends inside a string, or is too
+    large to index (4 GiB or more)
+
+  @example
+    JsonStructuralIndex index(document);
+    JsonTapeWalker walker(document, index);
+*/
+JsonStructuralIndex::JsonStructuralIndex(const std::string& json) {
+    if (json.size() >= std::numeric_limits<uint32_t>::max()) {
+        throw std::runtime_error("JsonStructuralIndex: Documents of 4 GiB or more are not supported");
+    }
+    structurals.reserve(json.size() / 8);
+
+    bool prevEscape = false;
+    uint64_t inStringCarry = 0;
+    char padded[64];
+    for (size_t base = 0; base < json.size(); base += 64) {
+        const char *block = json.data() + base;
+        if (base + 64 > json.size()) {
+            std::memset(padded, ' ', sizeof(padded));
+            std::memcpy(padded, block, json.size() - base);
+            block = padded;
+        }
+
+        BlockMasks masks;
+        classify(block, masks);
+        const uint64_t quotes = masks.quote & ~escapedBits(block, masks.backslash, prevEscape);
+        const uint64_t inString = prefixXor(quotes) ^ inStringCarry;
+        inStringCarry = (inString >> 63) != 0 ? ~uint64_t(0) : 0;
+
+        uint64_t structural = (masks.ops & ~inString) | quotes;
+        while (structural != 0) {
+            structurals.push_back(static_cast<uint32_t>(base + lowestBit(structural)));
+            structural &= structural - 1;
+        }
+    }
+
+    if (inStringCarry != 0) {
+        throw std::runtime_error("JsonStructuralIndex: Unterminated string");
+    }
+}
+
+/*
+  @return
+    The offsets of the structural characters, in order
+*/
+const std::vector<uint32_t>& JsonStructuralIndex::positions() const {
+    return structurals;
+}
+
+/*
+  JsonTapeWalker::JsonTapeWalker(json, index)
+
+  Construct a walker over a document and its structural index (the second
+  stage). Both must outlive the walker and the spans it returns.
+
+  @param json
+    The whole JSON document
+
+  @param index
+    The document's structural index
+
+  @example
+    JsonStructuralIndex index(document);
+    JsonTapeWalker walker(document, index);
+    JsonSpan key, value;
+    if (walker.enterArray("value")) {
+      while (walker.nextObject()) {
+        while (walker.nextMember(key)) {
+          if (key.equals("Data")) {
+            walker.memberValue(value);
+          } else {
+            walker.skipMemberValue();
+          }
+        }
+      }
+      walker.finish();
+    }
+*/
+JsonTapeWalker::JsonTapeWalker(const std::string& json, const JsonStructuralIndex& index)
+    : json(json), positions(index.positions()), cursor(0) {}
+
+/*
+  JsonTapeWalker::enterArray(key)
+
+  Find the member of the top-level object with the given key and move to the
+  start of its value, which must be an array.
+
+  @param key
+    The key to find, e.g. "value"
+
+  @return
+    false if the top-level object has no such member (or it isn't an array)
+
+  @throws
+    std::runtime_error if the document is not an object
+*/
+bool JsonTapeWalker::enterArray(const std::string& key) {
+    cursor = 0;
+    expect('{');
+    cursor++;
+
+    JsonSpan name;
+    while (nextMember(name)) {
+        const size_t start = valueStart();
+        if (name.equals(key) && start < json.size() && json[start] == '[') {
+            cursor += 2;
+            return true;
+        }
+        skipMemberValue();
+    }
+    return false;
+}
+
+/*
+  JsonTapeWalker::nextObject()
+
+  Move into the next object in the array entered with enterArray(),
+  skipping any elements that aren't objects. Every element must be followed
+  by a comma or the end of the array.
+
+  @return
+    false at the end of the array
+
+  @throws
+    std::runtime_error if the array is malformed
+*/
+bool JsonTapeWalker::nextObject() {
+    // Whether the cursor is at the start of an element, rather than after one
+    bool element = cursor > 0 && at(cursor - 1) == '[';
+    while (true) {
+        if (element) {
+            if (at(cursor) == '{') {
+                cursor++;
+                return true;
+            }
+            if (at(cursor) == ']' && at(cursor - 1) == '[' && !scalarBefore()) {
+                cursor++;
+                return false;
+            }
+            skipValue();
+        }
+
+        const char c = at(cursor);
+        if (c == ']') {
+            cursor++;
+            return false;
+        } else if (c != ',') {
+            unexpected();
+        }
+        cursor++;
+        element = true;
+    }
+}
+
+/*
+  JsonTapeWalker::finish()
+
+  Skip the rest of the top-level object after the array entered with
+  enterArray() has been read, and check that nothing but whitespace follows
+  it.
+
+  @throws
+    std::runtime_error if the rest of the document is malformed or missing
+*/
+void JsonTapeWalker::finish() {
+    JsonSpan key;
+    while (nextMember(key)) {
+        skipMemberValue();
+    }
+    if (cursor != positions.size()) {
+        unexpected();
+    }
+    for (size_t i = positions[cursor - 1] + 1; i < json.size(); i++) {
+        if (!isWhitespace(json[i])) {
+            throw std::runtime_error("JsonTapeWalker: Unexpected '" + std::string(1, json[i])
+                                     + "' at offset " + std::to_string(i));
+        }
+    }
+}
+
+/*
+  JsonTapeWalker::nextMember(key)
+
+  Read the key of the next member of the current object. Its value must
+  then be read with memberValue() or skipped with skipMemberValue().
+
+  @param key
+    Set to the key
+
+  @return
+    false at the end of the object
+
+  @throws
+    std::runtime_error if the object is malformed
+*/
+bool JsonTapeWalker::nextMember(JsonSpan& key) {
+    if (at(cursor) == '}') {
+        if (at(cursor - 1) == ',') {
+            unexpected();
+        }
+        cursor++;
+        return false;
+    }
+    // Every member but the first follows a comma
+    if (at(cursor - 1) != '{') {
+        expect(',');
+        cursor++;
+    }
+    expect('"');
+    const size_t open = positions[cursor];
+    cursor++;
+    expect('"');
+    const size_t close = positions[cursor];
+    cursor++;
+    expect(':');
+
+    key.data = json.data() + open + 1;
+    key.size = close - open - 1;
+    key.escaped = std::memchr(key.data, '\\', key.size) != nullptr;
+    return true;
+}
+
+/*
+  JsonTapeWalker::memberValue(value)
+
+  Read the value of the member whose key was just read. Objects and arrays
+  are skipped, and returned as CONTAINER with an empty span.
+
+  @param value
+    Set to the value
+
+  @return
+    The kind of value
+
+  @throws
+    std::runtime_error if the value is missing or malformed
+*/
+JsonKind JsonTapeWalker::memberValue(JsonSpan& value) {
+    const size_t start = valueStart();
+    cursor++;
+    value.data = json.data() + start;
+    value.size = 0;
+    value.escaped = false;
+
+    const char first = start < json.size() ? json[start] : '\0';
+    if (first == '"') {
+        cursor++;
+        expect('"');
+        value.data = json.data() + start + 1;
+        value.size = positions[cursor] - start - 1;
+        value.escaped = std::memchr(value.data, '\\', value.size) != nullptr;
+        cursor++;
+        return JsonKind::STRING;
+    }
+    if (first == '{' || first == '[') {
+        skipValue();
+        return JsonKind::CONTAINER;
+    }
+
+    // Anything else runs up to the next structural character
+    at(cursor);
+    size_t end = positions[cursor];
+    while (end > start && isWhitespace(json[end - 1])) {
+        end--;
+    }
+    if (end == start) {
+        throw std::runtime_error("JsonTapeWalker: Missing value at offset " + std::to_string(start));
+    }
+    value.size = end - start;
+    if (value.equals("true") || value.equals("false") || value.equals("null")) {
+        return JsonKind::LITERAL;
+    }
+    return JsonKind::NUMBER;
+}
+
+/*
+  JsonTapeWalker::skipMemberValue()
+
+  Skip the value of the member whose key was just read, without looking at
+  anything but the structural characters.
+*/
+void JsonTapeWalker::skipMemberValue() {
+    cursor++;
+    skipValue();
+}
+
+/*
+  Skip the value starting at the cursor. A number or literal has no
+  structural characters of its own, so for one the cursor is already at the
+  comma or closing bracket after it, and there is nothing to skip.
+
+  @throws
+    std::runtime_error if the value is missing, a container is never closed
+    or closed with the wrong bracket, or the cursor is at a colon
+*/
+void JsonTapeWalker::skipValue() {
+    const char c = at(cursor);
+    if (c == '"') {
+        cursor++;
+        expect('"');
+        cursor++;
+        return;
+    }
+    if (c == ',' || c == '}' || c == ']') {
+        if (!scalarBefore()) {
+            throw std::runtime_error("JsonTapeWalker: Missing value at offset " + std::to_string(positions[cursor]));
+        }
+        return;
+    }
+    if (c != '{' && c != '[') {
+        unexpected();
+    }
+
+    // The brackets opened and not yet closed, innermost last
+    std::string open;
+    do {
+        const char structural = at(cursor);
+        if (structural == '"') {
+            cursor++;
+            expect('"');
+        } else if (structural == '{' || structural == '[') {
+            open.push_back(structural);
+        } else if (structural == '}' || structural == ']') {
+            if (open.back() != (structural == '}' ? '{' : '[')) {
+                unexpected();
+            }
+            open.pop_back();
+        }
+        cursor++;
+    } while (!open.empty());
+}
+
+/*
+  Check whether there is anything but whitespace between the structural
+  character before the cursor and the one at it, i.e. a number or literal.
+*/
+bool JsonTapeWalker::scalarBefore() const {
+    for (size_t i = positions[cursor - 1] + 1; i < positions[cursor]; i++) {
+        if (!isWhitespace(json[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+  The structural character at an index into the positions.
+
+  @throws
+    std::runtime_error if the index is past the end of the document
+*/
+char JsonTapeWalker::at(size_t index) const {
+    if (index >= positions.size()) {
+        throw std::runtime_error("JsonTapeWalker: Unexpected end of JSON");
+    }
+    return json[positions[index]];
+}
+
+/*
+  Check the structural character at the cursor.
+
+  @throws
+    std::runtime_error if it isn't c
+*/
+void JsonTapeWalker::expect(char c) {
+    if (at(cursor) != c) {
+        throw std::runtime_error(std::string("JsonTapeWalker: Expected '") + c
+                                 + "' at offset " + std::to_string(positions[cursor]));
+    }
+}
+
+/*
+  Report the structural character at the cursor as out of place.
+
+  @throws
+    std::runtime_error always
+*/
+void JsonTapeWalker::unexpected() const {
+    throw std::runtime_error(std::string("JsonTapeWalker: Unexpected '") + at(cursor)
+                             + "' at offset " + std::to_string(positions[cursor]));
+}
+
+/*
+  The offset of the first character of the value after the colon at the
+  cursor.
+*/
+size_t JsonTapeWalker::valueStart() const {
+    size_t start = positions[cursor] + 1;
+    while (start < json.size() && isWhitespace(json[start])) {
+        start++;
+    }
+    return start;
+}
@@ -0,0 +1,97 @@
+#ifndef JSONINDEX_H_
+#define JSONINDEX_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  This file contains a two-stage JSON reader for large documents held in
+  memory, used as an alternative to nlohmann::json for WelshStats files.
+
+  The first stage, JsonStructuralIndex, classifies the document 64 bytes at
+  a time with SSE2 (or AVX2, when the processor supports it) and records the
+  offset of every structural character: braces, brackets, colons and commas
+  outside strings, and the quotes that open and close strings. Which bytes
+  are inside strings comes from a running XOR of the quote bits, so no byte
+  is looked at on its own unless its block contains a backslash (only then
+  are the backslashes followed to find escaped quotes).
+
+  The second stage, JsonTapeWalker, steps through the structural offsets to
+  read an array of objects (such as the "value" array of a WelshStats file)
+  member by member. Keys and values are returned as JsonSpan spans over the
+  document, so the values of keys a caller doesn't want can be skipped
+  without copying or converting them.
+
+  The walker checks the structure of the document (brackets match, members
+  and elements are separated by commas, and nothing follows the top-level
+  object), so a malformed or truncated document always fails rather than
+  being misread. The contents of numbers and literals it skips aren't
+  checked, though, so a few malformed documents that nlohmann would reject
+  are still read without complaint.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+  A string, number or literal in a JSON document: a span of the document
+  (without the quotes, for a string). An escaped string must be decoded with
+  str() before use.
+*/
+struct JsonSpan {
+  const char *data;
+  size_t size;
+  bool escaped;
+
+  bool equals(const std::string& text) const;
+  std::string str() const;
+  double toDouble() const;
+};
+
+/*
+  The kinds of value JsonTapeWalker::memberValue() can return.
+*/
+enum class JsonKind { STRING, NUMBER, LITERAL, CONTAINER };
+
+class JsonStructuralIndex {
+public:
+  explicit JsonStructuralIndex(const std::string& json);
+
+  const std::vector<uint32_t>& positions() const;
+
+private:
+  std::vector<uint32_t> structurals;
+};
+
+class JsonTapeWalker {
+public:
+  JsonTapeWalker(const std::string& json, const JsonStructuralIndex& index);
+
+  bool enterArray(const std::string& key);
+  bool nextObject();
+  bool nextMember(JsonSpan& key);
+  JsonKind memberValue(JsonSpan& value);
+  void skipMemberValue();
+  void finish();
+
+private:
+  void skipValue();
+  bool scalarBefore() const;
+  void unexpected() const;
+  char at(size_t index) const;
+  void expect(char c);
+  size_t valueStart() const;
+
+  const std::string& json;
+  const std::vector<uint32_t>& positions;
+
+  // The structural character the walker is at
+  size_t cursor;
+};
+
+#endif // JSONINDEX_H_
@@ -23,6 +23,9 @@
 #include <locale>
 #include <ostream>
 #include <iomanip>
+#include <algorithm>
+#include <vector>
+#include <utility>
 
 #include "measure.h"
 
@@ -89,6 +92,14 @@ std::map<int, double> Measure::getDataMap() const {
     return data;
 }
 
+/**
+ * Gets the year-val data map without copying it
+ * @return a reference to the map, valid for as long as the measure is
+ */
+const std::map<int, double>& Measure::getData() const {
+    return data;
+}
+
 
 /*
   TODO: Measure::getLabel()
@@ -194,20 +205,73 @@ double Measure::getValue(int key) {
     measure.setValue(1999, 12345678.9);
 */
 void Measure::setValue(const int& year,const double& value) {
-    if (data.size() != 0) {
-        bool found = false;
-        for (auto& yearValPair: data) {
-            if (year == yearValPair.first) {
-                found = true;
-                yearValPair.second = value;
+    if (summary) {
+        accumulate(year, value);
+        return;
+    }
+    rangeIndex.reset();
+    this -> data[year] = value;
+}
+
+/*
+  Measure::merge(newer)
+
+  Combine another Measure with the same codename into this one, taking its
+  label and its values (which replace this Measure's values for the same
+  years). Both sets of values are ordered by year, so they are merged in a
+  single pass, and newer is left empty.
+
+  @param newer
+    The Measure whose label and values take precedence
+
+  @return
+    void
+
+  @example
+    Measure measure("pop", "Population");
+    measure.setValue(1999, 1.0);
+
+    Measure newer("pop", "Population (revised)");
+    newer.setValue(1999, 2.0);
+    newer.setValue(2000, 3.0);
+
+    measure.merge(std::move(newer)); // 1999 -> 2.0, 2000 -> 3.0
+*/
+void Measure::merge(Measure&& newer) {
+    rangeIndex.reset();
+    this -> name = std::move(newer.name);
+    if (summary || newer.summary) {
+        summarise();
+        if (newer.summary) {
+            mergeSummary(std::move(newer));
+        } else {
+            for (auto& yearValPair: newer.data) {
+                accumulate(yearValPair.first, yearValPair.second);
             }
+            newer.data.clear();
         }
-        if (!found){
-            this -> data.insert({year,value});
+        return;
+    }
+    if (data.empty()) {
+        // newer's values are taken as they are, so its index still applies
+        data = std::move(newer.data);
+        newer.data.clear();
+        rangeIndex = std::move(newer.rangeIndex);
+        return;
+    }
+
+    auto position = data.begin();
+    for (auto& yearValPair: newer.data) {
+        while (position != data.end() && position->first < yearValPair.first) {
+            position++;
+        }
+        if (position != data.end() && position->first == yearValPair.first) {
+            position->second = yearValPair.second;
+        } else {
+            position = data.emplace_hint(position, yearValPair.first, yearValPair.second);
         }
-    } else {
-        this -> data.insert({year,value});
     }
+    newer.data.clear();
 }
 
 int Measure::getKey() const {
@@ -233,7 +297,7 @@ int Measure::getKey() const {
     auto size = measure.size(); // returns 1
 */
 unsigned int Measure::size() const {
-    return this->data.size();
+    return summary ? summaryCount : this->data.size();
 }
 
 
@@ -258,10 +322,8 @@ double Measure::getDifference() const {
     if (this->size() <= 1) {
         return 0;
     } else {
-        auto firstValIt = data.begin();
-        double firstVal = firstValIt->second;
-        auto secondValIt = --data.end();
-        double lastVal = secondValIt->second;
+        double firstVal = firstYearValue();
+        double lastVal = lastYearValue();
 
         double sum = lastVal - firstVal;
         return sum;
@@ -287,13 +349,13 @@ double Measure::getDifference() const {
     auto diff = measure.getDifferenceAsPercentage();
 */
 double Measure::getDifferenceAsPercentage() const {
-    auto firstValIt = data.begin();
-    auto secondValIt = --data.end();
+    double firstVal = firstYearValue();
+    double lastVal = lastYearValue();
     double largestVal;
-    if ((firstValIt -> second) > (secondValIt->second)) {
-        largestVal = firstValIt -> second;
-    } else if ((firstValIt -> second) < (secondValIt->second)) {
-        largestVal = secondValIt -> second;
+    if (firstVal > lastVal) {
+        largestVal = firstVal;
+    } else if (firstVal < lastVal) {
+        largestVal = lastVal;
     } else {
         largestVal = 0;
     }
@@ -324,6 +386,19 @@ double Measure::getDifferenceAsPercentage() const {
     auto diff = measure.getAverage(); // returns 12345678.4
 */
 double Measure::getAverage() const {
+    if (summary) {
+        // Summed in order of year, as for a full measure, so that the
+        // average is exactly the same
+        double sum = 0;
+        for (size_t word = 0; word < seenYears.size(); word++) {
+            for (unsigned int bit = 0; bit < 64; bit++) {
+                if ((seenYears[word] & (uint64_t(1) << bit)) != 0) {
+                    sum += seenValues[word * 64 + bit];
+                }
+            }
+        }
+        return sum / summaryCount;
+    }
     double sum = 0;
     double numVals = 0;
     for (auto it = data.begin(); it != data.end(); it++) {
@@ -333,6 +408,161 @@ double Measure::getAverage() const {
     return sum/numVals;
 }
 
+/*
+  Measure::buildRangeIndex()
+
+  Build the prefix sums and sparse min/max tables over the years currently
+  held by this Measure, so that rangeStats() can answer any range of years
+  without walking the data. The index is discarded by setValue() and
+  merge(), so this should be called once loading has finished. Copies of
+  the Measure (e.g. those Area::filter() makes for each query) share the
+  index rather than copying it.
+
+  @return
+    void
+
+  @example
+    Measure measure("pop", "Population");
+    measure.setValue(1999, 12345678.9);
+    measure.setValue(2001, 12345679.9);
+    measure.buildRangeIndex();
+*/
+void Measure::buildRangeIndex() {
+    const size_t n = data.size();
+    std::shared_ptr<RangeIndex> index = std::make_shared<RangeIndex>();
+    index->years.reserve(n);
+    index->prefixSums.reserve(n + 1);
+    index->prefixSums.push_back(0);
+    std::vector<double> values;
+    values.reserve(n);
+    for (auto& yearValPair: data) {
+        index->years.push_back(yearValPair.first);
+        values.push_back(yearValPair.second);
+        index->prefixSums.push_back(index->prefixSums.back() + yearValPair.second);
+    }
+
+    // Level k of each sparse table holds the min/max of the 2^k values
+    // starting at each index
+    if (n != 0) {
+        index->minTable.push_back(values);
+        index->maxTable.push_back(values);
+        for (size_t width = 2; width <= n; width *= 2) {
+            const std::vector<double> &prevMin = index->minTable.back();
+            const std::vector<double> &prevMax = index->maxTable.back();
+            const size_t half = width / 2;
+            std::vector<double> levelMin(n - width + 1);
+            std::vector<double> levelMax(n - width + 1);
+            for (size_t i = 0; i + width <= n; i++) {
+                levelMin[i] = std::min(prevMin[i], prevMin[i + half]);
+                levelMax[i] = std::max(prevMax[i], prevMax[i + half]);
+            }
+            index->minTable.push_back(std::move(levelMin));
+            index->maxTable.push_back(std::move(levelMax));
+        }
+    }
+    rangeIndex = std::move(index);
+}
+
+/*
+  Check whether the range index is current, i.e. buildRangeIndex() has been
+  called since the last value was set.
+
+  @return
+    true if rangeStats() will be answered from the index
+*/
+bool Measure::hasRangeIndex() const {
+    return rangeIndex != nullptr;
+}
+
+/*
+  Measure::rangeStats(firstYear, lastYear)
+
+  Calculate the number of values, sum, average, minimum and maximum of the
+  values between two years (inclusive). If the range index has been built
+  this takes constant time once the range has been located, otherwise the
+  values in the range are walked directly. This function should be callable
+  from a constant context and must promise to not change the state of the
+  instance or throw an exception.
+
+  @param firstYear
+    The first year of the range
+
+  @param lastYear
+    The last year of the range
+
+  @return
+    A RangeStats for the years in the range, with all values 0 if there are
+    no values in the range
+
+  @example
+    Measure measure("pop", "Population");
+    measure.setValue(1999, 10);
+    measure.setValue(2000, 20);
+    measure.setValue(2001, 60);
+    measure.buildRangeIndex();
+    auto stats = measure.rangeStats(2000, 2001); // average is 40, max is 60
+*/
+RangeStats Measure::rangeStats(int firstYear, int lastYear) const {
+    RangeStats stats = {0, 0, 0, 0, 0};
+    if (firstYear > lastYear) {
+        std::swap(firstYear, lastYear);
+    }
+
+    if (!rangeIndex) {
+        for (auto it = data.lower_bound(firstYear);
+             it != data.end() && it->first <= lastYear; it++) {
+            if (stats.count == 0) {
+                stats.min = it->second;
+                stats.max = it->second;
+            } else {
+                stats.min = std::min(stats.min, it->second);
+                stats.max = std::max(stats.max, it->second);
+            }
+            stats.sum += it->second;
+            stats.count++;
+        }
+    } else if (!rangeIndex->years.empty()) {
+        const std::vector<int> &years = rangeIndex->years;
+        // Years are nearly always contiguous, in which case the range can be
+        // located by offset rather than by searching
+        size_t first;
+        size_t last;
+        const int lowest = years.front();
+        const int highest = years.back();
+        if (static_cast<size_t>(highest - lowest) + 1 == years.size()) {
+            first = static_cast<size_t>(std::max(firstYear, lowest) - lowest);
+            last = static_cast<size_t>(std::min(lastYear, highest) - lowest) + 1;
+            if (firstYear > highest || lastYear < lowest) {
+                first = last = 0;
+            }
+        } else {
+            first = std::lower_bound(years.begin(), years.end(), firstYear)
+                    - years.begin();
+            last = std::upper_bound(years.begin(), years.end(), lastYear)
+                   - years.begin();
+        }
+
+        if (first < last) {
+            const size_t width = last - first;
+            size_t level = 0;
+            while ((static_cast<size_t>(2) << level) <= width) {
+                level++;
+            }
+            const size_t second = last - (static_cast<size_t>(1) << level);
+
+            stats.count = width;
+            stats.sum = rangeIndex->prefixSums[last] - rangeIndex->prefixSums[first];
+            stats.min = std::min(rangeIndex->minTable[level][first], rangeIndex->minTable[level][second]);
+            stats.max = std::max(rangeIndex->maxTable[level][first], rangeIndex->maxTable[level][second]);
+        }
+    }
+
+    if (stats.count != 0) {
+        stats.average = stats.sum / stats.count;
+    }
+    return stats;
+}
+
 /*
   TODO: operator<<(os, measure)
 
@@ -373,7 +603,16 @@ std::ostream &operator<<(std::ostream &os, const Measure &measure) {
     const int tabVal = 14;
     const int precision = 6;
     os << measure.getLabel() << " (" << measure.getCodename() << ")\n";
-    if (measure.size() != 0) {
+    if (measure.summary) {
+        // Only the summary columns are known
+        os << std::setw(tabVal) << "Average";
+        os << std::setw(tabVal) << "Diff.";
+        os << std::setw(tabVal) << "%Diff" << "\n";
+        os << std::fixed << std::setprecision(precision);
+        os << std::setw(tabVal) << measure.getAverage();
+        os << std::setw(tabVal) << measure.getDifference();
+        os << std::setw(tabVal) << measure.getDifferenceAsPercentage() << "\n";
+    } else if (measure.size() != 0) {
         for (auto& it: measure.data) {
             os << std::setw(tabVal) << it.first;
         }
@@ -456,3 +695,149 @@ bool operator<(const Measure &lhs, const Measure &rhs) {
 
     return lhs.getCodename() < rhs.getCodename();
 }
+
+/*
+  Measure::summarise()
+
+  Switch the measure to keeping running totals (the number of values and
+  the values of the first and last years) instead of a map of every value,
+  folding in any values already set. Afterwards setValue() and merge() only
+  update the totals, and size(), getAverage(), getDifference() and
+  getDifferenceAsPercentage() give the same results as before. The
+  year-by-year values are no longer available: getDataMap() is empty and
+  rangeStats() finds nothing.
+
+  As with setValue() on a full measure, a year that is set again replaces
+  its earlier value: the totals keep each year's value in a flat array
+  (indexed by year, rather than a node per year as in data), which the
+  average is also summed from.
+
+  @example
+    Measure measure("pop", "Population");
+    measure.summarise();
+    measure.setValue(1999, 10);
+    measure.setValue(2001, 20);
+    measure.setValue(1999, 15); // replaces 10
+    auto diff = measure.getDifference(); // returns 5.0
+*/
+void Measure::summarise() {
+    if (summary) {
+        return;
+    }
+    summary = true;
+    for (auto& yearValPair: data) {
+        accumulate(yearValPair.first, yearValPair.second);
+    }
+    data.clear();
+    rangeIndex.reset();
+}
+
+/*
+  @return
+    true if the measure keeps only running totals (see summarise())
+*/
+bool Measure::isSummary() const {
+    return summary;
+}
+
+/*
+  Add a value to the running totals, or if its year has been seen before,
+  replace the value the totals have for it.
+*/
+void Measure::accumulate(int year, double value) {
+    const bool added = markSeen(year);
+    double &slot = seenValue(year);
+    if (!added) {
+        slot = value;
+        if (year == firstYear) {
+            firstValue = value;
+        }
+        if (year == lastYear) {
+            lastValue = value;
+        }
+        return;
+    }
+    slot = value;
+    summaryCount++;
+    if (summaryCount == 1 || year < firstYear) {
+        firstYear = year;
+        firstValue = value;
+    }
+    if (summaryCount == 1 || year > lastYear) {
+        lastYear = year;
+        lastValue = value;
+    }
+}
+
+/*
+  Set the bit for a year, growing the bitmask in whole words (and the values
+  with it) as needed.
+
+  @return
+    false if the bit was already set
+*/
+bool Measure::markSeen(int year) {
+    if (seenYears.empty()) {
+        seenBase = year - ((year % 64) + 64) % 64;
+        seenYears.push_back(0);
+    }
+    if (year < seenBase) {
+        const int words = (seenBase - year + 63) / 64;
+        seenYears.insert(seenYears.begin(), words, 0);
+        seenValues.insert(seenValues.begin(), 64 * words, 0);
+        seenBase -= 64 * words;
+    }
+    const unsigned int offset = year - seenBase;
+    if (offset / 64 >= seenYears.size()) {
+        seenYears.resize(offset / 64 + 1, 0);
+    }
+    if (offset >= seenValues.size()) {
+        seenValues.resize(offset + 1, 0);
+    }
+    const uint64_t bit = uint64_t(1) << (offset % 64);
+    if ((seenYears[offset / 64] & bit) != 0) {
+        return false;
+    }
+    seenYears[offset / 64] |= bit;
+    return true;
+}
+
+/*
+  The value the totals have for a year, which markSeen() must have been
+  called for.
+*/
+double& Measure::seenValue(int year) {
+    return seenValues[year - seenBase];
+}
+
+/*
+  Combine the running totals of another summary with these, its values
+  replacing these for the years both have.
+*/
+void Measure::mergeSummary(Measure&& newer) {
+    for (size_t word = 0; word < newer.seenYears.size(); word++) {
+        for (unsigned int bit = 0; bit < 64; bit++) {
+            if ((newer.seenYears[word] & (uint64_t(1) << bit)) != 0) {
+                const int year = newer.seenBase + static_cast<int>(word * 64 + bit);
+                accumulate(year, newer.seenValue(year));
+            }
+        }
+    }
+    newer.seenYears.clear();
+    newer.seenValues.clear();
+    newer.summaryCount = 0;
+}
+
+/*
+  The value for the earliest year, which there must be.
+*/
+double Measure::firstYearValue() const {
+    return summary ? firstValue : data.begin()->second;
+}
+
+/*
+  The value for the latest year, which there must be.
+*/
+double Measure::lastYearValue() const {
+    return summary ? lastValue : (--data.end())->second;
+}
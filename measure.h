@@ -14,8 +14,23 @@
   functions and member variables you need to declare in this class.
  */
 
+#include <cstdint>
 #include <string>
 #include <map>
+#include <memory>
+#include <vector>
+
+/*
+  Aggregates over an inclusive range of years within a Measure, as returned by
+  Measure::rangeStats(). All values are 0 if no years fall within the range.
+*/
+struct RangeStats {
+    unsigned int count;
+    double sum;
+    double average;
+    double min;
+    double max;
+};
 
 /*
   The Measure class contains a measure code, label, and a container for readings
@@ -32,6 +47,7 @@ public:
     //setters
     void setLabel(const std::string& label);
     void setValue(const int& year,const double& value);
+    void merge(Measure&& newer);
 
     //getters
     double getValue(int key);
@@ -40,9 +56,19 @@ public:
     std::string getLabel() const;
     unsigned int size() const;
     std::map<int, double> getDataMap() const;
+    const std::map<int, double>& getData() const;
     double getDifference() const;
     double getDifferenceAsPercentage() const;
     int getKey() const;
+    RangeStats rangeStats(int firstYear, int lastYear) const;
+
+    //range index
+    void buildRangeIndex();
+    bool hasRangeIndex() const;
+
+    //summary mode
+    void summarise();
+    bool isSummary() const;
 
     //helpers
     std::string toLower(std::string s);
@@ -57,6 +83,38 @@ protected:
     std::string codename;
     int key;
     std::map<int, double> data;
+
+    // Prefix sums and sparse tables over data, built by buildRangeIndex().
+    // An index is never changed once built, so copies of the Measure share
+    // it, and it is discarded whenever a value changes.
+    struct RangeIndex {
+        std::vector<int> years;
+        std::vector<double> prefixSums;
+        std::vector<std::vector<double>> minTable;
+        std::vector<std::vector<double>> maxTable;
+    };
+    std::shared_ptr<const RangeIndex> rangeIndex;
+
+    // Running totals kept instead of data once summarise() has been called,
+    // with a bit per year seen (from seenBase) and the value each has in the
+    // totals, so that a repeated year replaces its earlier value
+    bool summary = false;
+    unsigned int summaryCount = 0;
+    int firstYear = 0;
+    double firstValue = 0;
+    int lastYear = 0;
+    double lastValue = 0;
+    int seenBase = 0;
+    std::vector<uint64_t> seenYears;
+    std::vector<double> seenValues;
+
+private:
+    void accumulate(int year, double value);
+    bool markSeen(int year);
+    double& seenValue(int year);
+    void mergeSummary(Measure&& newer);
+    double firstYearValue() const;
+    double lastYearValue() const;
 };
 
 #endif // MEASURE_H_
\ No newline at end of file
@@ -0,0 +1,542 @@
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  This file contains the implementation of the output sinks. See output.h for
+  an overview.
+
+  POSIX systems write several buffers with a single writev (or sendmsg, for a
+  socket). Windows has no writev, so there each buffer is written with its own
+  _write, which still saves the per-call overhead of iostreams.
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <malloc.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include "lib_json.hpp"
+
+#include "output.h"
+
+namespace {
+
+/*
+  The size of each output buffer, and what they are aligned to (a page, so
+  the kernel can copy whole pages out of them).
+*/
+constexpr size_t BUFFER_SIZE = 1024 * 1024;
+constexpr size_t BUFFER_ALIGNMENT = 4096;
+
+/*
+  How many buffers fill up before they are written, and the most blocks
+  passed to a single write (well under IOV_MAX on every POSIX system).
+*/
+constexpr size_t MAX_BUFFERS = 8;
+constexpr size_t MAX_BLOCKS = 64;
+
+#if !defined(_WIN32) && defined(MSG_NOSIGNAL)
+constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+constexpr int SEND_FLAGS = 0;
+#endif
+
+/*
+  The system's description of the last error.
+*/
+std::string lastError() {
+    return std::strerror(errno);
+}
+
+} // namespace
+
+/*
+  OutputSink::OutputSink(sink, fd)
+
+  Constructor for an OutputSink.
+
+  @param sink
+    A description of where the output goes, used in error messages
+
+  @param fd
+    The file descriptor to write to
+*/
+OutputSink::OutputSink(const std::string& sink, int fd)
+    : sinkName(sink), fd(fd), current(0), used(0) {}
+
+/*
+  Write whatever is still buffered. Derived classes must call flushQuietly()
+  in their own destructors, as by the time this one runs they no longer
+  exist to write with.
+*/
+OutputSink::~OutputSink() {
+    flushQuietly();
+}
+
+/*
+  OutputSink::getSink()
+
+  @return
+    The description of where the output goes passed into the constructor
+*/
+std::string OutputSink::getSink() const {
+    return sinkName;
+}
+
+/*
+  OutputSink::write(data, size)
+
+  Add some text to the output. It is copied into the sink's buffers unless
+  it is at least as large as one, in which case it is written straight away
+  along with everything buffered before it.
+
+  @param data
+    The text to write
+
+  @param size
+    The number of bytes of text
+
+  @throws
+    std::runtime_error if buffers are written and that fails
+
+  @example
+    OutputStdout output;
+    output.write("Hello\n", 6);
+    output.flush();
+*/
+void OutputSink::write(const char* data, size_t size) {
+    if (size >= BUFFER_SIZE) {
+        std::vector<OutputBlock> blocks = filledBlocks();
+        blocks.push_back({data, size});
+        writeBlocks(blocks);
+        return;
+    }
+
+    while (size > 0) {
+        if (current == buffers.size()) {
+            void *memory = nullptr;
+#ifdef _WIN32
+            memory = _aligned_malloc(BUFFER_SIZE, BUFFER_ALIGNMENT);
+#else
+            if (posix_memalign(&memory, BUFFER_ALIGNMENT, BUFFER_SIZE) != 0) {
+                memory = nullptr;
+            }
+#endif
+            if (memory == nullptr) {
+                throw std::bad_alloc();
+            }
+            buffers.emplace_back(static_cast<char*>(memory));
+        }
+
+        const size_t copied = std::min(size, BUFFER_SIZE - used);
+        std::memcpy(buffers[current].get() + used, data, copied);
+        used += copied;
+        data += copied;
+        size -= copied;
+
+        if (used == BUFFER_SIZE) {
+            current++;
+            used = 0;
+            if (current == MAX_BUFFERS) {
+                flush();
+            }
+        }
+    }
+}
+
+/*
+  OutputSink::write(text)
+
+  Add some text to the output. See write(data, size).
+
+  @param text
+    The text to write
+
+  @throws
+    std::runtime_error if buffers are written and that fails
+*/
+void OutputSink::write(const std::string& text) {
+    write(text.data(), text.size());
+}
+
+/*
+  OutputSink::flush()
+
+  Write everything buffered so far.
+
+  @throws
+    std::runtime_error if the output could not be written. The buffered
+    output is discarded either way.
+
+  @example
+    OutputFile output("popden.json");
+    output.write(areas.toJSON());
+    output.flush();
+*/
+void OutputSink::flush() {
+    std::vector<OutputBlock> blocks = filledBlocks();
+    writeBlocks(blocks);
+}
+
+/*
+  Flush the sink, ignoring any error (for use in destructors).
+*/
+void OutputSink::flushQuietly() noexcept {
+    try {
+        flush();
+    } catch (...) {
+        current = 0;
+        used = 0;
+    }
+}
+
+/*
+  Free a buffer allocated by write().
+*/
+void OutputSink::AlignedFree::operator()(char* buffer) const {
+#ifdef _WIN32
+    _aligned_free(buffer);
+#else
+    std::free(buffer);
+#endif
+}
+
+/*
+  Collect the buffered output as blocks and empty the buffers. The blocks
+  point into the buffers, so they stay valid until the next write().
+*/
+std::vector<OutputBlock> OutputSink::filledBlocks() {
+    std::vector<OutputBlock> blocks;
+    for (size_t i = 0; i < current; i++) {
+        blocks.push_back({buffers[i].get(), BUFFER_SIZE});
+    }
+    if (used > 0) {
+        blocks.push_back({buffers[current].get(), used});
+    }
+    current = 0;
+    used = 0;
+    return blocks;
+}
+
+/*
+  Write every block in order, continuing after partial writes.
+
+  @throws
+    std::runtime_error if writeSome() fails
+*/
+void OutputSink::writeBlocks(std::vector<OutputBlock>& blocks) {
+    size_t first = 0;
+    while (first < blocks.size()) {
+        size_t written = writeSome(&blocks[first], std::min(blocks.size() - first, MAX_BLOCKS));
+        while (written > 0) {
+            OutputBlock &block = blocks[first];
+            if (written >= block.size) {
+                written -= block.size;
+                first++;
+            } else {
+                block.data += written;
+                block.size -= written;
+                written = 0;
+            }
+        }
+    }
+}
+
+/*
+  OutputSink::writeSome(blocks, count)
+
+  Write as much of some blocks as a single system call will take.
+
+  @param blocks
+    The blocks to write, in order
+
+  @param count
+    The number of blocks, at least one and at most MAX_BLOCKS
+
+  @return
+    The number of bytes written, which is 0 if the call was interrupted
+
+  @throws
+    std::runtime_error if the write failed
+*/
+size_t OutputSink::writeSome(const OutputBlock* blocks, size_t count) {
+#ifdef _WIN32
+    (void) count;
+    const unsigned int size = static_cast<unsigned int>(
+        std::min<size_t>(blocks[0].size, std::numeric_limits<int>::max()));
+    const int written = _write(fd, blocks[0].data, size);
+#else
+    iovec vectors[MAX_BLOCKS];
+    for (size_t i = 0; i < count; i++) {
+        vectors[i].iov_base = const_cast<char*>(blocks[i].data);
+        vectors[i].iov_len = blocks[i].size;
+    }
+    const ssize_t written = ::writev(fd, vectors, static_cast<int>(count));
+#endif
+    if (written < 0) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        throw std::runtime_error("OutputSink::writeSome: Failed to write to " + sinkName + ": " + lastError());
+    }
+    return static_cast<size_t>(written);
+}
+
+/*
+  OutputStdout::OutputStdout()
+
+  Constructor for output to the standard output.
+
+  @example
+    OutputStdout output;
+    output.write(areas.toJSON() + "\n");
+    output.flush();
+*/
+OutputStdout::OutputStdout() : OutputSink("standard output", 1) {}
+
+OutputStdout::~OutputStdout() {
+    flushQuietly();
+}
+
+/*
+  Write to the standard output, after anything waiting in std::cout.
+*/
+size_t OutputStdout::writeSome(const OutputBlock* blocks, size_t count) {
+    std::cout.flush();
+    return OutputSink::writeSome(blocks, count);
+}
+
+/*
+  OutputFile::OutputFile(filePath)
+
+  Constructor for output to a file, creating it or emptying it if it already
+  exists.
+
+  @param filePath
+    The path of the file to write
+
+  @throws
+    std::runtime_error if the file could not be opened
+
+  @example
+    OutputFile output("popden.json");
+*/
+OutputFile::OutputFile(const std::string& filePath)
+    : OutputSink(filePath, -1) {
+#ifdef _WIN32
+    fd = _open(filePath.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    fd = ::open(filePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+#endif
+    if (fd < 0) {
+        throw std::runtime_error("OutputFile::OutputFile: Failed to open " + filePath + ": " + lastError());
+    }
+}
+
+OutputFile::~OutputFile() {
+    flushQuietly();
+#ifdef _WIN32
+    _close(fd);
+#else
+    ::close(fd);
+#endif
+}
+
+/*
+  OutputSocket::OutputSocket(socket, deadline)
+
+  Constructor for output to a connected socket. The socket is not closed by
+  the sink.
+
+  @param socket
+    The socket's file descriptor
+
+  @param deadline
+    When to give up waiting for the socket to take more output
+
+  @throws
+    std::runtime_error on Windows, where sockets are not supported
+
+  @example
+    OutputSocket output(fd, std::chrono::steady_clock::now() + std::chrono::seconds(5));
+    output.write(response);
+    output.flush();
+*/
+OutputSocket::OutputSocket(int socket, const std::chrono::steady_clock::time_point& deadline)
+    : OutputSink("socket " + std::to_string(socket), socket), deadline(deadline) {
+#ifdef _WIN32
+    throw std::runtime_error("OutputSocket::OutputSocket: Sockets are not supported on Windows");
+#endif
+}
+
+OutputSocket::~OutputSocket() {
+    flushQuietly();
+}
+
+/*
+  Wait for the socket to take more output, then send as much as it will.
+  Sending doesn't raise SIGPIPE if the other end has gone away.
+
+  @throws
+    std::runtime_error if the deadline passes or sending fails
+*/
+size_t OutputSocket::writeSome(const OutputBlock* blocks, size_t count) {
+#ifdef _WIN32
+    (void) blocks;
+    (void) count;
+    throw std::runtime_error("OutputSocket::writeSome: Sockets are not supported on Windows");
+#else
+    using Clock = std::chrono::steady_clock;
+    while (true) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+        if (left <= 0) {
+            throw std::runtime_error("OutputSocket::writeSome: Timed out writing to " + sinkName);
+        }
+        pollfd pfd = {fd, POLLOUT, 0};
+        int ready = poll(&pfd, 1, static_cast<int>(std::min<decltype(left)>(left, std::numeric_limits<int>::max())));
+        if (ready > 0) {
+            break;
+        } else if (ready < 0 && errno != EINTR) {
+            throw std::runtime_error("OutputSocket::writeSome: Failed to wait for " + sinkName + ": " + lastError());
+        }
+    }
+
+    iovec vectors[MAX_BLOCKS];
+    for (size_t i = 0; i < count; i++) {
+        vectors[i].iov_base = const_cast<char*>(blocks[i].data);
+        vectors[i].iov_len = blocks[i].size;
+    }
+    msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = vectors;
+    message.msg_iovlen = count;
+
+    const ssize_t sent = sendmsg(fd, &message, SEND_FLAGS);
+    if (sent < 0) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        throw std::runtime_error("OutputSocket::writeSome: Failed to write to " + sinkName + ": " + lastError());
+    }
+    return static_cast<size_t>(sent);
+#endif
+}
+
+/*
+  BethYw::formatNumber(value, buffer)
+
+  Write a number as text. Whole numbers (of which most of the datasets'
+  values are) are written digit by digit, without a decimal point. Other
+  finite numbers are written with the shortest digits that read back as the
+  same double, in the form used by Areas::toJSON(). Not-a-number is written
+  as nan and infinities as inf or -inf.
+
+  @param value
+    The number to write
+
+  @param buffer
+    Where to write it, with room for NUMBER_BUFFER_SIZE characters. It is
+    not terminated.
+
+  @return
+    The number of characters written
+
+  @example
+    char buffer[BethYw::NUMBER_BUFFER_SIZE];
+    std::string text(buffer, BethYw::formatNumber(97.126504, buffer));
+*/
+size_t BethYw::formatNumber(double value, char* buffer) {
+    if (std::isnan(value)) {
+        std::memcpy(buffer, "nan", 3);
+        return 3;
+    } else if (std::isinf(value)) {
+        std::memcpy(buffer, value < 0 ? "-inf" : "inf", value < 0 ? 4 : 3);
+        return value < 0 ? 4 : 3;
+    }
+
+    // Doubles hold every whole number up to 2^53 exactly
+    const double magnitude = std::fabs(value);
+    if (magnitude < 9007199254740992.0 && magnitude == std::floor(magnitude)) {
+        char digits[NUMBER_BUFFER_SIZE];
+        size_t count = 0;
+        uint64_t whole = static_cast<uint64_t>(magnitude);
+        do {
+            digits[count++] = static_cast<char>('0' + whole % 10);
+            whole /= 10;
+        } while (whole != 0);
+
+        size_t length = 0;
+        if (std::signbit(value) && magnitude != 0) {
+            buffer[length++] = '-';
+        }
+        while (count > 0) {
+            buffer[length++] = digits[--count];
+        }
+        return length;
+    }
+
+    return nlohmann::detail::to_chars(buffer, buffer + NUMBER_BUFFER_SIZE, value) - buffer;
+}
+
+/*
+  BethYw::appendField(out, field, separator)
+
+  Append a field of a row of CSV or TSV. A field containing the separator,
+  a double quote or a new line is put in double quotes, with its own double
+  quotes doubled.
+
+  @param out
+    The text to append to
+
+  @param field
+    The field's value
+
+  @param separator
+    The character between fields, ',' for CSV or '\t' for TSV
+
+  @example
+    std::string row;
+    BethYw::appendField(row, "Swansea, Abertawe", ',');
+    // row is "\"Swansea, Abertawe\""
+*/
+void BethYw::appendField(std::string& out, const std::string& field, char separator) {
+    if (field.find_first_of(std::string("\"\r\n") + separator) == std::string::npos) {
+        out += field;
+        return;
+    }
+    out += '"';
+    for (char c: field) {
+        out += c;
+        if (c == '"') {
+            out += '"';
+        }
+    }
+    out += '"';
+}
@@ -0,0 +1,143 @@
+#ifndef OUTPUT_H_
+#define OUTPUT_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  This file contains declarations for the output sinks, the counterparts of
+  the input sources in input.h. OutputSink is the base class, and OutputStdout,
+  OutputFile and OutputSocket write to the standard output, a file and a
+  connected socket respectively.
+
+  A sink copies what is written to it into large aligned buffers, and writes
+  several buffers at once (with writev, on POSIX systems) when they fill up or
+  the sink is flushed. Text at least as large as a buffer is not copied, but
+  written together with the buffers before it. This keeps the number of
+  system calls for a large export to a few per hundred megabytes.
+
+  BethYw::formatNumber() writes numbers for text output without the cost of
+  a stream or printf.
+ */
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+  A piece of output waiting to be written.
+*/
+struct OutputBlock {
+  const char *data;
+  size_t size;
+};
+
+/*
+  OutputSink is the base class for all output destinations, writing to a file
+  descriptor given by the derived class. Nothing is written until a buffer
+  fills up or flush() is called, and the destructor flushes whatever is left
+  (ignoring errors), so flush() must be called to find out whether the
+  output was written.
+*/
+class OutputSink {
+public:
+  virtual ~OutputSink();
+
+  std::string getSink() const;
+  void write(const char* data, size_t size);
+  void write(const std::string& text);
+  void flush();
+
+protected:
+  OutputSink(const std::string& sink, int fd);
+
+  virtual size_t writeSome(const OutputBlock* blocks, size_t count);
+  void flushQuietly() noexcept;
+
+  std::string sinkName;
+  int fd;
+
+private:
+  struct AlignedFree {
+    void operator()(char* buffer) const;
+  };
+  using Buffer = std::unique_ptr<char, AlignedFree>;
+
+  void writeBlocks(std::vector<OutputBlock>& blocks);
+  std::vector<OutputBlock> filledBlocks();
+
+  std::vector<Buffer> buffers;
+
+  // The buffer being filled, and how much of it has been
+  size_t current;
+  size_t used;
+};
+
+/*
+  Output to the standard output. Anything already written to std::cout is
+  flushed first, so the two can be mixed.
+*/
+class OutputStdout : public OutputSink {
+public:
+  OutputStdout();
+  ~OutputStdout();
+
+protected:
+  size_t writeSome(const OutputBlock* blocks, size_t count) override;
+};
+
+/*
+  Output to a file, which is created (or emptied) when the sink is
+  constructed and closed when it is destroyed.
+*/
+class OutputFile : public OutputSink {
+public:
+  OutputFile(const std::string& filePath);
+  ~OutputFile();
+};
+
+/*
+  Output to a connected socket, which is left open. Writes wait for the
+  socket to be ready, but give up once the deadline has passed.
+*/
+class OutputSocket : public OutputSink {
+public:
+  OutputSocket(int socket,
+               const std::chrono::steady_clock::time_point& deadline
+                   = std::chrono::steady_clock::time_point::max());
+  ~OutputSocket();
+
+protected:
+  size_t writeSome(const OutputBlock* blocks, size_t count) override;
+
+private:
+  std::chrono::steady_clock::time_point deadline;
+};
+
+namespace BethYw {
+
+/*
+  The most characters formatNumber() writes.
+*/
+constexpr size_t NUMBER_BUFFER_SIZE = 32;
+
+/*
+  Write the shortest text that reads back as value into buffer (which must
+  hold NUMBER_BUFFER_SIZE characters), returning the number of characters.
+*/
+size_t formatNumber(double value, char* buffer);
+
+/*
+  Append a field of CSV or TSV, quoted if it contains the separator, a quote
+  or a new line.
+*/
+void appendField(std::string& out, const std::string& field, char separator);
+
+} // namespace BethYw
+
+#endif // OUTPUT_H_
@@ -0,0 +1,119 @@
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  This file contains the implementation of PipelinedInput. See pipeline.h
+  for an overview of the import pipeline.
+*/
+
+#include <exception>
+#include <istream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "pipeline.h"
+
+constexpr size_t PipelinedInput::DEFAULT_BLOCK_SIZE;
+constexpr size_t PipelinedInput::DEFAULT_DEPTH;
+
+/*
+  PipelinedInput::PipelinedInput(source, blockSize, depth)
+
+  Construct a stream over source and start reading it ahead on another
+  thread. source must not be used by anything else until this stream has
+  been destroyed.
+
+  @param source
+    The stream to read, e.g. from InputFile::open()
+
+  @param blockSize
+    The number of bytes read at a time
+
+  @param depth
+    The most blocks that may be read but not yet consumed
+
+  @example
+    InputFile input("datasets/popu1009.json");
+    PipelinedInput is(input.open());
+
+    json j;
+    is >> j;
+*/
+PipelinedInput::PipelinedInput(std::istream& source, size_t blockSize, size_t depth)
+    : std::istream(nullptr), blocks(depth), buffer(blocks, error) {
+    rdbuf(&buffer);
+    // Let a read error reach the parser, instead of just setting badbit
+    exceptions(std::ios::badbit);
+    reader = std::thread(&PipelinedInput::readBlocks, this, std::ref(source), blockSize);
+}
+
+/*
+  PipelinedInput::~PipelinedInput()
+
+  Stop reading ahead (if the consumer stopped early) and join the reading
+  thread.
+*/
+PipelinedInput::~PipelinedInput() {
+    blocks.cancel();
+    reader.join();
+}
+
+/*
+  The read stage: read source in blocks until it ends or the consumer
+  cancels. If reading fails, the error is kept for the consumer, which
+  rethrows it once it has consumed the blocks read before the failure.
+*/
+void PipelinedInput::readBlocks(std::istream& source, size_t blockSize) {
+    try {
+        while (source.good()) {
+            std::string block(blockSize, '\0');
+            source.read(&block[0], blockSize);
+            if (source.bad()) {
+                throw std::runtime_error("PipelinedInput: Failed to read the input");
+            }
+            block.resize(source.gcount());
+            if (block.empty() || !blocks.push(std::move(block))) {
+                break;
+            }
+        }
+    } catch (...) {
+        // Published to the consumer by close()
+        error = std::current_exception();
+    }
+    blocks.close();
+}
+
+PipelinedInput::BlockBuffer::BlockBuffer(SpscQueue<std::string>& blocks,
+                                         const std::exception_ptr& error)
+    : blocks(blocks), error(error) {}
+
+/*
+  Move on to the next block once the current one has been consumed.
+
+  @return
+    The next character, or EOF once every block has been consumed
+
+  @throws
+    The exception that stopped the read stage, if reading failed
+*/
+PipelinedInput::BlockBuffer::int_type PipelinedInput::BlockBuffer::underflow() {
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+    if (!blocks.pop(current) || current.empty()) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return traits_type::eof();
+    }
+    setg(&current[0], &current[0], &current[0] + current.size());
+    return traits_type::to_int_type(*gptr());
+}
@@ -0,0 +1,180 @@
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  This file contains the building blocks of the import pipeline: SpscQueue,
+  a bounded lock-free queue between two threads, and PipelinedInput, an input
+  stream whose data is read in large blocks by a thread of its own.
+
+  Importing a dataset is split into three stages, each on its own thread:
+
+    read  -> PipelinedInput reads blocks of the file ahead of the parser
+    parse -> the populate…() function tokenises the blocks into rows
+    merge -> the rows are applied to the Areas object
+
+  Each pair of stages is connected by an SpscQueue with a small fixed
+  capacity, so a fast stage waits for a slow one (backpressure). Every
+  import reads its file through a PipelinedInput, so reading from slow (e.g.
+  network) storage overlaps with whatever consumes the blocks.
+
+  An AuthorityByYearCSV import on a single thread (--threads 1), with
+  --summary-only or with --ndjson runs all three stages, parsing the blocks
+  as they arrive without holding the whole file. With --ndjson, a WelshStats
+  JSON import does too, though its parse and merge stages share a thread:
+  nlohmann::json's SAX parser reads the blocks as they arrive and each row
+  is merged as soon as it ends. Otherwise the parser still collects the
+  whole file from the read stage first (the structural index for WelshStats
+  JSON, areas.csv and the default multi-threaded CSV path all need it, to
+  index or split it) and then parses it in parallel.
+
+  A read error is not mistaken for the end of the file: it is rethrown by
+  PipelinedInput to the parser.
+ */
+
+#include <atomic>
+#include <exception>
+#include <chrono>
+#include <istream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/*
+  A bounded queue with one producer thread and one consumer thread. Pushing
+  and popping never take a lock: each side only writes its own index, and
+  waits (spinning briefly, then yielding) while the queue is full or empty.
+
+  The producer calls close() once it has pushed everything. The consumer may
+  call cancel() to stop the producer early, e.g. after an error.
+*/
+template <typename T>
+class SpscQueue {
+public:
+  explicit SpscQueue(size_t capacity)
+      : slots(capacity + 1), head(0), tail(0), closed(false), cancelled(false) {}
+
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+
+  /*
+    Push an item, waiting while the queue is full. Returns false (without
+    pushing) if the consumer has cancelled the queue.
+  */
+  bool push(T item) {
+    const size_t position = tail.load(std::memory_order_relaxed);
+    const size_t next = (position + 1) % slots.size();
+    unsigned int spins = 0;
+    while (next == head.load(std::memory_order_acquire)) {
+      if (cancelled.load(std::memory_order_acquire)) {
+        return false;
+      }
+      backOff(spins);
+    }
+    slots[position] = std::move(item);
+    tail.store(next, std::memory_order_release);
+    return true;
+  }
+
+  /*
+    Pop an item, waiting while the queue is empty. Returns false once the
+    producer has closed the queue and every item has been popped.
+  */
+  bool pop(T& item) {
+    const size_t position = head.load(std::memory_order_relaxed);
+    unsigned int spins = 0;
+    while (position == tail.load(std::memory_order_acquire)) {
+      if (closed.load(std::memory_order_acquire)) {
+        // The producer may have pushed just before closing
+        if (position == tail.load(std::memory_order_acquire)) {
+          return false;
+        }
+        break;
+      }
+      backOff(spins);
+    }
+    item = std::move(slots[position]);
+    slots[position] = T();
+    head.store((position + 1) % slots.size(), std::memory_order_release);
+    return true;
+  }
+
+  void close() {
+    closed.store(true, std::memory_order_release);
+  }
+
+  void cancel() {
+    cancelled.store(true, std::memory_order_release);
+  }
+
+private:
+  static void backOff(unsigned int& spins) {
+    if (++spins < 64) {
+      return;
+    } else if (spins < 128) {
+      std::this_thread::yield();
+    } else {
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+  }
+
+  std::vector<T> slots;
+
+  // Written only by the consumer and the producer respectively, and kept on
+  // separate cache lines so they don't slow each other down
+  alignas(64) std::atomic<size_t> head;
+  alignas(64) std::atomic<size_t> tail;
+
+  std::atomic<bool> closed;
+  std::atomic<bool> cancelled;
+};
+
+/*
+  An input stream over another stream, which a separate thread reads ahead
+  of the consumer in blocks of blockSize bytes, keeping at most depth blocks
+  waiting. It can be passed to any parser that takes an std::istream.
+*/
+class PipelinedInput : public std::istream {
+public:
+  explicit PipelinedInput(std::istream& source,
+                          size_t blockSize = DEFAULT_BLOCK_SIZE,
+                          size_t depth = DEFAULT_DEPTH);
+  ~PipelinedInput();
+
+  PipelinedInput(const PipelinedInput&) = delete;
+  PipelinedInput& operator=(const PipelinedInput&) = delete;
+
+  static constexpr size_t DEFAULT_BLOCK_SIZE = 1024 * 1024;
+  static constexpr size_t DEFAULT_DEPTH = 4;
+
+private:
+  class BlockBuffer : public std::streambuf {
+  public:
+    BlockBuffer(SpscQueue<std::string>& blocks, const std::exception_ptr& error);
+
+  protected:
+    int_type underflow() override;
+
+  private:
+    SpscQueue<std::string>& blocks;
+    const std::exception_ptr& error;
+    std::string current;
+  };
+
+  void readBlocks(std::istream& source, size_t blockSize);
+
+  SpscQueue<std::string> blocks;
+  // Why the read stage stopped early, if it failed
+  std::exception_ptr error;
+  BlockBuffer buffer;
+  std::thread reader;
+};
+
+#endif // PIPELINE_H_
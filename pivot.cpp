@@ -0,0 +1,387 @@
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  This file contains the implementation of PivotTable and of BethYw::pivot(),
+  which builds one from the imported areas. See pivot.h for an overview.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "lib_json.hpp"
+
+#include "areas.h"
+#include "bethyw.h"
+#include "output.h"
+#include "pivot.h"
+
+using json = nlohmann::json;
+
+namespace {
+
+/*
+  Pivot on a year: a row for each area with a value for the year, and a
+  column for each measure any of them has a value for.
+
+  The areas are read in a single pass, collecting each value with its area
+  (rows are added in authority code order, as the areas are stored) and the
+  measure's column, numbered in the order measures are first seen. The
+  columns are then sorted by codename and the values placed in the matrix.
+*/
+PivotTable pivotYear(const Areas& areas, int year) {
+    struct Value {
+        size_t row;
+        size_t column;
+        double value;
+    };
+    std::vector<Value> values;
+    std::vector<std::string> rows;
+    std::map<std::string, size_t> columnsSeen;
+
+    for (auto& codeArea: areas) {
+        bool hasValue = false;
+        for (const Measure *measure: codeArea.second.sortedMeasures()) {
+            auto found = measure->getData().find(year);
+            if (found == measure->getData().end()) {
+                continue;
+            }
+            if (!hasValue) {
+                rows.push_back(codeArea.first);
+                hasValue = true;
+            }
+            auto column = columnsSeen.insert({measure->getCodename(), columnsSeen.size()}).first;
+            values.push_back({rows.size() - 1, column->second, found->second});
+        }
+    }
+
+    std::vector<std::string> columns;
+    std::vector<size_t> sortedColumn(columnsSeen.size());
+    for (auto& codeColumn: columnsSeen) {
+        sortedColumn[codeColumn.second] = columns.size();
+        columns.push_back(codeColumn.first);
+    }
+
+    PivotTable pivot("Values for " + std::to_string(year), "authority_code", rows, columns);
+    for (auto& value: values) {
+        pivot.set(value.row, sortedColumn[value.column], value.value);
+    }
+    return pivot;
+}
+
+/*
+  Pivot on an area: a row for each of its measures (in codename order) and
+  a column for each year any of them has a value for.
+*/
+PivotTable pivotArea(const Areas& areas, const std::string& code) {
+    const Area *found = areas.findArea(code);
+    if (found == nullptr) {
+        throw std::out_of_range("No area found matching " + code);
+    }
+    const Area &area = *found;
+    // Measures without a value (e.g. in the years imported) are left out
+    std::vector<const Measure*> measures;
+    for (const Measure *measure: area.sortedMeasures()) {
+        if (!measure->getData().empty()) {
+            measures.push_back(measure);
+        }
+    }
+    std::vector<std::string> rows;
+    for (const Measure *measure: measures) {
+        rows.push_back(measure->getCodename());
+    }
+    std::map<int, size_t> years;
+    for (const Measure *measure: measures) {
+        for (auto& yearValue: measure->getData()) {
+            years.insert({yearValue.first, 0});
+        }
+    }
+    std::vector<std::string> columns;
+    for (auto& yearColumn: years) {
+        yearColumn.second = columns.size();
+        columns.push_back(std::to_string(yearColumn.first));
+    }
+
+    const auto names = area.getNamesMap();
+    const auto english = names.find("eng");
+    const std::string title = (english == names.end() ? "" : english->second + " ") + "(" + code + ")";
+    PivotTable pivot(title, "measure_code", rows, columns);
+    for (size_t row = 0; row < measures.size(); row++) {
+        for (auto& yearValue: measures[row]->getData()) {
+            pivot.set(row, years[yearValue.first], yearValue.second);
+        }
+    }
+    return pivot;
+}
+
+} // namespace
+
+/*
+  PivotTable::PivotTable(title, rowHeading, rows, columns)
+
+  Construct a pivot table with no values.
+
+  @param title
+    What the table shows, printed above it as a table
+
+  @param rowHeading
+    The heading of the column of row labels
+
+  @param rows
+    The row labels
+
+  @param columns
+    The column labels
+
+  @example
+    PivotTable pivot("Values for 2015", "authority_code", {"W06000011"}, {"pop"});
+    pivot.set(0, 0, 244513);
+*/
+PivotTable::PivotTable(const std::string& title,
+                       const std::string& rowHeading,
+                       const std::vector<std::string>& rows,
+                       const std::vector<std::string>& columns)
+    : title(title), rowHeading(rowHeading), rows(rows), columns(columns),
+      cells(rows.size() * columns.size(), std::numeric_limits<double>::quiet_NaN()) {}
+
+/*
+  Set the value in a row and column.
+*/
+void PivotTable::set(size_t row, size_t column, double value) {
+    cells.at(row * columns.size() + column) = value;
+}
+
+/*
+  @return
+    true if there is a value in the row and column
+*/
+bool PivotTable::has(size_t row, size_t column) const {
+    return !std::isnan(get(row, column));
+}
+
+/*
+  @return
+    The value in a row and column, or NaN if there isn't one
+*/
+double PivotTable::get(size_t row, size_t column) const {
+    return cells.at(row * columns.size() + column);
+}
+
+size_t PivotTable::rowCount() const {
+    return rows.size();
+}
+
+size_t PivotTable::columnCount() const {
+    return columns.size();
+}
+
+/*
+  PivotTable::toJSON()
+
+  Render the table as a JSON object with a member for each row, each an
+  object with a member for each column that has a value.
+
+  @return
+    std::string of JSON
+
+  @example
+    // {"W06000011":{"pop":244513.0}}
+    std::cout << pivot.toJSON();
+*/
+std::string PivotTable::toJSON() const {
+    json j = json::object();
+    for (size_t row = 0; row < rows.size(); row++) {
+        json values = json::object();
+        for (size_t column = 0; column < columns.size(); column++) {
+            if (has(row, column)) {
+                values[columns[column]] = get(row, column);
+            }
+        }
+        j[rows[row]] = std::move(values);
+    }
+    return j.dump();
+}
+
+/*
+  PivotTable::toDelimited(separator)
+
+  Render the table as CSV or TSV: a header row of the row heading and the
+  column labels, then a row for each row of the table. Missing values are
+  left empty.
+
+  @param separator
+    The character between fields, ',' for CSV or '\t' for TSV
+
+  @return
+    The rows, each ending with a new line
+*/
+std::string PivotTable::toDelimited(char separator) const {
+    std::string text = rowHeading;
+    for (auto& column: columns) {
+        text += separator;
+        text += column;
+    }
+    text += '\n';
+
+    char number[BethYw::NUMBER_BUFFER_SIZE];
+    for (size_t row = 0; row < rows.size(); row++) {
+        BethYw::appendField(text, rows[row], separator);
+        for (size_t column = 0; column < columns.size(); column++) {
+            text += separator;
+            if (has(row, column)) {
+                text.append(number, BethYw::formatNumber(get(row, column), number));
+            }
+        }
+        text += '\n';
+    }
+    return text;
+}
+
+/*
+  PivotTable::render(format)
+
+  Render the table in an output format.
+
+  @param format
+    TABLE, JSON, CSV or TSV
+
+  @return
+    The rendered table, ending with a new line
+
+  @throws
+    std::invalid_argument for any other format
+*/
+std::string PivotTable::render(BethYw::OutputFormat format) const {
+    switch (format) {
+        case BethYw::OutputFormat::TABLE: {
+            std::ostringstream table;
+            table << *this << "\n";
+            return table.str();
+        }
+        case BethYw::OutputFormat::JSON:
+            return toJSON() + "\n";
+        case BethYw::OutputFormat::CSV:
+            return toDelimited(',');
+        case BethYw::OutputFormat::TSV:
+            return toDelimited('\t');
+        default:
+            throw std::invalid_argument("--pivot can only be output as a table, JSON, CSV or TSV");
+    }
+}
+
+/*
+  operator<<(os, pivot)
+
+  Print the table with its title, right-aligned in columns at least as wide
+  as a Measure's (wider if a value needs it), with - for missing values.
+
+  @param os
+    The output stream to write to
+
+  @param pivot
+    The PivotTable to write
+
+  @return
+    Reference to the output stream
+
+  @example
+    // Values for 2015
+    //   authority_code           pop
+    //        W06000011 244513.000000
+    std::cout << pivot;
+*/
+std::ostream &operator<<(std::ostream &os, const PivotTable &pivot) {
+    const size_t tabVal = 14;
+    const int precision = 6;
+
+    // Columns are widened to fit their longest value, so that they never
+    // run into each other
+    std::vector<std::string> cells;
+    std::vector<size_t> widths;
+    for (auto& column: pivot.columns) {
+        widths.push_back(std::max(tabVal, column.size() + 1));
+    }
+    for (size_t row = 0; row < pivot.rows.size(); row++) {
+        for (size_t column = 0; column < pivot.columns.size(); column++) {
+            std::string cell = "-";
+            if (pivot.has(row, column)) {
+                std::ostringstream value;
+                value << std::fixed << std::setprecision(precision) << pivot.get(row, column);
+                cell = value.str();
+            }
+            widths[column] = std::max(widths[column], cell.size() + 1);
+            cells.push_back(std::move(cell));
+        }
+    }
+
+    size_t labelWidth = pivot.rowHeading.size();
+    for (auto& row: pivot.rows) {
+        labelWidth = std::max(labelWidth, row.size());
+    }
+
+    os << pivot.title << "\n";
+    os << std::setw(labelWidth) << pivot.rowHeading;
+    for (size_t column = 0; column < pivot.columns.size(); column++) {
+        os << std::setw(widths[column]) << pivot.columns[column];
+    }
+    os << "\n";
+
+    auto cell = cells.begin();
+    for (auto& row: pivot.rows) {
+        os << std::setw(labelWidth) << row;
+        for (size_t column = 0; column < pivot.columns.size(); column++) {
+            os << std::setw(widths[column]) << *cell++;
+        }
+        os << "\n";
+    }
+    return os;
+}
+
+/*
+  BethYw::pivot(areas, pivotArg)
+
+  Pivot the imported areas on the --pivot argument. A year (YYYY) gives a
+  matrix of authorities by measures for that year, and an authority code
+  gives a matrix of that area's measures by years.
+
+  @param areas
+    The imported areas
+
+  @param pivotArg
+    The year or authority code to pivot on
+
+  @return
+    The PivotTable
+
+  @throws
+    std::invalid_argument if the year is out of range, or std::out_of_range
+    if there is no area with the authority code
+
+  @example
+    Areas areas;
+    ...
+    std::cout << BethYw::pivot(areas, "2015");
+*/
+PivotTable BethYw::pivot(const Areas& areas, const std::string& pivotArg) {
+    std::string year = pivotArg;
+    if (!year.empty() && BethYw::yearIsNumber(year)) {
+        if (year.size() != 4) {
+            throw std::invalid_argument("Invalid input for pivot argument");
+        }
+        return pivotYear(areas, std::stoi(year));
+    }
+    return pivotArea(areas, Areas::toUpper(pivotArg));
+}
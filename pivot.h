@@ -0,0 +1,61 @@
+#ifndef PIVOT_H_
+#define PIVOT_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  This file contains the declaration of PivotTable, a matrix of values with
+  labelled rows and columns, used for --pivot. Pivoting on a year gives a
+  matrix of authorities (rows) by measures (columns) for that year, and
+  pivoting on an authority code gives a matrix of that area's measures
+  (rows) by years (columns). Both are built by BethYw::pivot().
+ */
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "bethyw.h"
+
+class PivotTable {
+public:
+  PivotTable(const std::string& title,
+             const std::string& rowHeading,
+             const std::vector<std::string>& rows,
+             const std::vector<std::string>& columns);
+
+  void set(size_t row, size_t column, double value);
+  bool has(size_t row, size_t column) const;
+  double get(size_t row, size_t column) const;
+  size_t rowCount() const;
+  size_t columnCount() const;
+
+  std::string toJSON() const;
+  std::string toDelimited(char separator) const;
+  std::string render(BethYw::OutputFormat format) const;
+  friend std::ostream &operator<<(std::ostream &os, const PivotTable &pivot);
+
+private:
+  std::string title;
+  std::string rowHeading;
+  std::vector<std::string> rows;
+  std::vector<std::string> columns;
+
+  // The values, a row at a time, with NaN for a missing value
+  std::vector<double> cells;
+};
+
+namespace BethYw {
+
+/*
+  Pivot areas on the --pivot argument: a year, or an authority code.
+*/
+PivotTable pivot(const Areas& areas, const std::string& pivotArg);
+
+} // namespace BethYw
+
+#endif // PIVOT_H_
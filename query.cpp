@@ -0,0 +1,572 @@
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  This file contains the implementation of Query parsing and the QueryEngine,
+  which together let many queries be answered from one import of the data.
+
+  Each dataset is imported once, without any filters, into its own Areas
+  object. A Query is then answered by copying the filtered areas.csv names
+  and the filtered data of each requested dataset (in the requested order, so
+  later datasets take precedence just as they do at import time) into a new
+  Areas object, which is output in the usual way.
+*/
+
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "lib_cxxopts.hpp"
+
+#include "aggregate.h"
+#include "bethyw.h"
+#include "datasets.h"
+#include "input.h"
+#include "output.h"
+#include "pivot.h"
+#include "ranking.h"
+#include "rollup.h"
+#include "query.h"
+#include "threadpool.h"
+
+/*
+  BethYw::parseQuery(args)
+
+  Build a Query from parsed program arguments, validating them with the same
+  functions used for a single run of the program.
+
+  @param args
+    Parsed program arguments
+
+  @return
+    The Query
+
+  @throws
+    std::invalid_argument if any of the arguments are invalid
+
+  @example
+    auto cxxopts = BethYw::cxxoptsSetup();
+    auto args = cxxopts.parse(argc, argv);
+
+    auto query = BethYw::parseQuery(args);
+*/
+BethYw::Query BethYw::parseQuery(cxxopts::ParseResult& args) {
+    Query query;
+    for (auto& dataset: BethYw::parseDatasetsArg(args)) {
+        query.datasets.push_back(dataset.CODE);
+    }
+    query.areasFilter = BethYw::parseAreasArg(args);
+    query.measuresFilter = BethYw::parseMeasuresArg(args);
+    query.yearsFilter = BethYw::parseYearsArg(args);
+    query.format = BethYw::parseOutputFormatArg(args);
+    if (query.format == OutputFormat::NDJSON || query.format == OutputFormat::ARROW) {
+        throw std::invalid_argument("--ndjson and --arrow can only be used for a single run of the program");
+    }
+    if (args.count("pivot")) {
+        query.pivot = args["pivot"].as<std::string>();
+    }
+    if (args.count("top") != args.count("by")) {
+        throw std::invalid_argument("--top and --by must be used together");
+    }
+    if (args.count("top")) {
+        if (!query.pivot.empty()) {
+            throw std::invalid_argument("--top can't be used with --pivot");
+        }
+        query.top = args["top"].as<unsigned int>();
+        query.by = args["by"].as<std::string>();
+        query.ascending = args.count("ascending") != 0;
+        BethYw::parseRankKey(query.by);
+    }
+    if (args.count("where")) {
+        query.where = args["where"].as<std::string>();
+        BethYw::parseWhereArg(query.where);
+    }
+    if (args.count("aggregate")) {
+        query.aggregate = args["aggregate"].as<std::string>();
+        BethYw::parseAggregateArg(query.aggregate);
+    }
+    if (args.count("rollup")) {
+        if (!query.aggregate.empty()) {
+            throw std::invalid_argument("--rollup can't be used with --aggregate");
+        }
+        query.rollup = args["rollup"].as<std::string>();
+    }
+    return query;
+}
+
+/*
+  BethYw::parseQueryLine(line)
+
+  Build a Query from a line of whitespace-separated program arguments, using
+  the same syntax as the command line.
+
+  @param line
+    The program arguments, without the program name
+
+  @return
+    The Query
+
+  @throws
+    std::invalid_argument if any of the arguments are invalid, or a
+    cxxopts::OptionException if the arguments cannot be parsed
+
+  @example
+    auto query = BethYw::parseQueryLine("-d popden -a W06000011 -y 2010-2015");
+*/
+BethYw::Query BethYw::parseQueryLine(const std::string& line) {
+    std::vector<std::string> tokens = {"bethyw"};
+    std::istringstream lineStream(line);
+    std::string token;
+    while (lineStream >> token) {
+        tokens.push_back(token);
+    }
+
+    std::vector<char*> argv;
+    for (auto& arg: tokens) {
+        argv.push_back(&arg[0]);
+    }
+    int argc = argv.size();
+    char **argvPtr = argv.data();
+
+    auto cxxopts = BethYw::cxxoptsSetup();
+    auto args = cxxopts.parse(argc, argvPtr);
+    return BethYw::parseQuery(args);
+}
+
+/*
+  QueryEngine::QueryEngine(dir, cacheBytes)
+
+  Construct a QueryEngine for the datasets in a directory, importing the
+  names of all areas from areas.csv.
+
+  @param dir
+    The directory where the datasets are, ending with a directory separator
+
+  @param cacheBytes
+    The memory budget, in bytes, for caching rendered results
+
+  @throws
+    std::runtime_error if areas.csv cannot be imported
+
+  @example
+    BethYw::QueryEngine engine("datasets/");
+*/
+BethYw::QueryEngine::QueryEngine(const std::string& dir, size_t cacheBytes)
+    : dir(dir), dataGeneration(0), cache(cacheBytes) {
+    BethYw::loadAreas(names, dir, StringFilterSet());
+}
+
+/*
+  QueryEngine::load(datasetCodes)
+
+  Import every dataset in datasetCodes that has not already been imported.
+  Each dataset is imported in full, with no filters, into its own Areas
+  object so that it can be combined with others in any order later.
+
+  @param datasetCodes
+    The codes of the datasets to import (as in the -d argument)
+
+  @return
+    void
+
+  @throws
+    std::invalid_argument if a code doesn't match a dataset, or any
+    exception thrown while importing a dataset
+
+  @example
+    BethYw::QueryEngine engine("datasets/");
+    engine.load({"popden", "trains"});
+*/
+void BethYw::QueryEngine::load(const std::vector<std::string>& datasetCodes) {
+    const StringFilterSet noFilter;
+    const YearFilterTuple allYears = std::make_tuple(0, 0);
+
+    for (auto& code: datasetCodes) {
+        if (isLoaded(code)) {
+            continue;
+        }
+
+        bool found = false;
+        for (unsigned int i = 0; i < InputFiles::NUM_DATASETS; i++) {
+            const InputFileSource &source = InputFiles::DATASETS[i];
+            if (source.CODE == code) {
+                found = true;
+                InputFile file(dir + source.FILE);
+                Areas imported = Areas();
+                imported.populate(file.open(), source.PARSER, source.COLS,
+                                  &noFilter, &noFilter, &allYears);
+                imported.buildRangeIndexes();
+                auto inserted = datasets.emplace(code, std::move(imported)).first;
+                valueIndexes[code].reset(new ValueIndex(inserted->second));
+                dataGeneration++;
+                break;
+            }
+        }
+        if (!found) {
+            throw std::invalid_argument("No dataset matches key: " + code);
+        }
+    }
+}
+
+/*
+  Check whether a dataset has been imported into this QueryEngine.
+
+  @param datasetCode
+    The code of the dataset
+
+  @return
+    true if the dataset has been imported
+*/
+bool BethYw::QueryEngine::isLoaded(const std::string& datasetCode) const {
+    return datasets.find(datasetCode) != datasets.end();
+}
+
+/*
+  The generation of the imported data, which changes whenever another
+  dataset is imported.
+
+  @return
+    The generation
+*/
+unsigned long BethYw::QueryEngine::generation() const {
+    return dataGeneration;
+}
+
+/*
+  The cache of rendered results, e.g. for its hit and miss counts.
+
+  @return
+    The QueryCache
+*/
+const BethYw::QueryCache& BethYw::QueryEngine::getCache() const {
+    return cache;
+}
+
+/*
+  QueryEngine::select(query)
+
+  Build the Areas object that importing the query's datasets with its
+  filters would have produced.
+
+  @param query
+    The Query to answer
+
+  @return
+    The Areas matching the query
+
+  @throws
+    std::out_of_range if one of the query's datasets has not been loaded
+
+  @example
+    BethYw::QueryEngine engine("datasets/");
+    auto query = BethYw::parseQueryLine("-d popden -a W06000011");
+    engine.load(query.datasets);
+    Areas areas = engine.select(query);
+*/
+Areas BethYw::QueryEngine::select(const Query& query) const {
+    Areas result = Areas();
+    names.filterInto(result, &query.areasFilter, nullptr, nullptr, true);
+
+    for (auto& code: query.datasets) {
+        auto it = datasets.find(code);
+        if (it == datasets.end()) {
+            throw std::out_of_range("Dataset has not been loaded: " + code);
+        }
+        it->second.filterInto(result,
+                              &query.areasFilter,
+                              &query.measuresFilter,
+                              &query.yearsFilter,
+                              false);
+    }
+    if (!query.where.empty()) {
+        result.retainAreas(matchWhere(query));
+    }
+    return result;
+}
+
+/*
+  QueryEngine::matchWhere(query)
+
+  Find the areas whose values pass every comparison in the query's --where
+  argument, using each dataset's ValueIndex rather than scanning its areas.
+
+  A value that passes in one dataset only counts if no later dataset in the
+  query has a value for the same area, measure and year, as the later value
+  is the one an import would keep. The comparisons use every imported value,
+  including measures and years the query's -m and -y filters leave out, as
+  those filters only choose what is output.
+
+  @param query
+    The Query, with a --where argument
+
+  @return
+    The authority codes of the areas passing every comparison
+
+  @throws
+    std::out_of_range if one of the query's datasets has not been loaded
+
+  @example
+    BethYw::QueryEngine engine("datasets/");
+    auto query = BethYw::parseQueryLine("-d popden --where pop@2015>100000");
+    engine.load(query.datasets);
+    auto codes = engine.matchWhere(query);
+*/
+StringFilterSet BethYw::QueryEngine::matchWhere(const Query& query) const {
+    StringFilterSet passing;
+    bool first = true;
+    for (auto& predicate: BethYw::parseWhereArg(query.where)) {
+        StringFilterSet matched;
+        for (size_t i = 0; i < query.datasets.size(); i++) {
+            if (!valueIndexes.count(query.datasets[i])) {
+                throw std::out_of_range("Dataset has not been loaded: " + query.datasets[i]);
+            }
+            for (auto& code: valueIndexes.at(query.datasets[i])->matching(predicate)) {
+                if (!query.areasFilter.empty() && !query.areasFilter.count(code)) {
+                    continue;
+                }
+                if (!first && !passing.count(code)) {
+                    continue;
+                }
+                bool replaced = false;
+                for (size_t later = i + 1; later < query.datasets.size() && !replaced; later++) {
+                    const Area *area = datasets.at(query.datasets[later]).findArea(code);
+                    const Measure *measure = area == nullptr ? nullptr : area->findMeasure(predicate.measure);
+                    replaced = measure != nullptr && measure->getData().count(predicate.year) != 0;
+                }
+                if (!replaced) {
+                    matched.insert(code);
+                }
+            }
+        }
+        passing.swap(matched);
+        first = false;
+    }
+    return passing;
+}
+
+/*
+  QueryEngine::hierarchy(file)
+
+  Find the hierarchy in a file in the datasets directory, reading it the
+  first time a query rolls up through it.
+
+  @param file
+    The name of the hierarchy file (as in the --rollup argument)
+
+  @return
+    The hierarchy
+
+  @throws
+    Any exception thrown by BethYw::loadHierarchy()
+*/
+const RollupTree& BethYw::QueryEngine::hierarchy(const std::string& file) const {
+    std::lock_guard<std::mutex> lock(hierarchiesMutex);
+    auto found = hierarchies.find(file);
+    if (found == hierarchies.end()) {
+        std::unique_ptr<const RollupTree> tree(new RollupTree(BethYw::loadHierarchy(dir, file)));
+        found = hierarchies.emplace(file, std::move(tree)).first;
+    }
+    return *found->second;
+}
+
+/*
+  QueryEngine::answer(query)
+
+  Answer a query, rendering the result as tables or JSON exactly as a single
+  run of the program would output it. Rendered results are cached by their
+  canonical query key, so repeating a query only costs the lookup.
+
+  @param query
+    The Query to answer
+
+  @return
+    The rendered output, ending with a new line
+
+  @example
+    BethYw::QueryEngine engine("datasets/");
+    auto query = BethYw::parseQueryLine("-d popden -a W06000011 -j");
+    engine.load(query.datasets);
+    std::cout << engine.answer(query);
+*/
+std::string BethYw::QueryEngine::answer(const Query& query) const {
+    const std::string key = BethYw::canonicalQueryKey(query);
+    std::string rendered;
+    if (cache.get(key, dataGeneration, rendered)) {
+        return rendered;
+    }
+
+    // The measure --aggregate wmean: weights by, and the measures --rollup
+    // computes ratios from, are selected even if -m leaves them out, and
+    // then left out of the result
+    Query selecting = query;
+    Aggregation aggregation;
+    if (!query.aggregate.empty()) {
+        aggregation = BethYw::parseAggregateArg(query.aggregate);
+        if (aggregation.function == Aggregation::Function::WMEAN) {
+            BethYw::widenFilters(selecting.measuresFilter, selecting.yearsFilter, aggregation.weight, 0);
+        }
+    }
+    if (!query.rollup.empty()) {
+        BethYw::widenForRollup(selecting.measuresFilter);
+    }
+
+    Areas result = select(selecting);
+    if (!query.rollup.empty()) {
+        result = hierarchy(query.rollup).rollup(result);
+    } else if (!query.aggregate.empty()) {
+        Areas aggregated = Areas();
+        aggregated.setArea(aggregation.code(), BethYw::aggregate(result, aggregation));
+        result = std::move(aggregated);
+    }
+    if (selecting.measuresFilter != query.measuresFilter) {
+        Areas output = Areas();
+        result.filterInto(output, nullptr, &query.measuresFilter, nullptr, true);
+        result = std::move(output);
+    }
+    if (!query.pivot.empty()) {
+        rendered = BethYw::pivot(result, query.pivot).render(query.format);
+    } else if (!query.by.empty()) {
+        rendered = BethYw::rank(result, BethYw::parseRankKey(query.by), query.top, query.ascending)
+                       .render(query.format);
+    } else if (query.format == OutputFormat::JSON) {
+        rendered = result.toJSON() + "\n";
+    } else if (query.format == OutputFormat::CSV) {
+        rendered = result.toDelimited(',');
+    } else if (query.format == OutputFormat::TSV) {
+        rendered = result.toDelimited('\t');
+    } else {
+        std::ostringstream output;
+        output << result << "\n";
+        rendered = output.str();
+    }
+    cache.put(key, dataGeneration, rendered);
+    return rendered;
+}
+
+/*
+  BethYw::runBatch(dir, batchFile, json, cacheBytes)
+
+  Answer every query in a batch file. Each non-empty line of the file (other
+  than those starting with #) is one query, written with the same syntax as
+  the -d/-a/-m/-y and output format arguments. All the lines are read first so
+  that the union of their datasets can be imported once, then the queries
+  are answered in parallel on the shared ThreadPool, and each result is
+  written (in the order of the file) to the standard output preceded by a line with # and the
+  query. Queries that cannot be parsed or answered are reported on the
+  standard error after their # line, and the rest of the batch is still
+  answered, followed by the result cache's hit and miss counts.
+
+  @param dir
+    The directory where the datasets are, ending with a directory separator
+
+  @param batchFile
+    Path to the batch file
+
+  @param json
+    Output every result as JSON when the query line doesn't choose another
+    format
+
+  @param cacheBytes
+    The memory budget, in bytes, for caching rendered results
+
+  @return
+    Exit code, which is 1 if any query couldn't be parsed or answered
+
+  @throws
+    std::runtime_error if the batch file cannot be opened, or any exception
+    thrown while importing the datasets
+
+  @example
+    BethYw::runBatch("datasets/", "queries.txt", false);
+*/
+int BethYw::runBatch(const std::string& dir,
+                     const std::string& batchFile,
+                     bool json,
+                     size_t cacheBytes) {
+    std::ifstream batch(batchFile);
+    if (!batch.is_open()) {
+        throw std::runtime_error("BethYw::runBatch: Failed to open batch file " + batchFile);
+    }
+
+    std::vector<std::string> lines;
+    std::vector<Query> queries;
+    std::vector<std::string> errors;
+    std::vector<std::string> datasetCodes;
+    std::string line;
+    while (std::getline(batch, line)) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos || line[0] == '#') {
+            continue;
+        }
+        if (line.back() == '\r') {
+            line.pop_back();
+        }
+
+        Query query;
+        std::string error;
+        try {
+            query = BethYw::parseQueryLine(line);
+            if (json && query.format == OutputFormat::TABLE) {
+                query.format = OutputFormat::JSON;
+            }
+            datasetCodes.insert(datasetCodes.end(), query.datasets.begin(), query.datasets.end());
+        } catch (std::exception const &e) {
+            error = e.what();
+        }
+        lines.push_back(line);
+        queries.push_back(query);
+        errors.push_back(error);
+    }
+
+    BethYw::QueryEngine engine(dir, cacheBytes);
+    engine.load(datasetCodes);
+
+    ThreadPool &pool = ThreadPool::shared();
+    std::vector<std::future<std::string>> answers;
+    for (unsigned int i = 0; i < lines.size(); i++) {
+        if (errors[i].empty()) {
+            const Query &query = queries[i];
+            answers.push_back(pool.submit([&engine, &query]() { return engine.answer(query); }));
+        } else {
+            answers.push_back(std::future<std::string>());
+        }
+    }
+
+    // Every answer is awaited, even after a query fails, as the tasks refer
+    // to engine and queries
+    OutputStdout output;
+    bool failed = false;
+    for (unsigned int i = 0; i < lines.size(); i++) {
+        output.write("# " + lines[i] + "\n");
+        if (errors[i].empty()) {
+            try {
+                output.write(pool.await(answers[i]));
+            } catch (std::exception const &e) {
+                errors[i] = e.what();
+            }
+        }
+        if (!errors[i].empty()) {
+            // Keep the error next to the query it belongs to
+            output.flush();
+            std::cerr << lines[i] << ": " << errors[i] << std::endl;
+            failed = true;
+        }
+    }
+    output.flush();
+
+    const QueryCache &cache = engine.getCache();
+    std::cerr << "Result cache: " << cache.hits() << " hits, "
+              << cache.misses() << " misses" << std::endl;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,129 @@
+#ifndef QUERY_H_
+#define QUERY_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  This file contains the declarations for answering many queries against data
+  that is only imported once. A Query is one combination of the -d/-a/-m/-y
+  and output format program arguments, and a QueryEngine holds every dataset it has imported
+  (unfiltered) so that each Query is answered by filtering the imported data
+  rather than by parsing the files again.
+ */
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "lib_cxxopts.hpp"
+
+#include "datasets.h"
+#include "areas.h"
+#include "bethyw.h"
+#include "cache.h"
+#include "rollup.h"
+#include "valueindex.h"
+
+namespace BethYw {
+
+/*
+  A single query, i.e. the filters and output format that would otherwise be
+  given to one run of the program.
+*/
+struct Query {
+  // Codes of the datasets to include, in the order they should be combined
+  std::vector<std::string> datasets;
+
+  StringFilterSet areasFilter;
+  StringFilterSet measuresFilter;
+  YearFilterTuple yearsFilter;
+
+  // How to output the result (never NDJSON, which needs a streaming import,
+  // or ARROW, which is written to a file)
+  OutputFormat format = OutputFormat::TABLE;
+  // The year or authority code to pivot on (see BethYw::pivot), if any
+  std::string pivot;
+  // The number of areas to rank (see BethYw::rank), if not 0, by what, and
+  // whether the lowest values come first
+  unsigned int top = 0;
+  std::string by;
+  bool ascending = false;
+  // Comparisons an area's values must pass (see BethYw::parseWhereArg), if any
+  std::string where;
+  // How to combine the selected areas into one (see BethYw::aggregate), if
+  // they should be
+  std::string aggregate;
+  // The hierarchy file in the datasets directory to roll the selected areas
+  // up through (see RollupTree::rollup), if any
+  std::string rollup;
+};
+
+/*
+  Build a Query from parsed program arguments.
+*/
+Query parseQuery(cxxopts::ParseResult& args);
+
+/*
+  Build a Query from a line of program arguments, e.g.
+  "-d popden -a W06000011 -y 2010-2015".
+*/
+Query parseQueryLine(const std::string& line);
+
+/*
+  Holds the areas.csv names and every imported dataset, each kept separately
+  and unfiltered, and answers Query objects from them.
+*/
+class QueryEngine {
+public:
+  QueryEngine(const std::string& dir, size_t cacheBytes = DEFAULT_CACHE_MB * 1024 * 1024);
+
+  void load(const std::vector<std::string>& datasetCodes);
+  bool isLoaded(const std::string& datasetCode) const;
+  unsigned long generation() const;
+
+  Areas select(const Query& query) const;
+  StringFilterSet matchWhere(const Query& query) const;
+  std::string answer(const Query& query) const;
+  const QueryCache& getCache() const;
+
+private:
+  const RollupTree& hierarchy(const std::string& file) const;
+
+  std::string dir;
+  Areas names;
+  std::map<std::string, Areas> datasets;
+
+  // An index of each dataset's values for --where, whose columns are only
+  // built when a query first compares them
+  std::map<std::string, std::unique_ptr<ValueIndex>> valueIndexes;
+
+  // The hierarchy in each file --rollup has used, read when a query first
+  // uses it and never changed after
+  mutable std::mutex hierarchiesMutex;
+  mutable std::map<std::string, std::unique_ptr<const RollupTree>> hierarchies;
+
+  // Incremented whenever the imported data changes, invalidating the cache
+  unsigned long dataGeneration;
+
+  // Rendered results are cached even though answering is a const operation
+  mutable QueryCache cache;
+};
+
+/*
+  Answer every query in a batch file (one query per line) against a single
+  import of the datasets they use.
+*/
+int runBatch(const std::string& dir,
+             const std::string& batchFile,
+             bool json,
+             size_t cacheBytes = DEFAULT_CACHE_MB * 1024 * 1024);
+
+} // namespace BethYw
+
+#endif // QUERY_H_
@@ -0,0 +1,426 @@
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  This file contains the implementation of Ranking and of BethYw::rank(),
+  which picks the top (or bottom) k areas. See ranking.h for an overview.
+
+  Ranking doesn't sort every area: the statistic is read into a single
+  column of (value, area) pairs, std::nth_element moves the k best to the
+  front in linear time, and only those k are sorted.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "lib_json.hpp"
+
+#include "areas.h"
+#include "bethyw.h"
+#include "output.h"
+#include "ranking.h"
+
+using json = nlohmann::json;
+
+/*
+  RankKey::describe()
+
+  @return
+    What the key ranks by, in words, e.g. "dens in 2018"
+*/
+std::string RankKey::describe() const {
+    const std::string range = std::to_string(year) + "-" + std::to_string(lastYear);
+    switch (statistic) {
+        case Statistic::YEAR:
+            return measure + " in " + std::to_string(year);
+        case Statistic::RANGE_SUM:
+            return "total " + measure + " in " + range;
+        case Statistic::RANGE_AVERAGE:
+            return "average " + measure + " in " + range;
+        case Statistic::RANGE_MIN:
+            return "minimum " + measure + " in " + range;
+        case Statistic::RANGE_MAX:
+            return "maximum " + measure + " in " + range;
+        case Statistic::DIFF:
+            return "difference in " + measure;
+        case Statistic::PDIFF:
+            return "% difference in " + measure;
+        default:
+            return "average " + measure;
+    }
+}
+
+/*
+  @return
+    true if the key's statistic is over a range of years
+*/
+bool RankKey::isRange() const {
+    return statistic == Statistic::RANGE_SUM || statistic == Statistic::RANGE_AVERAGE
+           || statistic == Statistic::RANGE_MIN || statistic == Statistic::RANGE_MAX;
+}
+
+/*
+  RankKey::valueOf(values)
+
+  Find the key's statistic of a measure's values, with a range answered by
+  Measure::rangeStats().
+
+  @param values
+    The Measure
+
+  @return
+    The statistic, or NaN if the measure has no value for the year or none
+    in the range
+
+  @example
+    auto key = BethYw::parseRankKey("pop:max:2010-2015");
+    double highest = key.valueOf(area.getMeasure("pop"));
+*/
+double RankKey::valueOf(const Measure& values) const {
+    const double none = std::numeric_limits<double>::quiet_NaN();
+    if (isRange()) {
+        const RangeStats stats = values.rangeStats(year, lastYear);
+        if (stats.count == 0) {
+            return none;
+        }
+        switch (statistic) {
+            case Statistic::RANGE_SUM:
+                return stats.sum;
+            case Statistic::RANGE_MIN:
+                return stats.min;
+            case Statistic::RANGE_MAX:
+                return stats.max;
+            default:
+                return stats.average;
+        }
+    }
+
+    if (values.size() == 0) {
+        return none;
+    }
+    switch (statistic) {
+        case Statistic::YEAR: {
+            auto found = values.getData().find(year);
+            return found == values.getData().end() ? none : found->second;
+        }
+        case Statistic::DIFF:
+            return values.getDifference();
+        case Statistic::PDIFF:
+            return values.getDifferenceAsPercentage();
+        default:
+            return values.getAverage();
+    }
+}
+
+/*
+  Ranking::Ranking(title, areas)
+
+  Construct a ranking.
+
+  @param title
+    What the ranking shows, printed above it as a table
+
+  @param areas
+    The ranked areas, best first
+*/
+Ranking::Ranking(const std::string& title, const std::vector<RankedArea>& areas)
+    : title(title), areas(areas) {}
+
+/*
+  @return
+    The ranked areas, best first
+*/
+const std::vector<RankedArea>& Ranking::getAreas() const {
+    return areas;
+}
+
+/*
+  Ranking::toJSON()
+
+  Render the ranking as a JSON array with an object (rank, area, name and
+  value) for each area, best first.
+
+  @return
+    std::string of JSON
+
+  @example
+    // [{"area":"W06000011","name":"Swansea","rank":1,"value":244513.0}]
+    std::cout << ranking.toJSON();
+*/
+std::string Ranking::toJSON() const {
+    json j = json::array();
+    for (size_t i = 0; i < areas.size(); i++) {
+        j.push_back({{"rank", i + 1},
+                     {"area", areas[i].code},
+                     {"name", areas[i].name},
+                     {"value", areas[i].value}});
+    }
+    return j.dump();
+}
+
+/*
+  Ranking::toDelimited(separator)
+
+  Render the ranking as CSV or TSV, with a header row then a row of rank,
+  authority_code, name and value for each area.
+
+  @param separator
+    The character between fields, ',' for CSV or '\t' for TSV
+
+  @return
+    The rows, each ending with a new line
+*/
+std::string Ranking::toDelimited(char separator) const {
+    std::string text = "rank";
+    for (const char *column: {"authority_code", "name", "value"}) {
+        text += separator;
+        text += column;
+    }
+    text += '\n';
+
+    char number[BethYw::NUMBER_BUFFER_SIZE];
+    for (size_t i = 0; i < areas.size(); i++) {
+        text += std::to_string(i + 1);
+        text += separator;
+        BethYw::appendField(text, areas[i].code, separator);
+        text += separator;
+        BethYw::appendField(text, areas[i].name, separator);
+        text += separator;
+        text.append(number, BethYw::formatNumber(areas[i].value, number));
+        text += '\n';
+    }
+    return text;
+}
+
+/*
+  Ranking::render(format)
+
+  Render the ranking in an output format.
+
+  @param format
+    TABLE, JSON, CSV or TSV
+
+  @return
+    The rendered ranking, ending with a new line
+
+  @throws
+    std::invalid_argument for any other format
+*/
+std::string Ranking::render(BethYw::OutputFormat format) const {
+    switch (format) {
+        case BethYw::OutputFormat::TABLE: {
+            std::ostringstream table;
+            table << *this << "\n";
+            return table.str();
+        }
+        case BethYw::OutputFormat::JSON:
+            return toJSON() + "\n";
+        case BethYw::OutputFormat::CSV:
+            return toDelimited(',');
+        case BethYw::OutputFormat::TSV:
+            return toDelimited('\t');
+        default:
+            throw std::invalid_argument("--top can only be output as a table, JSON, CSV or TSV");
+    }
+}
+
+/*
+  operator<<(os, ranking)
+
+  Print the ranking with its title, a line per area with its rank,
+  authority code, value (in a column as wide as a Measure's) and name.
+
+  @param os
+    The output stream to write to
+
+  @param ranking
+    The Ranking to write
+
+  @return
+    Reference to the output stream
+
+  @example
+    // Top 1 areas by pop in 2015
+    // Rank Authority code          Value Name
+    //    1      W06000011  244513.000000 Swansea
+    std::cout << ranking;
+*/
+std::ostream &operator<<(std::ostream &os, const Ranking &ranking) {
+    const int tabVal = 14;
+    const int precision = 6;
+
+    os << ranking.title << "\n";
+    os << std::setw(4) << "Rank" << " " << std::setw(tabVal) << "Authority code"
+       << " " << std::setw(tabVal) << "Value" << " Name\n";
+
+    const std::ios_base::fmtflags flags = os.flags();
+    const std::streamsize oldPrecision = os.precision();
+    os << std::fixed << std::setprecision(precision);
+    for (size_t i = 0; i < ranking.areas.size(); i++) {
+        const RankedArea &area = ranking.areas[i];
+        os << std::setw(4) << i + 1 << " " << std::setw(tabVal) << area.code
+           << " " << std::setw(tabVal) << area.value << " " << area.name << "\n";
+    }
+    os.flags(flags);
+    os.precision(oldPrecision);
+    return os;
+}
+
+/*
+  BethYw::parseRankKey(by)
+
+  Parse the --by argument: a measure codename, optionally followed by a
+  colon and a year (YYYY), avg, diff or pdiff, or by a colon, one of sum,
+  avg, min or max, another colon and a range of years (YYYY-YYYY, in either
+  order). Without one, areas are ranked by the measure's average.
+
+  @param by
+    The argument
+
+  @return
+    The RankKey
+
+  @throws
+    std::invalid_argument if the statistic is none of these, with the
+    message: Invalid input for by argument
+
+  @example
+    auto key = BethYw::parseRankKey("dens:2018");
+    auto range = BethYw::parseRankKey("pop:avg:2010-2015");
+*/
+RankKey BethYw::parseRankKey(const std::string& by) {
+    RankKey key;
+    const size_t colon = by.find(':');
+    key.measure = Areas::toLower(by.substr(0, colon));
+    if (key.measure.empty()) {
+        throw std::invalid_argument("Invalid input for by argument");
+    }
+    if (colon == std::string::npos) {
+        return key;
+    }
+
+    std::string statistic = Areas::toLower(by.substr(colon + 1));
+    const size_t rangeColon = statistic.find(':');
+    if (rangeColon != std::string::npos) {
+        const std::string function = statistic.substr(0, rangeColon);
+        const std::string range = statistic.substr(rangeColon + 1);
+        std::string first = range.substr(0, 4);
+        std::string last = range.size() > 5 ? range.substr(5) : "";
+        if (range.size() != 9 || range[4] != '-' || !BethYw::yearIsNumber(first) || !BethYw::yearIsNumber(last)) {
+            throw std::invalid_argument("Invalid input for by argument");
+        }
+        if (function == "sum") {
+            key.statistic = RankKey::Statistic::RANGE_SUM;
+        } else if (function == "avg") {
+            key.statistic = RankKey::Statistic::RANGE_AVERAGE;
+        } else if (function == "min") {
+            key.statistic = RankKey::Statistic::RANGE_MIN;
+        } else if (function == "max") {
+            key.statistic = RankKey::Statistic::RANGE_MAX;
+        } else {
+            throw std::invalid_argument("Invalid input for by argument");
+        }
+        key.year = std::min(std::stoi(first), std::stoi(last));
+        key.lastYear = std::max(std::stoi(first), std::stoi(last));
+        return key;
+    }
+    if (statistic == "avg") {
+        key.statistic = RankKey::Statistic::AVERAGE;
+    } else if (statistic == "diff") {
+        key.statistic = RankKey::Statistic::DIFF;
+    } else if (statistic == "pdiff") {
+        key.statistic = RankKey::Statistic::PDIFF;
+    } else if (statistic.size() == 4 && BethYw::yearIsNumber(statistic)) {
+        key.statistic = RankKey::Statistic::YEAR;
+        key.year = std::stoi(statistic);
+    } else {
+        throw std::invalid_argument("Invalid input for by argument");
+    }
+    return key;
+}
+
+/*
+  BethYw::rank(areas, key, k, ascending)
+
+  Find the k areas with the highest (or, if ascending, the lowest) value of
+  a statistic of a measure. Areas without the measure, without a value for
+  the year or in the range, or whose statistic is not a number are left
+  out. Ties are
+  broken by authority code.
+
+  @param areas
+    The imported areas
+
+  @param key
+    The measure and statistic to rank by
+
+  @param k
+    The most areas to return
+
+  @param ascending
+    Rank the lowest values first instead of the highest
+
+  @return
+    The Ranking, best first
+
+  @example
+    Areas areas;
+    ...
+    // The 5 areas with the highest population density in 2018
+    std::cout << BethYw::rank(areas, BethYw::parseRankKey("dens:2018"), 5, false);
+*/
+Ranking BethYw::rank(const Areas& areas, const RankKey& key, size_t k, bool ascending) {
+    struct Candidate {
+        double value;
+        const std::string *code;
+        const Area *area;
+    };
+
+    std::vector<Candidate> column;
+    column.reserve(areas.size());
+    for (auto& codeArea: areas) {
+        const Measure *measure = codeArea.second.findMeasure(key.measure);
+        if (measure == nullptr) {
+            continue;
+        }
+        const double value = key.valueOf(*measure);
+        if (!std::isnan(value)) {
+            column.push_back({value, &codeArea.first, &codeArea.second});
+        }
+    }
+
+    auto better = [ascending](const Candidate& lhs, const Candidate& rhs) {
+        if (lhs.value != rhs.value) {
+            return ascending ? lhs.value < rhs.value : lhs.value > rhs.value;
+        }
+        return *lhs.code < *rhs.code;
+    };
+    k = std::min(k, column.size());
+    if (k < column.size()) {
+        std::nth_element(column.begin(), column.begin() + k, column.end(), better);
+    }
+    std::sort(column.begin(), column.begin() + k, better);
+
+    std::vector<RankedArea> ranked;
+    for (size_t i = 0; i < k; i++) {
+        const auto names = column[i].area->getNamesMap();
+        const auto english = names.find("eng");
+        ranked.push_back({*column[i].code, english == names.end() ? "" : english->second, column[i].value});
+    }
+
+    const std::string title = std::string(ascending ? "Bottom " : "Top ") + std::to_string(k)
+                              + " areas by " + key.describe();
+    return Ranking(title, ranked);
+}
@@ -0,0 +1,85 @@
+#ifndef RANKING_H_
+#define RANKING_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  This file contains the declarations for ranking areas by a statistic of
+  one of their measures, used for --top K --by <measure>[:<statistic>].
+  The statistic is a year's value, the average, difference or percentage
+  difference printed at the end of a measure's table, or the sum, average,
+  minimum or maximum over a range of years (e.g. pop:avg:2010-2015). A range
+  is answered by Measure::rangeStats(), so when the data was imported once
+  and indexed (--batch and --serve) it takes constant time per area.
+ */
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "bethyw.h"
+#include "measure.h"
+
+/*
+  What areas are ranked by: a measure, and which of its statistics.
+*/
+struct RankKey {
+  enum class Statistic { YEAR, AVERAGE, DIFF, PDIFF, RANGE_SUM, RANGE_AVERAGE, RANGE_MIN, RANGE_MAX };
+
+  std::string measure;
+  Statistic statistic = Statistic::AVERAGE;
+  // The year, or the first year of a range
+  int year = 0;
+  // The last year of a range
+  int lastYear = 0;
+
+  bool isRange() const;
+  double valueOf(const Measure& values) const;
+  std::string describe() const;
+};
+
+/*
+  An area's place in a Ranking.
+*/
+struct RankedArea {
+  std::string code;
+  std::string name;
+  double value;
+};
+
+class Ranking {
+public:
+  Ranking(const std::string& title, const std::vector<RankedArea>& areas);
+
+  const std::vector<RankedArea>& getAreas() const;
+
+  std::string toJSON() const;
+  std::string toDelimited(char separator) const;
+  std::string render(BethYw::OutputFormat format) const;
+  friend std::ostream &operator<<(std::ostream &os, const Ranking &ranking);
+
+private:
+  std::string title;
+  std::vector<RankedArea> areas;
+};
+
+namespace BethYw {
+
+/*
+  Parse the --by argument, e.g. "dens:2018", "rail:pdiff", "pop:avg:2010-2015"
+  or "pop".
+*/
+RankKey parseRankKey(const std::string& by);
+
+/*
+  The k areas with the highest (or lowest) values of a statistic.
+*/
+Ranking rank(const Areas& areas, const RankKey& key, size_t k, bool ascending);
+
+} // namespace BethYw
+
+#endif // RANKING_H_
@@ -0,0 +1,372 @@
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  This file contains the implementation of RollupTree. See rollup.h for an
+  overview.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "areas.h"
+#include "csvscanner.h"
+#include "measure.h"
+#include "rollup.h"
+
+namespace {
+
+/*
+  The measures whose values can be added up across areas.
+*/
+const std::set<std::string> ADDITIVE_MEASURES = {"area", "births", "deaths", "pop", "rail"};
+
+/*
+  The measures that are the ratio of two additive measures, with the
+  codenames of the numerator and denominator.
+*/
+const std::map<std::string, std::pair<std::string, std::string>> RATIO_MEASURES = {
+    {"dens", {"pop", "area"}}
+};
+
+/*
+  Add a value to a measure's value for a year, treating a missing value
+  as 0.
+*/
+void add(Measure& into, int year, double value) {
+    auto found = into.getData().find(year);
+    into.setValue(year, found == into.getData().end() ? value : found->second + value);
+}
+
+} // namespace
+
+/*
+  RollupTree::RollupTree()
+
+  Construct an empty hierarchy.
+
+  @example
+    RollupTree tree;
+    std::ifstream file("datasets/regions.csv");
+    tree.populateFromCSV(file);
+*/
+RollupTree::RollupTree() : nodes(), indexes(), bottomUp() {}
+
+/*
+  Find an area's node, adding one if it isn't in the hierarchy yet.
+*/
+size_t RollupTree::node(const std::string& code) {
+    auto found = indexes.find(code);
+    if (found != indexes.end()) {
+        return found->second;
+    }
+    Node added;
+    added.code = code;
+    nodes.push_back(std::move(added));
+    indexes.insert({code, nodes.size() - 1});
+    return nodes.size() - 1;
+}
+
+/*
+  RollupTree::populateFromCSV(is)
+
+  Read the hierarchy from a CSV file with a header row and then a row for
+  each child area: its authority code, its parent's code and, optionally,
+  the parent's English name. Codes are uppercased, as in areas.csv.
+
+  @param is
+    The input stream of the file
+
+  @return
+    void
+
+  @throws
+    std::runtime_error if a row has no parent, an area is given two
+    different parents, or the parents form a cycle
+
+  @example
+    RollupTree tree;
+    std::ifstream file("datasets/regions.csv");
+    tree.populateFromCSV(file);
+*/
+void RollupTree::populateFromCSV(std::istream& is) {
+    const std::string content((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    CsvScanner scanner(content.data(), content.size());
+    CsvField field;
+
+    // Ignore column titles
+    scanner.startRow();
+    while (scanner.startRow()) {
+        if (!scanner.nextField(field) || field.empty()) {
+            continue;
+        }
+        const std::string childCode = Areas::toUpper(field.str());
+        if (!scanner.nextField(field) || field.empty()) {
+            throw std::runtime_error("RollupTree::populateFromCSV: Missing parent for " + childCode);
+        }
+        const std::string parentCode = Areas::toUpper(field.str());
+
+        const size_t child = node(childCode);
+        const size_t parent = node(parentCode);
+        if (nodes[child].parent != -1 && nodes[child].parent != (long) parent) {
+            throw std::runtime_error("RollupTree::populateFromCSV: More than one parent for " + childCode);
+        }
+        if (nodes[child].parent == -1) {
+            nodes[child].parent = parent;
+            nodes[parent].children++;
+        }
+        if (scanner.nextField(field) && !field.empty()) {
+            nodes[parent].names["eng"] = field.str();
+        }
+    }
+    order();
+}
+
+/*
+  Find the depth of every node and sort them deepest first, so that each
+  node is visited after all of its children, then count the areas with no
+  children under each.
+*/
+void RollupTree::order() {
+    for (auto& current: nodes) {
+        current.depth = 0;
+        for (long above = current.parent; above != -1; above = nodes[above].parent) {
+            if (++current.depth > nodes.size()) {
+                throw std::runtime_error("RollupTree::populateFromCSV: The parents of "
+                                         + current.code + " form a cycle");
+            }
+        }
+    }
+
+    bottomUp.resize(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++) {
+        bottomUp[i] = i;
+    }
+    std::stable_sort(bottomUp.begin(), bottomUp.end(), [this](size_t lhs, size_t rhs) {
+        return nodes[lhs].depth > nodes[rhs].depth;
+    });
+
+    for (auto& current: nodes) {
+        current.leaves = current.children == 0 ? 1 : 0;
+    }
+    for (size_t index: bottomUp) {
+        if (nodes[index].parent != -1) {
+            nodes[nodes[index].parent].leaves += nodes[index].leaves;
+        }
+    }
+}
+
+/*
+  @return
+    The number of areas in the hierarchy
+*/
+size_t RollupTree::size() const {
+    return nodes.size();
+}
+
+/*
+  RollupTree::rollup(areas, leftOut)
+
+  Compute the values of every parent in the hierarchy from the imported
+  areas. Areas with no children take their values from areas (and have none
+  if they weren't imported), and every parent's value of an additive measure
+  (e.g. pop or area) in a year is the sum of its children's. A ratio measure
+  (dens, i.e. pop / area) is computed from the parent's sums in each year
+  they both have, if the areas have it, and is labelled as such. Any other
+  measure can't be added up, so is left out. Values that are not a number
+  are left out too.
+
+  A parent takes its names from the hierarchy file, or from areas if the
+  file doesn't name it. If some of the areas under a parent weren't imported
+  (e.g. because -a leaves them out), its English name says how many were,
+  as its values are then only a partial sum.
+
+  @param areas
+    The imported areas
+
+  @param leftOut
+    If not null, the codenames of the measures that were left out are added
+    to it
+
+  @return
+    An Areas with an Area for each parent in the hierarchy that has any
+    values, with its names and computed values
+
+  @example
+    Areas data = Areas();
+    BethYw::loadDatasets(data, ...);
+    RollupTree tree = BethYw::loadHierarchy("datasets/", "regions.csv");
+    std::cout << tree.rollup(data);
+*/
+Areas RollupTree::rollup(const Areas& areas, std::set<std::string>* leftOut) const {
+    std::vector<std::map<std::string, Measure>> sums(nodes.size());
+    std::vector<size_t> imported(nodes.size(), 0);
+    // The labels of the ratio measures the areas have
+    std::map<std::string, std::string> ratios;
+
+    for (size_t index = 0; index < nodes.size(); index++) {
+        const Area *area = nodes[index].children == 0 ? areas.findArea(nodes[index].code) : nullptr;
+        if (area == nullptr) {
+            continue;
+        }
+        for (const Measure *measure: area->sortedMeasures()) {
+            const std::string &code = measure->getCodename();
+            if (ADDITIVE_MEASURES.count(code)) {
+                sums[index].emplace(code, *measure);
+            } else if (RATIO_MEASURES.count(code)) {
+                ratios.emplace(code, measure->getLabel());
+            } else if (leftOut != nullptr) {
+                leftOut->insert(code);
+            }
+        }
+        imported[index] = sums[index].empty() ? 0 : 1;
+    }
+
+    for (size_t index: bottomUp) {
+        const long parent = nodes[index].parent;
+        if (parent == -1) {
+            continue;
+        }
+        imported[parent] += imported[index];
+        for (auto& codeMeasure: sums[index]) {
+            auto into = sums[parent].find(codeMeasure.first);
+            if (into == sums[parent].end()) {
+                into = sums[parent].emplace(codeMeasure.first,
+                                            Measure(codeMeasure.first, codeMeasure.second.getLabel())).first;
+            }
+            for (auto& yearValue: codeMeasure.second.getData()) {
+                if (!std::isnan(yearValue.second)) {
+                    add(into->second, yearValue.first, yearValue.second);
+                }
+            }
+        }
+    }
+
+    Areas parents = Areas();
+    for (size_t index = 0; index < nodes.size(); index++) {
+        const Node &current = nodes[index];
+        if (current.children == 0 || sums[index].empty()) {
+            continue;
+        }
+        Area area(current.code);
+        for (auto& codeMeasure: sums[index]) {
+            area.setMeasure(codeMeasure.first, codeMeasure.second);
+        }
+        for (auto& codeLabel: ratios) {
+            const auto &parts = RATIO_MEASURES.at(codeLabel.first);
+            auto numerator = sums[index].find(parts.first);
+            auto denominator = sums[index].find(parts.second);
+            if (numerator == sums[index].end() || denominator == sums[index].end()) {
+                continue;
+            }
+            Measure ratio(codeLabel.first, codeLabel.second + " (" + parts.first + " / " + parts.second + ")");
+            for (auto& yearValue: numerator->second.getData()) {
+                auto below = denominator->second.getData().find(yearValue.first);
+                if (below != denominator->second.getData().end() && below->second != 0) {
+                    ratio.setValue(yearValue.first, yearValue.second / below->second);
+                }
+            }
+            if (ratio.size() != 0) {
+                area.setMeasure(codeLabel.first, ratio);
+            }
+        }
+
+        std::map<std::string, std::string> names = current.names;
+        const Area *named = names.empty() ? areas.findArea(current.code) : nullptr;
+        if (named != nullptr) {
+            names = named->getNamesMap();
+        }
+        if (imported[index] < current.leaves) {
+            std::string &eng = names["eng"];
+            eng += (eng.empty() ? "" : " ") + std::string("(partial: ") + std::to_string(imported[index])
+                   + " of " + std::to_string(current.leaves) + " areas)";
+        }
+        for (auto& langName: names) {
+            area.setName(langName.first, langName.second);
+        }
+        parents.setArea(current.code, std::move(area));
+    }
+    return parents;
+}
+
+/*
+  BethYw::loadHierarchy(dir, file)
+
+  Read a hierarchy (see RollupTree::populateFromCSV) from a file in the
+  datasets directory.
+
+  @param dir
+    The directory where the datasets are, ending with a directory separator
+
+  @param file
+    The name of the hierarchy file, which must be in dir
+
+  @return
+    The hierarchy
+
+  @throws
+    std::invalid_argument if file names a directory, or
+    std::runtime_error if it can't be read or isn't a valid hierarchy
+
+  @example
+    Areas data = Areas();
+    BethYw::loadDatasets(data, ...);
+    std::cout << BethYw::loadHierarchy("datasets/", "regions.csv").rollup(data);
+*/
+RollupTree BethYw::loadHierarchy(const std::string& dir, const std::string& file) {
+    if (file.empty() || file.find_first_of("/\\") != std::string::npos || file == "." || file == "..") {
+        throw std::invalid_argument("--rollup must be the name of a file in the datasets directory");
+    }
+
+    std::ifstream input(dir + file);
+    if (!input.is_open()) {
+        throw std::runtime_error("BethYw::loadHierarchy: Failed to open hierarchy file " + dir + file);
+    }
+    RollupTree tree;
+    tree.populateFromCSV(input);
+    return tree;
+}
+
+/*
+  BethYw::widenForRollup(measuresFilter)
+
+  Widen the measures filter given to loadDatasets() so that the measures
+  RollupTree::rollup() computes a ratio measure from are imported whenever
+  the ratio is. They must be filtered out again before output, e.g. with
+  Areas::filterInto().
+
+  @param measuresFilter
+    The measures filter to widen (left as it is if empty, i.e. all measures)
+
+  @return
+    void
+
+  @example
+    auto importMeasures = BethYw::parseMeasuresArg(args);
+    BethYw::widenForRollup(importMeasures);
+*/
+void BethYw::widenForRollup(StringFilterSet& measuresFilter) {
+    if (measuresFilter.empty()) {
+        return;
+    }
+    for (auto& codeParts: RATIO_MEASURES) {
+        if (measuresFilter.count(codeParts.first)) {
+            measuresFilter.insert(codeParts.second.first);
+            measuresFilter.insert(codeParts.second.second);
+        }
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef ROLLUP_H_
+#define ROLLUP_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  This file contains the declaration of RollupTree, a hierarchy of areas
+  (e.g. authorities within regions, regions within a country) used for
+  --rollup. The hierarchy is read from a CSV file like areas.csv, with a row
+  for each child:
+
+    Child code,Parent code,Parent name (eng)
+
+  where the name is optional. A parent can itself be the child of another.
+
+  rollup() computes every parent's values from the imported areas in a single
+  bottom-up pass: each area is visited once, deepest first, and its values
+  (read from the Areas for an area with no children) are added to its
+  parent's. Only measures that can be added up across areas (counts, such as
+  the population, and land area) are summed. A ratio of two of them, such as
+  population density, is computed again for each parent from its sums, and
+  any other measure (e.g. a concentration) is left out.
+
+  The hierarchy doesn't change once read, so one RollupTree can roll up any
+  number of Areas, including from several threads at once.
+ */
+
+#include <istream>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "areas.h"
+#include "measure.h"
+
+class RollupTree {
+public:
+  RollupTree();
+
+  void populateFromCSV(std::istream& is);
+
+  size_t size() const;
+  Areas rollup(const Areas& areas, std::set<std::string>* leftOut = nullptr) const;
+
+private:
+  struct Node {
+    std::string code;
+    std::map<std::string, std::string> names;
+    // Index of the parent in nodes, or -1 for the top of the hierarchy
+    long parent = -1;
+    size_t children = 0;
+    size_t depth = 0;
+    // The number of areas with no children at or below this one
+    size_t leaves = 0;
+  };
+
+  size_t node(const std::string& code);
+  void order();
+
+  std::vector<Node> nodes;
+  std::unordered_map<std::string, size_t> indexes;
+
+  // Indexes of the nodes, deepest first
+  std::vector<size_t> bottomUp;
+};
+
+namespace BethYw {
+
+/*
+  Read the hierarchy in a file in the datasets directory.
+*/
+RollupTree loadHierarchy(const std::string& dir, const std::string& file);
+
+/*
+  Widen a measures filter to import what --rollup computes ratios from.
+*/
+void widenForRollup(StringFilterSet& measuresFilter);
+
+} // namespace BethYw
+
+#endif // ROLLUP_H_
@@ -0,0 +1,469 @@
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  This file contains the implementation of the resident query server and its
+  client. The server imports every dataset once into a QueryEngine, which is
+  never modified afterwards, so a fixed pool of worker threads can answer
+  queries from it concurrently without any locking. The main thread only
+  accepts connections and hands them to the workers through a queue.
+
+  Unix domain sockets are only available on POSIX systems, so on Windows both
+  functions throw a std::runtime_error.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "datasets.h"
+#include "output.h"
+#include "query.h"
+#include "server.h"
+
+#ifndef _WIN32
+
+namespace {
+
+/*
+  The longest request line the server will accept, in bytes.
+*/
+constexpr size_t MAX_REQUEST_BYTES = 64 * 1024;
+
+/*
+  The most connections that can be waiting for a free worker.
+*/
+constexpr size_t MAX_PENDING_CONNECTIONS = 1024;
+
+#ifdef MSG_NOSIGNAL
+constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+constexpr int SEND_FLAGS = 0;
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+volatile std::sig_atomic_t stopRequested = 0;
+
+void requestStop(int) {
+    stopRequested = 1;
+}
+
+/*
+  Milliseconds left until deadline, or 0 if it has passed.
+*/
+int remainingMs(const Clock::time_point& deadline) {
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+    if (left <= 0) {
+        return 0;
+    }
+    return static_cast<int>(std::min<decltype(left)>(left, std::numeric_limits<int>::max()));
+}
+
+/*
+  Wait until fd is ready for events, or the deadline passes.
+
+  @return
+    true if fd is ready
+*/
+bool waitFor(int fd, short events, const Clock::time_point& deadline) {
+    while (true) {
+        int left = remainingMs(deadline);
+        if (left == 0) {
+            return false;
+        }
+        pollfd pfd = {fd, events, 0};
+        int ready = poll(&pfd, 1, left);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        return ready > 0;
+    }
+}
+
+/*
+  Read a single line (without its new line) from fd before the deadline.
+
+  @return
+    true if a complete line was read
+*/
+bool readLine(int fd, std::string& line, const Clock::time_point& deadline) {
+    char buffer[4096];
+    while (waitFor(fd, POLLIN, deadline)) {
+        ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        } else if (received <= 0) {
+            // The client may close its end without a final new line
+            return received == 0 && !line.empty();
+        }
+
+        line.append(buffer, received);
+        size_t newLine = line.find('\n');
+        if (newLine != std::string::npos) {
+            line.resize(newLine);
+            return true;
+        } else if (line.size() > MAX_REQUEST_BYTES) {
+            return false;
+        }
+    }
+    return false;
+}
+
+/*
+  Write all of data to fd before the deadline.
+
+  @return
+    true if everything was written
+*/
+bool writeAll(int fd, const std::string& data, const Clock::time_point& deadline) {
+    size_t written = 0;
+    while (written < data.size()) {
+        if (!waitFor(fd, POLLOUT, deadline)) {
+            return false;
+        }
+        ssize_t sent = send(fd, data.data() + written, data.size() - written, SEND_FLAGS);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        } else if (sent <= 0) {
+            return false;
+        }
+        written += sent;
+    }
+    return true;
+}
+
+/*
+  A queue of accepted connections waiting for a worker. pop() blocks until a
+  connection is available or the queue has been closed.
+*/
+class ConnectionQueue {
+public:
+    bool push(int fd) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (closed || pending.size() >= MAX_PENDING_CONNECTIONS) {
+            return false;
+        }
+        pending.push(fd);
+        available.notify_one();
+        return true;
+    }
+
+    bool pop(int& fd) {
+        std::unique_lock<std::mutex> lock(mutex);
+        available.wait(lock, [this] { return closed || !pending.empty(); });
+        if (pending.empty()) {
+            return false;
+        }
+        fd = pending.front();
+        pending.pop();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        available.notify_all();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable available;
+    std::queue<int> pending;
+    bool closed = false;
+};
+
+/*
+  Answer the single request on a connection, then close it.
+*/
+void handleConnection(int fd, const BethYw::QueryEngine& snapshot, unsigned int timeoutMs) {
+    const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+
+    std::string line;
+    if (!readLine(fd, line, deadline)) {
+        // Allow the error itself a fresh timeout, the original has passed
+        writeAll(fd, "ERR Request timed out or was too long\n",
+                 Clock::now() + std::chrono::milliseconds(timeoutMs));
+        ::close(fd);
+        return;
+    }
+
+    std::string response;
+    if (line == "stats") {
+        const BethYw::QueryCache &cache = snapshot.getCache();
+        response = "OK\nhits=" + std::to_string(cache.hits())
+                   + " misses=" + std::to_string(cache.misses())
+                   + " entries=" + std::to_string(cache.entries())
+                   + " bytes=" + std::to_string(cache.bytes()) + "\n";
+        writeAll(fd, response, deadline);
+        ::close(fd);
+        return;
+    }
+
+    // The answer is written after the status line without joining them, as
+    // it may be large
+    std::string status = "OK\n";
+    std::string answer;
+    try {
+        BethYw::Query query = BethYw::parseQueryLine(line);
+        answer = snapshot.answer(query);
+    } catch (std::exception const &e) {
+        std::string message = e.what();
+        for (auto& c: message) {
+            if (c == '\n') {
+                c = ' ';
+            }
+        }
+        status = "ERR " + message + "\n";
+    }
+
+    try {
+        OutputSocket output(fd, deadline);
+        output.write(status);
+        output.write(answer);
+        output.flush();
+    } catch (std::exception const &) {
+        // The client has gone or stopped reading, so there is no one to tell
+    }
+    ::close(fd);
+}
+
+/*
+  Fill in a sockaddr_un for socketPath.
+*/
+sockaddr_un socketAddress(const std::string& socketPath) {
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.empty() || socketPath.size() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("Invalid socket path: " + socketPath);
+    }
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    return address;
+}
+
+} // namespace
+
+#endif // _WIN32
+
+/*
+  BethYw::runServer(dir, socketPath, workers, timeoutMs, cacheBytes)
+
+  Import every dataset in dir once and then answer queries sent over a Unix
+  domain socket until the process receives SIGINT or SIGTERM. Each query is a
+  single line using the same syntax as the -d/-a/-m/-y/-j program arguments
+  and is answered from the imported data by one of a fixed number of worker
+  threads.
+
+  @param dir
+    The directory where the datasets are, ending with a directory separator
+
+  @param socketPath
+    The path of the socket to listen on. A stale socket at this path is
+    replaced, but any other type of file is not.
+
+  @param workers
+    The number of worker threads answering queries
+
+  @param timeoutMs
+    The time allowed, in milliseconds, to receive each request and send its
+    response
+
+  @param cacheBytes
+    The memory budget, in bytes, for caching rendered results
+
+  @return
+    Exit code
+
+  @throws
+    std::runtime_error if the socket cannot be created, or any exception
+    thrown while importing the datasets
+
+  @example
+    BethYw::runServer("datasets/", "/tmp/bethyw.sock", 4, 5000, 64 * 1024 * 1024);
+*/
+int BethYw::runServer(const std::string& dir,
+                      const std::string& socketPath,
+                      unsigned int workers,
+                      unsigned int timeoutMs,
+                      size_t cacheBytes) {
+#ifdef _WIN32
+    throw std::runtime_error("BethYw::runServer: Unix domain sockets are not supported on Windows");
+#else
+    sockaddr_un address = socketAddress(socketPath);
+
+    BethYw::QueryEngine engine(dir, cacheBytes);
+    std::vector<std::string> allCodes;
+    for (unsigned int i = 0; i < InputFiles::NUM_DATASETS; i++) {
+        allCodes.push_back(InputFiles::DATASETS[i].CODE);
+    }
+    engine.load(allCodes);
+    const BethYw::QueryEngine &snapshot = engine;
+
+    struct stat existing;
+    if (stat(socketPath.c_str(), &existing) == 0) {
+        if (!S_ISSOCK(existing.st_mode)) {
+            throw std::runtime_error("BethYw::runServer: " + socketPath + " exists and is not a socket");
+        }
+        unlink(socketPath.c_str());
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        throw std::runtime_error(std::string("BethYw::runServer: socket: ") + std::strerror(errno));
+    }
+    if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+            || listen(listener, SOMAXCONN) != 0) {
+        std::string error = std::strerror(errno);
+        ::close(listener);
+        throw std::runtime_error("BethYw::runServer: Failed to listen on " + socketPath + ": " + error);
+    }
+
+    struct sigaction stopAction;
+    std::memset(&stopAction, 0, sizeof(stopAction));
+    stopAction.sa_handler = requestStop;
+    sigaction(SIGINT, &stopAction, nullptr);
+    sigaction(SIGTERM, &stopAction, nullptr);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    ConnectionQueue connections;
+    std::vector<std::thread> pool;
+    for (unsigned int i = 0; i < std::max(workers, 1u); i++) {
+        pool.emplace_back([&connections, &snapshot, timeoutMs] {
+            int fd;
+            while (connections.pop(fd)) {
+                handleConnection(fd, snapshot, timeoutMs);
+            }
+        });
+    }
+
+    std::cerr << "Listening on " << socketPath << std::endl;
+    while (!stopRequested) {
+        // Wake up regularly to check whether we have been asked to stop
+        if (!waitFor(listener, POLLIN, Clock::now() + std::chrono::milliseconds(500))) {
+            continue;
+        }
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            continue;
+        }
+        if (!connections.push(fd)) {
+            writeAll(fd, "ERR Server busy\n", Clock::now() + std::chrono::milliseconds(timeoutMs));
+            ::close(fd);
+        }
+    }
+
+    connections.close();
+    for (auto& worker: pool) {
+        worker.join();
+    }
+    ::close(listener);
+    unlink(socketPath.c_str());
+    return 0;
+#endif
+}
+
+/*
+  BethYw::runClient(socketPath, args)
+
+  Send the program arguments, other than --client and its value, as a query
+  to the server listening on socketPath, and print the response to the
+  standard output (or the error to the standard error).
+
+  @param socketPath
+    The path of the server's socket
+
+  @param args
+    Program arguments, including the program name
+
+  @return
+    Exit code, 1 if the server reported an error
+
+  @throws
+    std::runtime_error if the server cannot be reached
+
+  @example
+    // bethyw --client /tmp/bethyw.sock -d popden -a W06000011
+    BethYw::runClient("/tmp/bethyw.sock", std::vector<std::string>(argv, argv + argc));
+*/
+int BethYw::runClient(const std::string& socketPath, const std::vector<std::string>& args) {
+#ifdef _WIN32
+    throw std::runtime_error("BethYw::runClient: Unix domain sockets are not supported on Windows");
+#else
+    std::string request;
+    for (unsigned int i = 1; i < args.size(); i++) {
+        const std::string &arg = args[i];
+        if (arg == "--client") {
+            i++;
+            continue;
+        } else if (arg.compare(0, 9, "--client=") == 0) {
+            continue;
+        }
+        request += (request.empty() ? "" : " ") + arg;
+    }
+    request += "\n";
+
+    sockaddr_un address = socketAddress(socketPath);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        std::string error = std::strerror(errno);
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        throw std::runtime_error("BethYw::runClient: Failed to connect to " + socketPath + ": " + error);
+    }
+
+    std::signal(SIGPIPE, SIG_IGN);
+    std::string response;
+    if (writeAll(fd, request, Clock::time_point::max())) {
+        char buffer[64 * 1024];
+        ssize_t received;
+        while ((received = recv(fd, buffer, sizeof(buffer), 0)) != 0) {
+            if (received < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            response.append(buffer, received);
+        }
+    }
+    ::close(fd);
+
+    if (response.compare(0, 3, "OK\n") == 0) {
+        OutputStdout output;
+        output.write(response.data() + 3, response.size() - 3);
+        output.flush();
+        return 0;
+    } else if (response.compare(0, 4, "ERR ") == 0) {
+        std::cerr << response.substr(4);
+        return 1;
+    }
+    throw std::runtime_error("BethYw::runClient: No response from " + socketPath);
+#endif
+}
@@ -0,0 +1,56 @@
+#ifndef SERVER_H_
+#define SERVER_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  This file contains the declarations for running Beth Yw? as a resident
+  query server on a Unix domain socket, and for the thin client that forwards
+  its program arguments to that server.
+
+  The protocol is deliberately simple: the client connects, sends its query
+  as a single line of program arguments (e.g. "-d popden -a W06000011 -j"),
+  and the server replies with a status line ("OK" or "ERR <message>")
+  followed by the output, and then closes the connection. The request "stats"
+  instead replies with the server's result cache statistics.
+ */
+
+#include <string>
+#include <vector>
+
+namespace BethYw {
+
+/*
+  Default number of worker threads answering queries in the server.
+*/
+constexpr unsigned int DEFAULT_SERVER_WORKERS = 4;
+
+/*
+  Default time allowed, in milliseconds, to receive a request and send its
+  response.
+*/
+constexpr unsigned int DEFAULT_REQUEST_TIMEOUT_MS = 5000;
+
+/*
+  Import all datasets in dir once and answer queries sent to socketPath until
+  interrupted.
+*/
+int runServer(const std::string& dir,
+              const std::string& socketPath,
+              unsigned int workers,
+              unsigned int timeoutMs,
+              size_t cacheBytes);
+
+/*
+  Forward the program arguments (other than --client) to the server listening
+  on socketPath and print its response.
+*/
+int runClient(const std::string& socketPath, const std::vector<std::string>& args);
+
+} // namespace BethYw
+
+#endif // SERVER_H_
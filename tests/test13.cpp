@@ -0,0 +1,175 @@
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  Catch2 test script — https://github.com/catchorg/Catch2
+  Catch2 is licensed under the BOOST license.
+
+  A differential test of the JSON engines: every document is read with both
+  nlohmann::json and the structural index (jsonindex.h), which must import
+  the same areas or both fail. Run from the directory containing datasets/.
+ */
+
+#include "../lib_catch.hpp"
+
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../datasets.h"
+#include "../areas.h"
+
+namespace {
+
+/*
+  Import a WelshStats JSON document with one engine, returning the areas as
+  JSON, or "error" if the import threw.
+*/
+std::string importWith(JsonEngine engine,
+                       const std::string& document,
+                       const BethYw::SourceColumnMapping& cols) {
+  Areas::setJsonEngine(engine);
+  Areas areas = Areas();
+  std::istringstream stream(document);
+  try {
+    areas.populateFromWelshStatsJSON(stream, cols);
+  } catch (std::exception const &) {
+    Areas::setJsonEngine(JsonEngine::SIMD);
+    return "error";
+  }
+  Areas::setJsonEngine(JsonEngine::SIMD);
+  return areas.toJSON();
+}
+
+std::string readFile(const std::string& path) {
+  std::ifstream file(path);
+  return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+const std::string VALID =
+    "{\"odata.metadata\": \"x\", \"value\": ["
+    "{\"Localauthority_Code\": \"W06000011\", \"Localauthority_ItemName_ENG\": \"Swansea\", "
+    "\"Measure_Code\": \"Pop\", \"Measure_ItemName_ENG\": \"Population\", "
+    "\"Notes\": [1, {\"a\": [true, null]}, \"\\\"\"], "
+    "\"Year_Code\": \"2015\", \"Data\": 242316}, "
+    "{\"Localauthority_Code\": \"W06000011\", \"Localauthority_ItemName_ENG\": \"Swansea\", "
+    "\"Measure_Code\": \"Area\", \"Measure_ItemName_ENG\": \"Land area\", "
+    "\"Year_Code\": \"2015\", \"Data\": 379.7}"
+    "], \"odata.nextLink\": null}\n";
+
+} // namespace
+
+SCENARIO( "the JSON engines import the shipped datasets identically", "[Areas][jsonEngines]" ) {
+
+  for (auto& dataset: BethYw::InputFiles::DATASETS) {
+    if (dataset.PARSER != BethYw::SourceDataType::WelshStatsJSON) {
+      continue;
+    }
+
+    GIVEN( "the dataset " + dataset.FILE ) {
+
+      const std::string document = readFile("datasets/" + dataset.FILE);
+      REQUIRE( !document.empty() );
+
+      THEN( "both engines import the same areas" ) {
+
+        const std::string expected = importWith(JsonEngine::NLOHMANN, document, dataset.COLS);
+        REQUIRE( expected != "error" );
+        REQUIRE( importWith(JsonEngine::SIMD, document, dataset.COLS) == expected );
+        REQUIRE( importWith(JsonEngine::VERIFY, document, dataset.COLS) == expected );
+
+      } // THEN
+
+      THEN( "both engines reject the dataset truncated anywhere" ) {
+
+        for (size_t length = 0; length < document.size(); length += 1 + document.size() / 97) {
+          const std::string truncated = document.substr(0, length);
+          INFO( "truncated to " << length << " bytes" );
+          REQUIRE( importWith(JsonEngine::NLOHMANN, truncated, dataset.COLS) == "error" );
+          REQUIRE( importWith(JsonEngine::SIMD, truncated, dataset.COLS) == "error" );
+        }
+
+      } // THEN
+
+    } // GIVEN
+  }
+
+} // SCENARIO
+
+SCENARIO( "the JSON engines agree on small documents", "[Areas][jsonEngines]" ) {
+
+  const BethYw::SourceColumnMapping &cols = BethYw::InputFiles::POPDEN.COLS;
+
+  GIVEN( "a valid document with nested values in a skipped key" ) {
+
+    THEN( "both engines import the same areas" ) {
+
+      const std::string expected = importWith(JsonEngine::NLOHMANN, VALID, cols);
+      REQUIRE( expected != "error" );
+      REQUIRE( importWith(JsonEngine::SIMD, VALID, cols) == expected );
+
+    } // THEN
+
+    THEN( "both engines reject it truncated to any length" ) {
+
+      for (size_t length = 0; length + 1 < VALID.size(); length++) {
+        const std::string truncated = VALID.substr(0, length);
+        INFO( "truncated to: " << truncated );
+        REQUIRE( importWith(JsonEngine::NLOHMANN, truncated, cols) == "error" );
+        REQUIRE( importWith(JsonEngine::SIMD, truncated, cols) == "error" );
+      }
+
+    } // THEN
+
+  } // GIVEN
+
+  GIVEN( "malformed documents" ) {
+
+    const std::vector<std::string> malformed = {
+      "",
+      "[]",
+      "{\"value\":[}",
+      "{\"value\":[1:]}",
+      "{\"value\":[:]}",
+      "{\"value\":[,]}",
+      "{\"value\":[1,]}",
+      "{\"value\":[1,,2]}",
+      "{\"value\":[1}",
+      "{\"value\":[{]}",
+      "{\"value\":[{}}",
+      "{\"value\":[{}]]}",
+      "{\"value\":[[}]]}",
+      "{\"value\":[{\"Data\":}]}",
+      "{\"value\":[{\"Data\":1,}]}",
+      "{\"value\":[{\"Data\" 1}]}",
+      "{\"value\":[{\"Data\":1 \"Year_Code\":\"2015\"}]}",
+      "{\"value\":[{\"Notes\":[1:2]}]}",
+      "{\"value\":[{\"Notes\":{\"a\":[}}]}",
+      "{\"value\":[]",
+      "{\"value\":[]}}",
+      "{\"value\":[]} x",
+      "{\"value\":[],}",
+      "{\"value\":[] \"next\":1}",
+    };
+
+    THEN( "both engines reject every one of them" ) {
+
+      for (auto& document: malformed) {
+        INFO( "document: " << document );
+        REQUIRE( importWith(JsonEngine::NLOHMANN, document, cols) == "error" );
+        REQUIRE( importWith(JsonEngine::SIMD, document, cols) == "error" );
+      }
+
+    } // THEN
+
+  } // GIVEN
+
+} // SCENARIO
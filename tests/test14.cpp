@@ -0,0 +1,285 @@
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  Catch2 test script — https://github.com/catchorg/Catch2
+  Catch2 is licensed under the BOOST license.
+
+  Measure::rangeStats() with and without its range index, and ranking by a
+  range of years with --by <measure>:<sum|avg|min|max>:YYYY-ZZZZ. Run from the
+  directory containing datasets/.
+ */
+
+#include "../lib_catch.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../area.h"
+#include "../areas.h"
+#include "../measure.h"
+#include "../query.h"
+#include "../ranking.h"
+
+namespace {
+
+/*
+  Check that a Measure gives the same statistics for a range whether or not
+  its range index has been built.
+*/
+RangeStats indexedAndWalked(Measure measure, int firstYear, int lastYear) {
+  const RangeStats walked = measure.rangeStats(firstYear, lastYear);
+  measure.buildRangeIndex();
+  const RangeStats indexed = measure.rangeStats(firstYear, lastYear);
+  REQUIRE( indexed.count == walked.count );
+  REQUIRE( indexed.sum == Approx(walked.sum) );
+  REQUIRE( indexed.average == Approx(walked.average) );
+  REQUIRE( indexed.min == walked.min );
+  REQUIRE( indexed.max == walked.max );
+  return indexed;
+}
+
+} // namespace
+
+SCENARIO( "a Measure can give statistics over a range of years", "[Measure][rangeStats]" ) {
+
+  GIVEN( "a Measure with values for a run of years" ) {
+
+    Measure measure("pop", "Population");
+    measure.setValue(2000, 10);
+    measure.setValue(2001, 40);
+    measure.setValue(2002, 20);
+    measure.setValue(2003, 30);
+
+    THEN( "a range covering some years gives their statistics" ) {
+
+      const RangeStats stats = indexedAndWalked(measure, 2001, 2002);
+      REQUIRE( stats.count == 2 );
+      REQUIRE( stats.sum == Approx(60) );
+      REQUIRE( stats.average == Approx(30) );
+      REQUIRE( stats.min == 20 );
+      REQUIRE( stats.max == 40 );
+
+    } // THEN
+
+    THEN( "a range of one year gives that year's value" ) {
+
+      const RangeStats stats = indexedAndWalked(measure, 2003, 2003);
+      REQUIRE( stats.count == 1 );
+      REQUIRE( stats.sum == Approx(30) );
+      REQUIRE( stats.min == 30 );
+      REQUIRE( stats.max == 30 );
+
+    } // THEN
+
+    THEN( "a range wider than the years gives the statistics of them all" ) {
+
+      const RangeStats stats = indexedAndWalked(measure, 1990, 2010);
+      REQUIRE( stats.count == 4 );
+      REQUIRE( stats.average == Approx(25) );
+      REQUIRE( stats.min == 10 );
+      REQUIRE( stats.max == 40 );
+
+    } // THEN
+
+    THEN( "a range given last year first is the same range" ) {
+
+      const RangeStats stats = indexedAndWalked(measure, 2002, 2001);
+      REQUIRE( stats.count == 2 );
+      REQUIRE( stats.sum == Approx(60) );
+
+    } // THEN
+
+    THEN( "a range outside the years is empty" ) {
+
+      for (auto& range: std::vector<std::pair<int, int>>{{1990, 1999}, {2004, 2010}}) {
+        const RangeStats stats = indexedAndWalked(measure, range.first, range.second);
+        REQUIRE( stats.count == 0 );
+        REQUIRE( stats.sum == 0 );
+        REQUIRE( stats.average == 0 );
+      }
+
+    } // THEN
+
+  } // GIVEN
+
+  GIVEN( "a Measure with gaps between its years" ) {
+
+    Measure measure("pop", "Population");
+    measure.setValue(1991, 5);
+    measure.setValue(1995, 50);
+    measure.setValue(1996, 1);
+    measure.setValue(2011, 100);
+
+    THEN( "a range only counts the years it has values for" ) {
+
+      const RangeStats stats = indexedAndWalked(measure, 1993, 1996);
+      REQUIRE( stats.count == 2 );
+      REQUIRE( stats.sum == Approx(51) );
+      REQUIRE( stats.min == 1 );
+      REQUIRE( stats.max == 50 );
+
+    } // THEN
+
+    THEN( "a range falling in a gap is empty" ) {
+
+      const RangeStats stats = indexedAndWalked(measure, 1997, 2010);
+      REQUIRE( stats.count == 0 );
+
+    } // THEN
+
+    THEN( "every range agrees with walking the values" ) {
+
+      for (int first = 1989; first <= 2013; first++) {
+        for (int last = first; last <= 2013; last++) {
+          indexedAndWalked(measure, first, last);
+        }
+      }
+
+    } // THEN
+
+  } // GIVEN
+
+  GIVEN( "a Measure with no values" ) {
+
+    Measure measure("pop", "Population");
+
+    THEN( "every range is empty" ) {
+
+      REQUIRE( indexedAndWalked(measure, 1990, 2020).count == 0 );
+
+    } // THEN
+
+  } // GIVEN
+
+} // SCENARIO
+
+SCENARIO( "a Measure's range index is shared by copies and discarded by changes", "[Measure][rangeStats]" ) {
+
+  GIVEN( "a Measure whose range index has been built" ) {
+
+    Measure measure("pop", "Population");
+    measure.setValue(2000, 10);
+    measure.setValue(2001, 20);
+    measure.buildRangeIndex();
+    REQUIRE( measure.hasRangeIndex() );
+
+    THEN( "a copy of it has the index too" ) {
+
+      const Measure copy = measure;
+      REQUIRE( copy.hasRangeIndex() );
+      REQUIRE( copy.rangeStats(2000, 2001).sum == Approx(30) );
+
+    } // THEN
+
+    THEN( "setting a value discards the index, and the new value counts" ) {
+
+      measure.setValue(2001, 50);
+      REQUIRE_FALSE( measure.hasRangeIndex() );
+      REQUIRE( measure.rangeStats(2000, 2001).sum == Approx(60) );
+
+    } // THEN
+
+    THEN( "merging it into a Measure with no values keeps its index" ) {
+
+      Measure empty("pop", "Population");
+      empty.merge(Measure(measure));
+      REQUIRE( empty.hasRangeIndex() );
+
+    } // THEN
+
+    THEN( "merging another Measure into it discards the index" ) {
+
+      Measure newer("pop", "Population");
+      newer.setValue(2002, 30);
+      measure.merge(std::move(newer));
+      REQUIRE_FALSE( measure.hasRangeIndex() );
+      REQUIRE( measure.rangeStats(2000, 2002).count == 3 );
+
+    } // THEN
+
+  } // GIVEN
+
+} // SCENARIO
+
+SCENARIO( "areas can be ranked by a statistic over a range of years", "[Ranking][rangeStats]" ) {
+
+  GIVEN( "range keys for --by" ) {
+
+    THEN( "each function and range is parsed, in either order" ) {
+
+      const RankKey key = BethYw::parseRankKey("Pop:MAX:2015-2010");
+      REQUIRE( key.measure == "pop" );
+      REQUIRE( key.statistic == RankKey::Statistic::RANGE_MAX );
+      REQUIRE( key.isRange() );
+      REQUIRE( key.year == 2010 );
+      REQUIRE( key.lastYear == 2015 );
+      REQUIRE( BethYw::parseRankKey("pop:sum:2010-2010").statistic == RankKey::Statistic::RANGE_SUM );
+      REQUIRE( BethYw::parseRankKey("pop:avg:2010-2011").statistic == RankKey::Statistic::RANGE_AVERAGE );
+      REQUIRE( BethYw::parseRankKey("pop:min:2010-2011").statistic == RankKey::Statistic::RANGE_MIN );
+      REQUIRE_FALSE( BethYw::parseRankKey("pop:avg").isRange() );
+
+    } // THEN
+
+    THEN( "malformed ranges are rejected" ) {
+
+      for (auto& by: {"pop:avg:2010", "pop:avg:2010-", "pop:avg:201-2011", "pop:avg:2010-20111",
+                      "pop:avg:2010_2011", "pop:mean:2010-2011", "pop:2010-2011", "pop::2010-2011"}) {
+        INFO( "--by " << by );
+        REQUIRE_THROWS_AS( BethYw::parseRankKey(by), std::invalid_argument );
+      }
+
+    } // THEN
+
+  } // GIVEN
+
+  GIVEN( "a query engine with the popden dataset loaded" ) {
+
+    BethYw::QueryEngine engine("datasets/");
+    engine.load({"popden"});
+
+    THEN( "the selected measures keep the index built when the dataset was loaded" ) {
+
+      const Areas selected = engine.select(BethYw::parseQueryLine("-d popden -a W06000011"));
+      const Measure *pop = selected.findArea("W06000011")->findMeasure("pop");
+      REQUIRE( pop != nullptr );
+      REQUIRE( pop->hasRangeIndex() );
+
+    } // THEN
+
+    THEN( "a batch query ranks by the range the same way as ranking the areas directly" ) {
+
+      const Areas areas = engine.select(BethYw::parseQueryLine("-d popden"));
+
+      const RankKey key = BethYw::parseRankKey("pop:avg:1991-1993");
+      const Ranking ranking = BethYw::rank(areas, key, 3, false);
+      REQUIRE( ranking.getAreas().size() == 3 );
+      for (auto& ranked: ranking.getAreas()) {
+        const Measure *pop = areas.findArea(ranked.code)->findMeasure("pop");
+        REQUIRE( ranked.value == Approx(pop->rangeStats(1991, 1993).average) );
+      }
+
+      const std::string answer = engine.answer(BethYw::parseQueryLine("-d popden --top 3 --by pop:avg:1991-1993 -j"));
+      REQUIRE( answer == ranking.render(BethYw::OutputFormat::JSON) );
+
+    } // THEN
+
+    THEN( "areas with no value in the range are left out" ) {
+
+      const Areas areas = engine.select(BethYw::parseQueryLine("-d popden"));
+      const Ranking ranking = BethYw::rank(areas, BethYw::parseRankKey("pop:sum:2050-2060"), 3, false);
+      REQUIRE( ranking.getAreas().empty() );
+
+    } // THEN
+
+  } // GIVEN
+
+} // SCENARIO
@@ -0,0 +1,173 @@
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  Catch2 test script — https://github.com/catchorg/Catch2
+  Catch2 is licensed under the BOOST license.
+
+  The ThreadPool (submit() and await()) and TaskGroup, with worker threads and
+  with none, where tasks run on the thread that submits them.
+ */
+
+#include "../lib_catch.hpp"
+
+#include <atomic>
+#include <future>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "../threadpool.h"
+
+SCENARIO( "tasks can be submitted to a ThreadPool and awaited", "[ThreadPool]" ) {
+
+  for (unsigned int threads: {1u, 4u}) {
+
+    GIVEN( "a pool of " + std::to_string(threads) + " thread(s)" ) {
+
+      ThreadPool pool(threads);
+
+      THEN( "every submitted task's result is returned by await()" ) {
+
+        std::vector<std::future<int>> results;
+        for (int i = 0; i < 200; i++) {
+          results.push_back(pool.submit([i] { return i * i; }));
+        }
+        for (int i = 0; i < 200; i++) {
+          REQUIRE( pool.await(results[i]) == i * i );
+        }
+
+      } // THEN
+
+      THEN( "an exception thrown by a task is rethrown by await()" ) {
+
+        std::future<int> result = pool.submit([]() -> int {
+          throw std::runtime_error("task failed");
+        });
+        REQUIRE_THROWS_AS( pool.await(result), std::runtime_error );
+
+        std::future<int> next = pool.submit([] { return 7; });
+        REQUIRE( pool.await(next) == 7 );
+
+      } // THEN
+
+      THEN( "a task can submit tasks of its own and await them" ) {
+
+        std::future<int> outer = pool.submit([&pool] {
+          std::vector<std::future<int>> inner;
+          for (int i = 1; i <= 50; i++) {
+            inner.push_back(pool.submit([i] { return i; }));
+          }
+          int sum = 0;
+          for (auto& result: inner) {
+            sum += pool.await(result);
+          }
+          return sum;
+        });
+        REQUIRE( pool.await(outer) == 50 * 51 / 2 );
+
+      } // THEN
+
+    } // GIVEN
+
+  }
+
+  GIVEN( "a pool of one thread" ) {
+
+    ThreadPool pool(1);
+
+    THEN( "it has no workers, and tasks run on the submitting thread" ) {
+
+      const std::thread::id caller = std::this_thread::get_id();
+      std::future<std::thread::id> ran = pool.submit([] { return std::this_thread::get_id(); });
+      REQUIRE( ran.wait_for(std::chrono::seconds(0)) == std::future_status::ready );
+      REQUIRE( ran.get() == caller );
+      REQUIRE_FALSE( pool.runPendingTask() );
+
+    } // THEN
+
+  } // GIVEN
+
+} // SCENARIO
+
+SCENARIO( "tasks can be run together in a TaskGroup", "[ThreadPool][TaskGroup]" ) {
+
+  for (unsigned int threads: {1u, 4u}) {
+
+    GIVEN( "a pool of " + std::to_string(threads) + " thread(s)" ) {
+
+      ThreadPool pool(threads);
+
+      THEN( "wait() returns once every task has run" ) {
+
+        std::vector<int> done(500, 0);
+        TaskGroup group(pool);
+        for (size_t i = 0; i < done.size(); i++) {
+          group.run([&done, i] { done[i] = static_cast<int>(i); });
+        }
+        group.wait();
+
+        std::vector<int> expected(done.size());
+        std::iota(expected.begin(), expected.end(), 0);
+        REQUIRE( done == expected );
+
+      } // THEN
+
+      THEN( "wait() rethrows an exception from a task after the others have run" ) {
+
+        std::atomic<int> ran(0);
+        TaskGroup group(pool);
+        for (int i = 0; i < 20; i++) {
+          group.run([&ran, i] {
+            if (i == 5) {
+              throw std::out_of_range("task 5 failed");
+            }
+            ran++;
+          });
+        }
+        REQUIRE_THROWS_AS( group.wait(), std::out_of_range );
+        REQUIRE( ran == 19 );
+
+        group.run([&ran] { ran++; });
+        REQUIRE_NOTHROW( group.wait() );
+        REQUIRE( ran == 20 );
+
+      } // THEN
+
+      THEN( "tasks in a group can wait on groups of their own" ) {
+
+        std::atomic<int> leaves(0);
+        TaskGroup outer(pool);
+        for (int i = 0; i < 8; i++) {
+          outer.run([&pool, &leaves] {
+            TaskGroup inner(pool);
+            for (int j = 0; j < 8; j++) {
+              inner.run([&leaves] { leaves++; });
+            }
+            inner.wait();
+          });
+        }
+        outer.wait();
+        REQUIRE( leaves == 64 );
+
+      } // THEN
+
+      THEN( "a group with no tasks does not wait" ) {
+
+        TaskGroup group(pool);
+        REQUIRE_NOTHROW( group.wait() );
+
+      } // THEN
+
+    } // GIVEN
+
+  }
+
+} // SCENARIO
@@ -0,0 +1,221 @@
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  Catch2 test script — https://github.com/catchorg/Catch2
+  Catch2 is licensed under the BOOST license.
+
+  Splitting CSV data into ranges of whole rows with CsvScanner::countQuotes()
+  and CsvScanner::nextRowStart(), as large CSV files are split to be parsed in
+  parallel. Quoted fields may hold commas, new lines and doubled quotes, so
+  every split must give the same rows as scanning the data in one go.
+ */
+
+#include "../lib_catch.hpp"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "../csvscanner.h"
+
+namespace {
+
+using Rows = std::vector<std::vector<std::string>>;
+
+/*
+  Scan every row of data[begin, end) into its fields.
+*/
+Rows scanRows(const std::string& data, size_t begin, size_t end) {
+  Rows rows;
+  CsvScanner scanner(data.data() + begin, end - begin);
+  CsvField field;
+  while (scanner.startRow()) {
+    rows.emplace_back();
+    while (scanner.nextField(field)) {
+      rows.back().push_back(field.str());
+    }
+  }
+  return rows;
+}
+
+/*
+  The offset each row starts at, and the size of the data, found by scanning
+  it in one go.
+*/
+std::vector<size_t> rowStarts(const std::string& data) {
+  std::vector<size_t> starts = {0};
+  CsvScanner scanner(data.data(), data.size());
+  while (scanner.startRow()) {
+    scanner.skipRow();
+    starts.push_back(scanner.position());
+  }
+  if (starts.back() != data.size()) {
+    starts.push_back(data.size());
+  }
+  return starts;
+}
+
+/*
+  Split data[from, size) into ranges of whole rows the same way as Areas does
+  for a large CSV file: cut it into equal pieces, count the quotes in each,
+  and move each cut on to the start of the next row outside quotes.
+*/
+std::vector<size_t> splitRows(const std::string& data, size_t from, size_t parts) {
+  const size_t size = data.size();
+  const size_t pieceSize = (size - from + parts - 1) / parts;
+
+  std::vector<size_t> cuts;
+  for (size_t cut = from; cut < size; cut += pieceSize) {
+    cuts.push_back(cut);
+  }
+  cuts.push_back(size);
+
+  std::vector<size_t> starts = {from};
+  size_t quotes = 0;
+  for (size_t i = 0; i + 2 < cuts.size(); i++) {
+    quotes += CsvScanner::countQuotes(data.data() + cuts[i], cuts[i + 1] - cuts[i]);
+    const size_t start = CsvScanner::nextRowStart(data.data(), size, cuts[i + 1], quotes % 2 == 1);
+    starts.push_back(std::max(start, starts.back()));
+  }
+  starts.push_back(size);
+  return starts;
+}
+
+/*
+  A CSV file long enough to cross many of the scanner's blocks, whose rows
+  mix plain fields with quoted commas, new lines and doubled quotes, and
+  which ends some lines with \r\n.
+*/
+std::string awkwardCsv() {
+  const std::vector<std::string> names = {
+    "Cardiff",
+    "\"Bro Morgannwg, Vale of Glamorgan\"",
+    "\"Line one\nline two\"",
+    "\"Said \"\"hello\"\", then left\"",
+    "\"\"",
+    "\"\"\"\"",
+    "\"Ends with a new line\r\n\"",
+    "\"Commas, \"\"quotes\"\"\nand new lines, all at once\"",
+  };
+
+  std::string csv = "AuthorityCode,Name,2015,2016\n";
+  for (size_t i = 0; i < 120; i++) {
+    csv += "W0600" + std::to_string(1000 + i) + "," + names[i % names.size()]
+           + "," + std::to_string(i * 1.5) + "," + std::to_string(i);
+    csv += i % 3 == 0 ? "\r\n" : "\n";
+  }
+  return csv;
+}
+
+} // namespace
+
+SCENARIO( "the start of the next row can be found from any offset of CSV data", "[CsvScanner][nextRowStart]" ) {
+
+  GIVEN( "CSV data with quoted commas, new lines and doubled quotes" ) {
+
+    const std::string csv = awkwardCsv();
+    const std::vector<size_t> starts = rowStarts(csv);
+    REQUIRE( starts.size() == 122 );
+
+    THEN( "from every offset, the next row is found given the quote parity before it" ) {
+
+      for (size_t from = 0; from <= csv.size(); from++) {
+        const bool quoted = CsvScanner::countQuotes(csv.data(), from) % 2 == 1;
+        const size_t expected = *std::upper_bound(starts.begin(), starts.end() - 1, from);
+        INFO( "from " << from );
+        REQUIRE( CsvScanner::nextRowStart(csv.data(), csv.size(), from, quoted) == std::min(expected, csv.size()) );
+      }
+
+    } // THEN
+
+    THEN( "quotes counted piece by piece add up to the quotes in the whole" ) {
+
+      const size_t whole = CsvScanner::countQuotes(csv.data(), csv.size());
+      REQUIRE( whole % 2 == 0 );
+      for (size_t cut = 0; cut <= csv.size(); cut += 7) {
+        REQUIRE( CsvScanner::countQuotes(csv.data(), cut)
+                 + CsvScanner::countQuotes(csv.data() + cut, csv.size() - cut) == whole );
+      }
+
+    } // THEN
+
+  } // GIVEN
+
+  GIVEN( "CSV data with no new line after the last row" ) {
+
+    const std::string csv = "a,b\n\"c\nd\",e";
+
+    THEN( "there is no next row after the last new line" ) {
+
+      REQUIRE( CsvScanner::nextRowStart(csv.data(), csv.size(), 0, false) == 4 );
+      REQUIRE( CsvScanner::nextRowStart(csv.data(), csv.size(), 4, false) == csv.size() );
+      REQUIRE( CsvScanner::nextRowStart(csv.data(), csv.size(), 6, true) == csv.size() );
+
+    } // THEN
+
+  } // GIVEN
+
+} // SCENARIO
+
+SCENARIO( "CSV data can be split into ranges of whole rows", "[CsvScanner][nextRowStart]" ) {
+
+  GIVEN( "CSV data with quoted commas, new lines and doubled quotes" ) {
+
+    const std::string csv = awkwardCsv();
+    const size_t from = csv.find('\n') + 1;
+    const Rows whole = scanRows(csv, from, csv.size());
+    REQUIRE( whole.size() == 120 );
+
+    THEN( "scanning the ranges of any split gives the same rows as scanning the whole" ) {
+
+      for (size_t parts = 1; parts <= 64; parts++) {
+        const std::vector<size_t> starts = splitRows(csv, from, parts);
+        REQUIRE( std::is_sorted(starts.begin(), starts.end()) );
+
+        Rows split;
+        for (size_t i = 0; i + 1 < starts.size(); i++) {
+          const Rows range = scanRows(csv, starts[i], starts[i + 1]);
+          split.insert(split.end(), range.begin(), range.end());
+        }
+        INFO( parts << " parts" );
+        REQUIRE( split == whole );
+      }
+
+    } // THEN
+
+  } // GIVEN
+
+  GIVEN( "CSV data with a quoted field longer than a piece" ) {
+
+    std::string csv = "AuthorityCode,Name\nW06000001,\"";
+    for (int i = 0; i < 100; i++) {
+      csv += "a long field, with a \"\"quote\"\" and\na new line ";
+    }
+    csv += "\"\nW06000002,Short\n";
+    const Rows whole = scanRows(csv, 0, csv.size());
+    REQUIRE( whole.size() == 3 );
+
+    THEN( "the pieces inside the field give empty ranges, and no row is split" ) {
+
+      const std::vector<size_t> starts = splitRows(csv, 0, 16);
+      REQUIRE( std::adjacent_find(starts.begin(), starts.end()) != starts.end() );
+
+      Rows split;
+      for (size_t i = 0; i + 1 < starts.size(); i++) {
+        const Rows range = scanRows(csv, starts[i], starts[i + 1]);
+        split.insert(split.end(), range.begin(), range.end());
+      }
+      REQUIRE( split == whole );
+
+    } // THEN
+
+  } // GIVEN
+
+} // SCENARIO
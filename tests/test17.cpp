@@ -0,0 +1,192 @@
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  Catch2 test script — https://github.com/catchorg/Catch2
+  Catch2 is licensed under the BOOST license.
+
+  The QueryCache of rendered results: least-recently-used eviction within its
+  memory budget, emptying when the generation of the data changes, and the
+  canonical keys that let equivalent queries share a result.
+ */
+
+#include "../lib_catch.hpp"
+
+#include <string>
+
+#include "../cache.h"
+#include "../query.h"
+
+namespace {
+
+/*
+  A rendered result that, stored under a one-character key, is charged
+  exactly 200 bytes (the result, the key twice, and 128 bytes for the nodes).
+*/
+std::string result200(char fill) {
+  return std::string(200 - 2 - 128, fill);
+}
+
+} // namespace
+
+SCENARIO( "the QueryCache evicts the least recently used results to stay within its budget", "[QueryCache]" ) {
+
+  GIVEN( "a cache with room for three results" ) {
+
+    BethYw::QueryCache cache(600);
+    std::string rendered;
+
+    cache.put("a", 1, result200('a'));
+    cache.put("b", 1, result200('b'));
+    cache.put("c", 1, result200('c'));
+    REQUIRE( cache.entries() == 3 );
+    REQUIRE( cache.bytes() == 600 );
+
+    THEN( "a fourth result evicts the one used longest ago" ) {
+
+      cache.put("d", 1, result200('d'));
+      REQUIRE( cache.entries() == 3 );
+      REQUIRE( cache.bytes() == 600 );
+      REQUIRE_FALSE( cache.get("a", 1, rendered) );
+      REQUIRE( cache.get("b", 1, rendered) );
+      REQUIRE( cache.get("d", 1, rendered) );
+      REQUIRE( rendered == result200('d') );
+
+    } // THEN
+
+    THEN( "getting a result makes it the most recently used" ) {
+
+      REQUIRE( cache.get("a", 1, rendered) );
+      cache.put("d", 1, result200('d'));
+      cache.put("e", 1, result200('e'));
+      REQUIRE( cache.get("a", 1, rendered) );
+      REQUIRE( rendered == result200('a') );
+      REQUIRE_FALSE( cache.get("b", 1, rendered) );
+      REQUIRE_FALSE( cache.get("c", 1, rendered) );
+
+    } // THEN
+
+    THEN( "putting a key again replaces its result and makes it the most recently used" ) {
+
+      cache.put("a", 1, result200('A'));
+      REQUIRE( cache.entries() == 3 );
+      REQUIRE( cache.bytes() == 600 );
+      cache.put("d", 1, result200('d'));
+      REQUIRE_FALSE( cache.get("b", 1, rendered) );
+      REQUIRE( cache.get("a", 1, rendered) );
+      REQUIRE( rendered == result200('A') );
+
+    } // THEN
+
+    THEN( "a larger result evicts as many results as it needs to" ) {
+
+      cache.put("d", 1, std::string(400 - 2 - 128, 'd'));
+      REQUIRE( cache.entries() == 2 );
+      REQUIRE( cache.bytes() == 600 );
+      REQUIRE_FALSE( cache.get("a", 1, rendered) );
+      REQUIRE_FALSE( cache.get("b", 1, rendered) );
+      REQUIRE( cache.get("c", 1, rendered) );
+
+    } // THEN
+
+    THEN( "a result larger than the whole budget is not stored, and evicts nothing" ) {
+
+      cache.put("d", 1, std::string(600, 'd'));
+      REQUIRE( cache.entries() == 3 );
+      REQUIRE_FALSE( cache.get("d", 1, rendered) );
+      REQUIRE( cache.get("a", 1, rendered) );
+
+    } // THEN
+
+    THEN( "a result replaced by one larger than the budget is removed" ) {
+
+      cache.put("a", 1, std::string(600, 'a'));
+      REQUIRE( cache.entries() == 2 );
+      REQUIRE( cache.bytes() == 400 );
+      REQUIRE_FALSE( cache.get("a", 1, rendered) );
+
+    } // THEN
+
+  } // GIVEN
+
+} // SCENARIO
+
+SCENARIO( "the QueryCache is emptied when the generation of the data changes", "[QueryCache]" ) {
+
+  GIVEN( "a cache holding results from one generation of the data" ) {
+
+    BethYw::QueryCache cache(1024 * 1024);
+    std::string rendered;
+    cache.put("a", 1, "first a");
+    cache.put("b", 1, "first b");
+
+    THEN( "getting with another generation misses, and empties the cache" ) {
+
+      REQUIRE_FALSE( cache.get("a", 2, rendered) );
+      REQUIRE( cache.entries() == 0 );
+      REQUIRE( cache.bytes() == 0 );
+      REQUIRE_FALSE( cache.get("b", 1, rendered) );
+
+    } // THEN
+
+    THEN( "putting with another generation leaves only the new result" ) {
+
+      cache.put("a", 2, "second a");
+      REQUIRE( cache.entries() == 1 );
+      REQUIRE_FALSE( cache.get("b", 2, rendered) );
+      REQUIRE( cache.get("a", 2, rendered) );
+      REQUIRE( rendered == "second a" );
+
+    } // THEN
+
+    THEN( "hits and misses are counted, and kept when the cache is cleared" ) {
+
+      REQUIRE( cache.get("a", 1, rendered) );
+      REQUIRE( cache.get("b", 1, rendered) );
+      REQUIRE_FALSE( cache.get("c", 1, rendered) );
+      REQUIRE( cache.hits() == 2 );
+      REQUIRE( cache.misses() == 1 );
+
+      cache.clear();
+      REQUIRE( cache.entries() == 0 );
+      REQUIRE( cache.bytes() == 0 );
+      REQUIRE_FALSE( cache.get("a", 1, rendered) );
+      REQUIRE( cache.hits() == 2 );
+      REQUIRE( cache.misses() == 2 );
+
+    } // THEN
+
+  } // GIVEN
+
+} // SCENARIO
+
+SCENARIO( "equivalent queries have the same cache key", "[QueryCache][canonicalQueryKey]" ) {
+
+  GIVEN( "queries written in different ways" ) {
+
+    THEN( "the order of the areas and measures doesn't matter" ) {
+
+      REQUIRE( BethYw::canonicalQueryKey(BethYw::parseQueryLine("-d popden -a W06000011,W06000010 -m pop,area"))
+               == BethYw::canonicalQueryKey(BethYw::parseQueryLine("-d popden -a W06000010,W06000011 -m area,pop")) );
+
+    } // THEN
+
+    THEN( "queries that give different output have different keys" ) {
+
+      const std::string key = BethYw::canonicalQueryKey(BethYw::parseQueryLine("-d popden -a W06000011"));
+      REQUIRE( key != BethYw::canonicalQueryKey(BethYw::parseQueryLine("-d popden -a W06000011 -j")) );
+      REQUIRE( key != BethYw::canonicalQueryKey(BethYw::parseQueryLine("-d popden -a W06000011 -y 2010")) );
+      REQUIRE( key != BethYw::canonicalQueryKey(BethYw::parseQueryLine("-d popden -a W06000010")) );
+      REQUIRE( key != BethYw::canonicalQueryKey(BethYw::parseQueryLine("-d popden -a W06000011 --top 3 --by pop")) );
+
+    } // THEN
+
+  } // GIVEN
+
+} // SCENARIO
@@ -0,0 +1,480 @@
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  Catch2 test script — https://github.com/catchorg/Catch2
+  Catch2 is licensed under the BOOST license.
+
+  The Arrow IPC stream written by ArrowStreamWriter and Areas::writeArrow(),
+  read back with a minimal flatbuffer reader: the schema, the dictionaries,
+  the record batches and the end of the stream.
+ */
+
+#include "../lib_catch.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../area.h"
+#include "../areas.h"
+#include "../arrow.h"
+#include "../measure.h"
+#include "../output.h"
+
+namespace {
+
+/*
+  An OutputSink that keeps everything written to it in memory.
+*/
+class CapturedOutput : public OutputSink {
+public:
+  CapturedOutput() : OutputSink("memory", -1) {}
+  ~CapturedOutput() { flushQuietly(); }
+
+  std::string bytes;
+
+protected:
+  size_t writeSome(const OutputBlock* blocks, size_t count) override {
+    size_t written = 0;
+    for (size_t i = 0; i < count; i++) {
+      bytes.append(blocks[i].data, blocks[i].size);
+      written += blocks[i].size;
+    }
+    return written;
+  }
+};
+
+template <typename T>
+T readAt(const std::string& bytes, size_t position) {
+  REQUIRE( position + sizeof(T) <= bytes.size() );
+  T value;
+  std::memcpy(&value, bytes.data() + position, sizeof(T));
+  return value;
+}
+
+/*
+  A flatbuffer table at an offset into the stream, with just enough to read
+  the fields of Arrow's messages.
+*/
+struct FlatTable {
+  const std::string& bytes;
+  size_t position;
+
+  // The offset of a field from the table, or 0 if it is absent
+  size_t fieldOffset(unsigned int slot) const {
+    const size_t vtable = position - readAt<int32_t>(bytes, position);
+    const size_t entry = 4 + 2 * slot;
+    return entry < readAt<uint16_t>(bytes, vtable) ? readAt<uint16_t>(bytes, vtable + entry) : 0;
+  }
+
+  bool has(unsigned int slot) const {
+    return fieldOffset(slot) != 0;
+  }
+
+  template <typename T>
+  T scalar(unsigned int slot) const {
+    const size_t offset = fieldOffset(slot);
+    return offset == 0 ? T(0) : readAt<T>(bytes, position + offset);
+  }
+
+  // Where the table, string or vector a field refers to starts
+  size_t target(unsigned int slot) const {
+    const size_t offset = fieldOffset(slot);
+    REQUIRE( offset != 0 );
+    return position + offset + readAt<uint32_t>(bytes, position + offset);
+  }
+
+  FlatTable table(unsigned int slot) const {
+    return {bytes, target(slot)};
+  }
+
+  std::string string(unsigned int slot) const {
+    const size_t start = target(slot);
+    return bytes.substr(start + 4, readAt<uint32_t>(bytes, start));
+  }
+
+  size_t vectorLength(unsigned int slot) const {
+    return readAt<uint32_t>(bytes, target(slot));
+  }
+
+  FlatTable tableAt(unsigned int slot, size_t index) const {
+    const size_t element = target(slot) + 4 + 4 * index;
+    return {bytes, element + readAt<uint32_t>(bytes, element)};
+  }
+
+  // An element of a vector of structs of two int64s (FieldNode or Buffer)
+  std::pair<int64_t, int64_t> pairAt(unsigned int slot, size_t index) const {
+    const size_t element = target(slot) + 4 + 16 * index;
+    return {readAt<int64_t>(bytes, element), readAt<int64_t>(bytes, element + 8)};
+  }
+};
+
+/*
+  A message of the stream: its header and where its body starts.
+*/
+struct ArrowMessage {
+  uint8_t headerType;
+  FlatTable header;
+  int64_t bodyLength;
+  size_t body;
+};
+
+constexpr uint8_t HEADER_SCHEMA = 1;
+constexpr uint8_t HEADER_DICTIONARY_BATCH = 2;
+constexpr uint8_t HEADER_RECORD_BATCH = 3;
+
+/*
+  Split a stream into its messages, checking the framing of each and that it
+  ends with the end-of-stream marker.
+*/
+std::vector<ArrowMessage> readMessages(const std::string& bytes) {
+  std::vector<ArrowMessage> messages;
+  size_t position = 0;
+  while (true) {
+    REQUIRE( readAt<uint32_t>(bytes, position) == 0xFFFFFFFF );
+    const uint32_t metadataSize = readAt<uint32_t>(bytes, position + 4);
+    if (metadataSize == 0) {
+      REQUIRE( position + 8 == bytes.size() );
+      return messages;
+    }
+
+    const size_t metadata = position + 8;
+    const size_t body = metadata + metadataSize;
+    REQUIRE( body % 64 == 0 );
+
+    const FlatTable message{bytes, metadata + readAt<uint32_t>(bytes, metadata)};
+    REQUIRE( message.scalar<int16_t>(0) == 4 );
+    messages.push_back({message.scalar<uint8_t>(1), message.table(2), message.scalar<int64_t>(3), body});
+    position = body + static_cast<size_t>(messages.back().bodyLength);
+  }
+}
+
+/*
+  Where each buffer of a RecordBatch starts in the stream, and its length,
+  checking that every buffer is aligned.
+*/
+std::vector<std::pair<size_t, size_t>> bodyBuffers(const ArrowMessage& message, const FlatTable& batch) {
+  std::vector<std::pair<size_t, size_t>> buffers;
+  for (size_t i = 0; i < batch.vectorLength(2); i++) {
+    const std::pair<int64_t, int64_t> buffer = batch.pairAt(2, i);
+    REQUIRE( buffer.first % 64 == 0 );
+    REQUIRE( buffer.first + buffer.second <= message.bodyLength );
+    buffers.push_back({message.body + static_cast<size_t>(buffer.first), static_cast<size_t>(buffer.second)});
+  }
+  return buffers;
+}
+
+template <typename T>
+std::vector<T> readColumn(const std::string& bytes, const std::pair<size_t, size_t>& buffer, size_t length) {
+  REQUIRE( buffer.second == length * sizeof(T) );
+  std::vector<T> column;
+  for (size_t i = 0; i < length; i++) {
+    column.push_back(readAt<T>(bytes, buffer.first + i * sizeof(T)));
+  }
+  return column;
+}
+
+bool isValid(const std::string& bytes, const std::pair<size_t, size_t>& bitmap, size_t index) {
+  REQUIRE( index / 8 < bitmap.second );
+  return (readAt<uint8_t>(bytes, bitmap.first + index / 8) >> (index % 8)) & 1;
+}
+
+/*
+  Read the strings of a DictionaryBatch with the given id.
+*/
+std::vector<std::string> readDictionary(const std::string& bytes, const ArrowMessage& message, int64_t id) {
+  REQUIRE( message.headerType == HEADER_DICTIONARY_BATCH );
+  REQUIRE( message.header.scalar<int64_t>(0) == id );
+
+  const FlatTable data = message.header.table(1);
+  const size_t length = static_cast<size_t>(data.scalar<int64_t>(0));
+  REQUIRE( data.vectorLength(1) == 1 );
+  REQUIRE( data.pairAt(1, 0) == std::make_pair(static_cast<int64_t>(length), int64_t(0)) );
+
+  const auto buffers = bodyBuffers(message, data);
+  REQUIRE( buffers.size() == 3 );
+  const std::vector<int32_t> offsets = readColumn<int32_t>(bytes, buffers[1], length + 1);
+  REQUIRE( static_cast<size_t>(offsets.back()) == buffers[2].second );
+
+  std::vector<std::string> strings;
+  for (size_t i = 0; i < length; i++) {
+    REQUIRE( isValid(bytes, buffers[0], i) );
+    strings.push_back(bytes.substr(buffers[2].first + offsets[i], offsets[i + 1] - offsets[i]));
+  }
+  return strings;
+}
+
+/*
+  Read the rows of a RecordBatch, with NaN for null values.
+*/
+ArrowBatch readBatch(const std::string& bytes, const ArrowMessage& message) {
+  REQUIRE( message.headerType == HEADER_RECORD_BATCH );
+
+  const FlatTable batch = message.header;
+  const size_t length = static_cast<size_t>(batch.scalar<int64_t>(0));
+  const auto buffers = bodyBuffers(message, batch);
+  REQUIRE( buffers.size() == 8 );
+
+  ArrowBatch rows;
+  rows.areas = readColumn<int32_t>(bytes, buffers[1], length);
+  rows.measures = readColumn<int32_t>(bytes, buffers[3], length);
+  rows.years = readColumn<int16_t>(bytes, buffers[5], length);
+  rows.values = readColumn<double>(bytes, buffers[7], length);
+
+  REQUIRE( batch.vectorLength(1) == 4 );
+  int64_t nullValues = 0;
+  for (size_t i = 0; i < length; i++) {
+    REQUIRE( isValid(bytes, buffers[0], i) );
+    REQUIRE( isValid(bytes, buffers[2], i) );
+    REQUIRE( isValid(bytes, buffers[4], i) );
+    if (!isValid(bytes, buffers[6], i)) {
+      rows.values[i] = std::numeric_limits<double>::quiet_NaN();
+      nullValues++;
+    }
+  }
+  for (size_t column = 0; column < 4; column++) {
+    REQUIRE( batch.pairAt(1, column).first == static_cast<int64_t>(length) );
+    REQUIRE( batch.pairAt(1, column).second == (column == 3 ? nullValues : 0) );
+  }
+  return rows;
+}
+
+/*
+  Check a Field of the schema, returning its type table.
+*/
+FlatTable checkField(const FlatTable& field, const std::string& name, uint8_t typeType) {
+  REQUIRE( field.string(0) == name );
+  REQUIRE( field.scalar<uint8_t>(1) == 1 );
+  REQUIRE( field.scalar<uint8_t>(2) == typeType );
+  REQUIRE( field.vectorLength(5) == 0 );
+  return field.table(3);
+}
+
+} // namespace
+
+SCENARIO( "an Arrow stream describes its columns in a schema and dictionaries", "[Arrow]" ) {
+
+  GIVEN( "a stream written with no batches" ) {
+
+    const std::vector<std::string> areaCodes = {"W06000010", "W06000011", "W06000024"};
+    const std::vector<std::string> measureCodes = {"area", "dens", "pop"};
+
+    CapturedOutput output;
+    ArrowStreamWriter writer(output, areaCodes, measureCodes);
+    writer.finish();
+    output.flush();
+
+    const std::vector<ArrowMessage> messages = readMessages(output.bytes);
+    REQUIRE( messages.size() == 3 );
+
+    THEN( "the schema comes first, with the four columns of the long table" ) {
+
+      REQUIRE( messages[0].headerType == HEADER_SCHEMA );
+      REQUIRE( messages[0].bodyLength == 0 );
+
+      const FlatTable schema = messages[0].header;
+      REQUIRE( schema.scalar<int16_t>(0) == 0 );
+      REQUIRE( schema.vectorLength(1) == 4 );
+
+      const std::vector<std::string> names = {"authority_code", "measure_code"};
+      for (int64_t id = 0; id < 2; id++) {
+        const FlatTable field = schema.tableAt(1, static_cast<size_t>(id));
+        checkField(field, names[id], 5);
+        const FlatTable encoding = field.table(4);
+        REQUIRE( encoding.scalar<int64_t>(0) == id );
+        REQUIRE( encoding.table(1).scalar<int32_t>(0) == 32 );
+        REQUIRE( encoding.table(1).scalar<uint8_t>(1) == 1 );
+        REQUIRE( encoding.scalar<uint8_t>(2) == 1 );
+      }
+
+      const FlatTable year = schema.tableAt(1, 2);
+      const FlatTable yearType = checkField(year, "year", 2);
+      REQUIRE( yearType.scalar<int32_t>(0) == 16 );
+      REQUIRE( yearType.scalar<uint8_t>(1) == 1 );
+      REQUIRE_FALSE( year.has(4) );
+
+      const FlatTable value = schema.tableAt(1, 3);
+      REQUIRE( checkField(value, "value", 3).scalar<int16_t>(0) == 2 );
+      REQUIRE_FALSE( value.has(4) );
+
+    } // THEN
+
+    THEN( "the dictionaries of authority and measure codes follow the schema" ) {
+
+      REQUIRE( readDictionary(output.bytes, messages[1], 0) == areaCodes );
+      REQUIRE( readDictionary(output.bytes, messages[2], 1) == measureCodes );
+
+    } // THEN
+
+    THEN( "finishing the stream again writes nothing more" ) {
+
+      const size_t size = output.bytes.size();
+      writer.finish();
+      output.flush();
+      REQUIRE( output.bytes.size() == size );
+
+    } // THEN
+
+  } // GIVEN
+
+  GIVEN( "a stream with empty dictionaries" ) {
+
+    const std::vector<std::string> none;
+    CapturedOutput output;
+    ArrowStreamWriter writer(output, none, none);
+    writer.finish();
+    output.flush();
+
+    THEN( "the dictionaries are written with no strings" ) {
+
+      const std::vector<ArrowMessage> messages = readMessages(output.bytes);
+      REQUIRE( messages.size() == 3 );
+      REQUIRE( readDictionary(output.bytes, messages[1], 0).empty() );
+      REQUIRE( readDictionary(output.bytes, messages[2], 1).empty() );
+
+    } // THEN
+
+  } // GIVEN
+
+} // SCENARIO
+
+SCENARIO( "rows are written to an Arrow stream in record batches", "[Arrow]" ) {
+
+  GIVEN( "a writer with dictionaries of authority and measure codes" ) {
+
+    const std::vector<std::string> areaCodes = {"W06000010", "W06000011"};
+    const std::vector<std::string> measureCodes = {"dens", "pop"};
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+
+    CapturedOutput output;
+    ArrowStreamWriter writer(output, areaCodes, measureCodes);
+
+    THEN( "each batch is read back with the rows written, and NaN values are null" ) {
+
+      ArrowBatch first;
+      for (int i = 0; i < 11; i++) {
+        first.areas.push_back(i % 2);
+        first.measures.push_back((i / 2) % 2);
+        first.years.push_back(static_cast<int16_t>(1991 + i));
+        first.values.push_back(i == 3 || i == 9 ? nan : i * 1.25);
+      }
+      ArrowBatch second;
+      second.areas = {1};
+      second.measures = {0};
+      second.years = {-32768};
+      second.values = {-0.5};
+
+      writer.writeBatch(first);
+      writer.writeBatch(second);
+      writer.finish();
+      output.flush();
+
+      const std::vector<ArrowMessage> messages = readMessages(output.bytes);
+      REQUIRE( messages.size() == 5 );
+
+      for (size_t i = 0; i < 2; i++) {
+        const ArrowBatch& written = i == 0 ? first : second;
+        const ArrowBatch read = readBatch(output.bytes, messages[3 + i]);
+        REQUIRE( read.areas == written.areas );
+        REQUIRE( read.measures == written.measures );
+        REQUIRE( read.years == written.years );
+        REQUIRE( read.size() == written.size() );
+        for (size_t row = 0; row < read.size(); row++) {
+          if (std::isnan(written.values[row])) {
+            REQUIRE( std::isnan(read.values[row]) );
+          } else {
+            REQUIRE( read.values[row] == written.values[row] );
+          }
+        }
+      }
+
+    } // THEN
+
+    THEN( "an empty batch writes nothing" ) {
+
+      output.flush();
+      const size_t size = output.bytes.size();
+      writer.writeBatch(ArrowBatch());
+      output.flush();
+      REQUIRE( output.bytes.size() == size );
+
+    } // THEN
+
+    THEN( "a batch with columns of different lengths is rejected" ) {
+
+      ArrowBatch batch;
+      batch.areas = {0, 1};
+      batch.measures = {0, 1};
+      batch.years = {2000};
+      batch.values = {1, 2};
+      REQUIRE_THROWS_AS( writer.writeBatch(batch), std::invalid_argument );
+
+    } // THEN
+
+  } // GIVEN
+
+} // SCENARIO
+
+SCENARIO( "Areas can be written as an Arrow stream", "[Arrow][Areas]" ) {
+
+  GIVEN( "some areas with measures" ) {
+
+    Areas areas;
+
+    Area swansea("W06000011");
+    Measure pop("pop", "Population");
+    pop.setValue(2010, 239023);
+    pop.setValue(2011, 239993);
+    swansea.setMeasure("pop", pop);
+    Measure dens("dens", "Population density");
+    dens.setValue(2010, 628.5);
+    swansea.setMeasure("dens", dens);
+    areas.setArea("W06000011", swansea);
+
+    Area cardiff("W06000015");
+    Measure area("area", "Land area");
+    area.setValue(2010, 140.4);
+    cardiff.setMeasure("area", area);
+    areas.setArea("W06000015", cardiff);
+
+    CapturedOutput output;
+    areas.writeArrow(output);
+    output.flush();
+
+    THEN( "the stream holds every value of every measure, once" ) {
+
+      const std::vector<ArrowMessage> messages = readMessages(output.bytes);
+      REQUIRE( messages.size() == 4 );
+
+      const std::vector<std::string> areaCodes = readDictionary(output.bytes, messages[1], 0);
+      const std::vector<std::string> measureCodes = readDictionary(output.bytes, messages[2], 1);
+      REQUIRE( areaCodes == std::vector<std::string>{"W06000011", "W06000015"} );
+      REQUIRE( measureCodes == std::vector<std::string>{"area", "dens", "pop"} );
+
+      const ArrowBatch rows = readBatch(output.bytes, messages[3]);
+      REQUIRE( rows.size() == 4 );
+      for (size_t row = 0; row < rows.size(); row++) {
+        const Area *found = areas.findArea(areaCodes.at(rows.areas[row]));
+        REQUIRE( found != nullptr );
+        const Measure *measure = found->findMeasure(measureCodes.at(rows.measures[row]));
+        REQUIRE( measure != nullptr );
+        REQUIRE( measure->getData().at(rows.years[row]) == rows.values[row] );
+      }
+
+    } // THEN
+
+  } // GIVEN
+
+} // SCENARIO
@@ -0,0 +1,295 @@
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  This file contains the implementation of the work-stealing ThreadPool and
+  of TaskGroup. See threadpool.h for an overview of how tasks are scheduled.
+*/
+
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "threadpool.h"
+
+namespace {
+
+/*
+  The pool and index of the worker running on this thread, if any, so that
+  tasks submitted from a worker go to its own deque.
+*/
+thread_local const ThreadPool *currentPool = nullptr;
+thread_local unsigned int currentWorker = 0;
+
+std::mutex sharedMutex;
+std::unique_ptr<ThreadPool> sharedPool;
+unsigned int sharedThreads = 0;
+
+} // namespace
+
+/*
+  ThreadPool::ThreadPool(threads)
+
+  Construct a pool and start its worker threads.
+
+  @param threads
+    The number of worker threads. With 1 or 0 no threads are started and
+    tasks run on the thread that submits them.
+
+  @example
+    ThreadPool pool(4);
+    auto result = pool.submit([] { return 6 * 7; });
+    int answer = pool.await(result);
+*/
+ThreadPool::ThreadPool(unsigned int threads)
+    : queued(0), stopping(false), nextQueue(0) {
+    if (threads <= 1) {
+        return;
+    }
+    for (unsigned int i = 0; i < threads; i++) {
+        queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+    }
+    for (unsigned int i = 0; i < threads; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+/*
+  ThreadPool::~ThreadPool()
+
+  Finish every queued task, then stop and join the worker threads.
+*/
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker: workers) {
+        worker.join();
+    }
+}
+
+/*
+  The number of threads that tasks run on.
+
+  @return
+    The number of worker threads, or 1 if tasks run on the submitting thread
+*/
+unsigned int ThreadPool::size() const {
+    return workers.empty() ? 1 : workers.size();
+}
+
+/*
+  ThreadPool::runPendingTask()
+
+  Run one queued task on the calling thread, if there is one. Used to help
+  with the work while waiting for it to finish.
+
+  @return
+    true if a task was run
+*/
+bool ThreadPool::runPendingTask() {
+    Task task;
+    if (workers.empty() || !takeTask(task)) {
+        return false;
+    }
+    task();
+    return true;
+}
+
+/*
+  Queue a task: on the submitting worker's own deque if it is called from a
+  worker of this pool, otherwise on each worker's deque in turn.
+*/
+void ThreadPool::enqueue(Task task) {
+    if (workers.empty()) {
+        task();
+        return;
+    }
+
+    unsigned int index = currentPool == this
+                         ? currentWorker
+                         : nextQueue++ % queues.size();
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queued++;
+    }
+    wake.notify_one();
+}
+
+/*
+  Take a task to run: the newest task from this worker's own deque, or else
+  the oldest task from another deque.
+
+  @return
+    true if a task was taken
+*/
+bool ThreadPool::takeTask(Task& task) {
+    const unsigned int count = queues.size();
+    const unsigned int own = currentPool == this ? currentWorker : nextQueue % count;
+
+    bool found = false;
+    for (unsigned int i = 0; i < count && !found; i++) {
+        WorkerQueue &queue = *queues[(own + i) % count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            continue;
+        }
+        if (i == 0) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        found = true;
+    }
+
+    if (found) {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queued--;
+    }
+    return found;
+}
+
+/*
+  The loop run by each worker thread: run tasks until the pool is stopping
+  and there are none left, sleeping while there is nothing to do.
+*/
+void ThreadPool::workerLoop(unsigned int index) {
+    currentPool = this;
+    currentWorker = index;
+
+    while (true) {
+        Task task;
+        if (takeTask(task)) {
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this] { return stopping || queued > 0; });
+        if (stopping && queued == 0) {
+            return;
+        }
+    }
+}
+
+/*
+  ThreadPool::configure(threads)
+
+  Set the number of threads for the shared pool. This should be called before
+  the shared pool is first used; if it already exists it is replaced once its
+  queued tasks have finished.
+
+  @param threads
+    The number of worker threads, or 0 for the default
+
+  @example
+    ThreadPool::configure(8);
+    ThreadPool &pool = ThreadPool::shared();
+*/
+void ThreadPool::configure(unsigned int threads) {
+    std::lock_guard<std::mutex> lock(sharedMutex);
+    sharedThreads = threads;
+    sharedPool.reset();
+}
+
+/*
+  ThreadPool::shared()
+
+  The pool shared by importing, querying and rendering, created on first use
+  with the number of threads given to configure() (or the default).
+
+  @return
+    The shared ThreadPool
+*/
+ThreadPool& ThreadPool::shared() {
+    std::lock_guard<std::mutex> lock(sharedMutex);
+    if (!sharedPool) {
+        sharedPool.reset(new ThreadPool(sharedThreads == 0 ? defaultThreads() : sharedThreads));
+    }
+    return *sharedPool;
+}
+
+/*
+  The default number of threads: one per hardware thread.
+
+  @return
+    The number of hardware threads, or 1 if that is unknown
+*/
+unsigned int ThreadPool::defaultThreads() {
+    unsigned int threads = std::thread::hardware_concurrency();
+    return threads == 0 ? 1 : threads;
+}
+
+/*
+  TaskGroup::TaskGroup(pool)
+
+  Construct an empty group of tasks that will run on pool.
+
+  @param pool
+    The ThreadPool to run the tasks on
+
+  @example
+    TaskGroup group(ThreadPool::shared());
+    group.run([] { ... });
+    group.run([] { ... });
+    group.wait();
+*/
+TaskGroup::TaskGroup(ThreadPool& pool) : pool(pool), outstanding(0) {}
+
+/*
+  TaskGroup::~TaskGroup()
+
+  Wait for any tasks still running, discarding their exceptions.
+*/
+TaskGroup::~TaskGroup() {
+    try {
+        wait();
+    } catch (...) {
+    }
+}
+
+/*
+  TaskGroup::wait()
+
+  Wait for every task in the group to finish, helping to run queued tasks in
+  the meantime.
+
+  @throws
+    The first exception thrown by any of the tasks
+*/
+void TaskGroup::wait() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (outstanding == 0) {
+                break;
+            }
+        }
+        if (!pool.runPendingTask()) {
+            std::unique_lock<std::mutex> lock(mutex);
+            done.wait_for(lock, std::chrono::milliseconds(1), [this] { return outstanding == 0; });
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (error) {
+        std::exception_ptr thrown = error;
+        error = nullptr;
+        std::rethrow_exception(thrown);
+    }
+}
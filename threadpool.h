@@ -0,0 +1,149 @@
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  This file contains the ThreadPool and TaskGroup classes, which are shared by
+  everything in Beth Yw? that runs work in parallel (importing datasets,
+  rendering output, answering batches of queries, and so on).
+
+  Each worker thread has its own deque of tasks. A worker takes tasks from the
+  back of its own deque (the most recently submitted, whose data is most
+  likely still in cache), and when that is empty it steals from the front of
+  another worker's deque. This keeps every core busy even when tasks are
+  badly unbalanced, e.g. importing a tiny dataset alongside a huge one.
+
+  With one thread (or fewer) there are no workers at all, and tasks simply
+  run on the thread that submits them.
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class ThreadPool {
+public:
+  explicit ThreadPool(unsigned int threads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  /*
+    Submit a task, returning a future for its result. Exceptions thrown by
+    the task are rethrown by the future's get().
+  */
+  template <typename Function>
+  auto submit(Function&& function) -> std::future<decltype(function())> {
+    using Result = decltype(function());
+    auto task = std::make_shared<std::packaged_task<Result()>>(
+        std::forward<Function>(function));
+    std::future<Result> result = task->get_future();
+    enqueue([task] { (*task)(); });
+    return result;
+  }
+
+  /*
+    Wait for a future, running queued tasks on this thread in the meantime
+    (so waiting from inside a task cannot deadlock the pool).
+  */
+  template <typename Result>
+  Result await(std::future<Result>& future) {
+    while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+      if (!runPendingTask()) {
+        future.wait_for(std::chrono::milliseconds(1));
+      }
+    }
+    return future.get();
+  }
+
+  bool runPendingTask();
+  unsigned int size() const;
+
+  static void configure(unsigned int threads);
+  static ThreadPool& shared();
+  static unsigned int defaultThreads();
+
+private:
+  using Task = std::function<void()>;
+
+  struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void enqueue(Task task);
+  bool takeTask(Task& task);
+  void workerLoop(unsigned int index);
+
+  std::vector<std::unique_ptr<WorkerQueue>> queues;
+  std::vector<std::thread> workers;
+
+  std::mutex sleepMutex;
+  std::condition_variable wake;
+  size_t queued;
+  bool stopping;
+
+  std::atomic<unsigned int> nextQueue;
+};
+
+/*
+  A group of tasks submitted to a ThreadPool that can be waited for together.
+  wait() rethrows the first exception thrown by any of the tasks.
+*/
+class TaskGroup {
+public:
+  explicit TaskGroup(ThreadPool& pool);
+  ~TaskGroup();
+
+  TaskGroup(const TaskGroup&) = delete;
+  TaskGroup& operator=(const TaskGroup&) = delete;
+
+  template <typename Function>
+  void run(Function&& function) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      outstanding++;
+    }
+    auto task = std::make_shared<typename std::decay<Function>::type>(
+        std::forward<Function>(function));
+    pool.submit([this, task] {
+      try {
+        (*task)();
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--outstanding == 0) {
+        done.notify_all();
+      }
+    });
+  }
+
+  void wait();
+
+private:
+  ThreadPool& pool;
+  std::mutex mutex;
+  std::condition_variable done;
+  size_t outstanding;
+  std::exception_ptr error;
+};
+
+#endif // THREADPOOL_H_
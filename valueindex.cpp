@@ -0,0 +1,293 @@
+
+
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  This file contains the implementation of ValueIndex and --where. See
+  valueindex.h for an overview.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "areas.h"
+#include "bethyw.h"
+#include "valueindex.h"
+
+/*
+  ValuePredicate::test(candidate)
+
+  @param candidate
+    An area's value
+
+  @return
+    true if the value passes the comparison
+*/
+bool ValuePredicate::test(double candidate) const {
+    switch (comparison) {
+        case Comparison::LESS:
+            return candidate < value;
+        case Comparison::LESS_EQUAL:
+            return candidate <= value;
+        case Comparison::GREATER_EQUAL:
+            return candidate >= value;
+        case Comparison::GREATER:
+            return candidate > value;
+        default:
+            return candidate == value;
+    }
+}
+
+/*
+  ValueIndex::ValueIndex(areas)
+
+  Construct an index over some areas, with no columns built yet.
+
+  @param areas
+    The areas to index, which must outlive the index and not change while
+    it is used
+
+  @example
+    Areas areas;
+    ...
+    ValueIndex index(areas);
+    auto codes = index.matching(BethYw::parseWhereArg("pop@2015>100000")[0]);
+*/
+ValueIndex::ValueIndex(const Areas& areas) : areas(areas), mutex(), columns() {}
+
+/*
+  ValueIndex::column(measure, year)
+
+  Get the sorted column of values for a measure in a year, building it the
+  first time it is asked for. Areas without the measure, without a value for
+  the year, or whose value is not a number aren't in the column.
+
+  @param measure
+    The measure's codename, in lowercase
+
+  @param year
+    The year
+
+  @return
+    The areas' values in ascending order (ties in authority code order)
+*/
+const ValueIndex::Column& ValueIndex::column(const std::string& measure, int year) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = columns.find({measure, year});
+    if (found != columns.end()) {
+        return *found->second;
+    }
+
+    std::unique_ptr<Column> column(new Column());
+    for (auto& codeArea: areas) {
+        const Measure *data = codeArea.second.findMeasure(measure);
+        if (data == nullptr) {
+            continue;
+        }
+        auto yearValue = data->getData().find(year);
+        if (yearValue != data->getData().end() && !std::isnan(yearValue->second)) {
+            column->push_back({yearValue->second, &codeArea.first});
+        }
+    }
+    // The areas are visited in authority code order, so a stable sort keeps
+    // equal values in that order
+    std::stable_sort(column->begin(), column->end(), [](const Entry& lhs, const Entry& rhs) {
+        return lhs.value < rhs.value;
+    });
+
+    const Column &built = *column;
+    columns.emplace(std::make_pair(measure, year), std::move(column));
+    return built;
+}
+
+/*
+  ValueIndex::matching(predicate)
+
+  Find the areas passing a comparison, with a binary search of the sorted
+  column for the predicate's measure and year.
+
+  @param predicate
+    The comparison
+
+  @return
+    The authority codes of the areas passing it, in order of their value
+
+  @example
+    ValueIndex index(areas);
+    ValuePredicate predicate = BethYw::parseWhereArg("pop@2015>100000")[0];
+    for (auto& code: index.matching(predicate)) {
+        std::cout << code << std::endl;
+    }
+*/
+std::vector<std::string> ValueIndex::matching(const ValuePredicate& predicate) const {
+    const Column &values = column(predicate.measure, predicate.year);
+    auto below = [](const Entry& entry, double value) { return entry.value < value; };
+    auto above = [](double value, const Entry& entry) { return value < entry.value; };
+    const auto first = std::lower_bound(values.begin(), values.end(), predicate.value, below);
+    const auto last = std::upper_bound(first, values.end(), predicate.value, above);
+
+    auto from = values.begin();
+    auto to = values.end();
+    switch (predicate.comparison) {
+        case ValuePredicate::Comparison::LESS:
+            to = first;
+            break;
+        case ValuePredicate::Comparison::LESS_EQUAL:
+            to = last;
+            break;
+        case ValuePredicate::Comparison::GREATER_EQUAL:
+            from = first;
+            break;
+        case ValuePredicate::Comparison::GREATER:
+            from = last;
+            break;
+        default:
+            from = first;
+            to = last;
+            break;
+    }
+
+    std::vector<std::string> codes;
+    codes.reserve(to - from);
+    for (auto it = from; it != to; it++) {
+        codes.push_back(*it->code);
+    }
+    return codes;
+}
+
+/*
+  @return
+    The number of (measure, year) columns built so far
+*/
+size_t ValueIndex::columnCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return columns.size();
+}
+
+/*
+  BethYw::parseWhereArg(where)
+
+  Parse the --where argument: one or more comparisons separated by commas,
+  each a measure codename, @, a year (YYYY), one of <, <=, =, >= and >, and
+  a number.
+
+  @param where
+    The argument
+
+  @return
+    The predicates, in the order given
+
+  @throws
+    std::invalid_argument if a comparison can't be parsed, with the message:
+    Invalid input for where argument
+
+  @example
+    auto predicates = BethYw::parseWhereArg("pop@2015>100000,dens@2015<=500");
+*/
+std::vector<ValuePredicate> BethYw::parseWhereArg(const std::string& where) {
+    const std::invalid_argument invalid("Invalid input for where argument");
+    std::vector<ValuePredicate> predicates;
+
+    size_t start = 0;
+    while (start <= where.size()) {
+        size_t end = where.find(',', start);
+        if (end == std::string::npos) {
+            end = where.size();
+        }
+        const std::string comparison = where.substr(start, end - start);
+        start = end + 1;
+
+        const size_t at = comparison.find('@');
+        const size_t op = comparison.find_first_of("<>=", at);
+        if (at == 0 || at == std::string::npos || op == std::string::npos) {
+            throw invalid;
+        }
+
+        ValuePredicate predicate;
+        predicate.measure = Areas::toLower(comparison.substr(0, at));
+        std::string year = comparison.substr(at + 1, op - at - 1);
+        if (year.size() != 4 || !BethYw::yearIsNumber(year)) {
+            throw invalid;
+        }
+        predicate.year = std::stoi(year);
+
+        size_t number = op + 1;
+        if (comparison[op] == '<' || comparison[op] == '>') {
+            const bool orEqual = number < comparison.size() && comparison[number] == '=';
+            if (orEqual) {
+                number++;
+            }
+            if (comparison[op] == '<') {
+                predicate.comparison = orEqual ? ValuePredicate::Comparison::LESS_EQUAL
+                                               : ValuePredicate::Comparison::LESS;
+            } else {
+                predicate.comparison = orEqual ? ValuePredicate::Comparison::GREATER_EQUAL
+                                               : ValuePredicate::Comparison::GREATER;
+            }
+        } else {
+            predicate.comparison = ValuePredicate::Comparison::EQUAL;
+            if (number < comparison.size() && comparison[number] == '=') {
+                number++;
+            }
+        }
+
+        try {
+            size_t parsed = 0;
+            predicate.value = std::stod(comparison.substr(number), &parsed);
+            if (parsed != comparison.size() - number || std::isnan(predicate.value)) {
+                throw invalid;
+            }
+        } catch (std::logic_error const &) {
+            throw invalid;
+        }
+        predicates.push_back(predicate);
+    }
+    return predicates;
+}
+
+/*
+  BethYw::applyWhere(areas, predicates)
+
+  Remove every area that doesn't pass all the predicates, using a
+  ValueIndex built over the areas for the purpose. The areas must have been
+  imported with the predicates' measures and years (see
+  BethYw::widenFilters), even if they aren't output.
+
+  @param areas
+    The imported areas
+
+  @param predicates
+    The comparisons from --where
+
+  @return
+    void
+
+  @example
+    Areas data = Areas();
+    BethYw::loadDatasets(data, ...);
+    BethYw::applyWhere(data, BethYw::parseWhereArg("pop@2015>100000"));
+*/
+void BethYw::applyWhere(Areas& areas, const std::vector<ValuePredicate>& predicates) {
+    StringFilterSet passing;
+    {
+        const ValueIndex index(areas);
+        for (size_t i = 0; i < predicates.size(); i++) {
+            StringFilterSet matched;
+            for (auto& code: index.matching(predicates[i])) {
+                if (i == 0 || passing.count(code)) {
+                    matched.insert(code);
+                }
+            }
+            passing.swap(matched);
+        }
+    }
+    areas.retainAreas(passing);
+}
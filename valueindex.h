@@ -0,0 +1,89 @@
+#ifndef VALUEINDEX_H_
+#define VALUEINDEX_H_
+
+/*
+  +---------------------------------------+
+  | BETH YW? WELSH GOVERNMENT DATA PARSER |
+  +---------------------------------------+
+
+  AUTHOR: <963906>
+
+  This file contains the declarations for --where, which keeps only the areas
+  whose value of a measure in a year passes a comparison, e.g.
+  "pop@2015>100000" (several can be given, separated by commas, and an area
+  must pass them all). The comparisons see every value, whether or not -m
+  and -y choose to output it.
+
+  A ValueIndex answers these comparisons without scanning every area. For
+  each (measure, year) it is asked about, it builds a column of the areas'
+  values sorted by value, once, and then finds the areas passing any
+  comparison with a binary search. Columns are only built when first needed.
+ */
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "areas.h"
+
+/*
+  A comparison of an area's value of a measure in a year with a number.
+*/
+struct ValuePredicate {
+  enum class Comparison { LESS, LESS_EQUAL, EQUAL, GREATER_EQUAL, GREATER };
+
+  std::string measure;
+  int year = 0;
+  Comparison comparison = Comparison::EQUAL;
+  double value = 0;
+
+  bool test(double candidate) const;
+};
+
+class ValueIndex {
+public:
+  explicit ValueIndex(const Areas& areas);
+
+  ValueIndex(const ValueIndex&) = delete;
+  ValueIndex& operator=(const ValueIndex&) = delete;
+
+  std::vector<std::string> matching(const ValuePredicate& predicate) const;
+  size_t columnCount() const;
+
+private:
+  // An area's value in a column, with its authority code (a key of the
+  // indexed Areas, so the Areas must not change while the index is used)
+  struct Entry {
+    double value;
+    const std::string *code;
+  };
+  using Column = std::vector<Entry>;
+
+  const Column& column(const std::string& measure, int year) const;
+
+  const Areas& areas;
+
+  // Built on first use, and never changed after, so a reference to a
+  // column stays valid once the lock is released
+  mutable std::mutex mutex;
+  mutable std::map<std::pair<std::string, int>, std::unique_ptr<const Column>> columns;
+};
+
+namespace BethYw {
+
+/*
+  Parse the --where argument, e.g. "pop@2015>100000,dens@2015<=500".
+*/
+std::vector<ValuePredicate> parseWhereArg(const std::string& where);
+
+/*
+  Keep only the areas passing every predicate.
+*/
+void applyWhere(Areas& areas, const std::vector<ValuePredicate>& predicates);
+
+} // namespace BethYw
+
+#endif // VALUEINDEX_H_